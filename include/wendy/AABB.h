@@ -89,7 +89,8 @@ public:
   /*! The center of this bounding box.
    */
   vec3 center;
-  /*! The size of this bounding box.
+  /*! The size of this bounding box.  This is the full width, height and
+   *  depth, so the box extends half of it in each direction from the center.
    */
   vec3 size;
 };
@@ -69,7 +69,8 @@ public:
    */
   const AABB& getOrthoVolume() const;
   /*! Sets the volume used by orthographic projection.
-   *  @param[in] newVolume The volume to use.
+   *  @param[in] newVolume The volume to use.  The projection spans the bounds
+   *  of the box, i.e. half its size on each side of its center.
    */
   void setOrthoVolume(const AABB& newVolume);
   /*! @return The field of view, in degrees, of this camera.
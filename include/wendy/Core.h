@@ -28,6 +28,7 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 
 #include <cstdarg>
 #include <cstddef>
@@ -227,6 +228,14 @@ public:
     object(initObject)
   {
   }
+  /*! Move constructor.  This takes over the object owned by the source,
+   *  leaving it empty.
+   */
+  Ptr(Ptr<T>&& source) throw():
+    object(source.object)
+  {
+    source.object = NULL;
+  }
   /*! Destructor
    */
   virtual ~Ptr()
@@ -278,6 +287,22 @@ public:
     object = newObject;
     return *this;
   }
+  /*! Move assignment operator.  This takes over the object owned by the
+   *  source, leaving it empty.
+   */
+  Ptr<T>& operator = (Ptr<T>&& source) throw()
+  {
+    if (this != &source)
+    {
+      if (object)
+        delete object;
+
+      object = source.object;
+      source.object = NULL;
+    }
+
+    return *this;
+  }
   /*! @return The currently owned object.
    */
   T* getObject()
@@ -304,15 +329,28 @@ private:
 
 ///////////////////////////////////////////////////////////////////////
 
+class RefTracker;
+
+///////////////////////////////////////////////////////////////////////
+
 /*! @brief Base class for references.
  *  @remarks Concept taken from MoSync.
  */
 class RefBase
 {
 protected:
-  static bool unreferenced(RefObject* object);
   static void increment(RefObject* object);
-  static void decrement(RefObject* object);
+  /*! @return @c true if this removed the last reference to the object.
+   */
+  static bool decrement(RefObject* object);
+  static RefTracker* track(RefObject* object);
+  static void retain(RefTracker* tracker);
+  static void untrack(RefTracker* tracker);
+  /*! @return The tracked object with a new reference added, or @c NULL if it
+   *  has been or is being destroyed.
+   */
+  static RefObject* lock(RefTracker* tracker);
+  static bool isExpired(const RefTracker* tracker);
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -321,6 +359,10 @@ protected:
  *
  *  @remarks No, there are no visible knobs on this class. Use the Ref class to
  *  point to objects derived from RefObject to enable reference counting.
+ *
+ *  @remarks Reference counts are updated atomically unless the library is
+ *  built with @c WENDY_ATOMIC_REFCOUNTS disabled, in which case references to
+ *  an object may only be used by one thread at a time.
  */
 class RefObject
 {
@@ -339,7 +381,8 @@ public:
    */
   RefObject& operator = (const RefObject& source);
 private:
-  uint count;
+  std::atomic<uint> count;
+  std::atomic<RefTracker*> tracker;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -375,6 +418,14 @@ public:
   {
     operator = (source);
   }
+  /*! Move constructor.  This takes over the reference held by the source,
+   *  leaving it empty, without changing the reference count.
+   */
+  Ref(Ref<T>&& source) throw():
+    object(source.object)
+  {
+    source.object = NULL;
+  }
   /*! Destructor
    */
   ~Ref()
@@ -400,12 +451,7 @@ public:
     if (newObject)
       increment(newObject);
 
-    if (object)
-    {
-      decrement(object);
-      if (unreferenced(object))
-        delete static_cast<RefObject*>(object);
-    }
+    release();
 
     object = newObject;
     return *this;
@@ -416,6 +462,21 @@ public:
   {
     return operator = (source.object);
   }
+  /*! Move assignment operator.  This takes over the reference held by the
+   *  source, leaving it empty, without changing its reference count.
+   */
+  Ref<T>& operator = (Ref<T>&& source) throw()
+  {
+    if (this != &source)
+    {
+      release();
+
+      object = source.object;
+      source.object = NULL;
+    }
+
+    return *this;
+  }
   /*! @return The currently owned object.
    */
   T* getObject() const
@@ -423,11 +484,107 @@ public:
     return object;
   }
 private:
+  void release()
+  {
+    if (object && decrement(object))
+      delete static_cast<RefObject*>(object);
+  }
   T* object;
 };
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @brief Weak smart reference.
+ *
+ *  Pointer to an object that inherits from RefObject, which does not keep the
+ *  object alive.  Use lock to get a Ref to the object, if it still exists.
+ *  This is useful for caches that shouldn't own what they contain.
+ *
+ *  @remarks Only objects owned through Ref are tracked; an object which has
+ *  never been referenced is considered expired.
+ */
+template <typename T>
+class WeakRef : public RefBase
+{
+public:
+  /*! Default constructor.
+   */
+  WeakRef(T* initObject = NULL):
+    tracker(NULL)
+  {
+    operator = (initObject);
+  }
+  /*! Copy constructor.
+   */
+  WeakRef(const WeakRef<T>& source):
+    tracker(NULL)
+  {
+    operator = (source);
+  }
+  /*! Destructor.
+   */
+  ~WeakRef()
+  {
+    if (tracker)
+      untrack(tracker);
+  }
+  /*! @return A reference to the object, or @c NULL if it has been destroyed.
+   */
+  Ref<T> lock() const
+  {
+    if (!tracker)
+      return NULL;
+
+    RefObject* object = RefBase::lock(tracker);
+    if (!object)
+      return NULL;
+
+    // The new reference keeps the object alive, so the one added by locking
+    // can be dropped without checking for the last one
+    Ref<T> result(static_cast<T*>(object));
+    decrement(object);
+    return result;
+  }
+  /*! @return @c true if the object has been destroyed or no object is
+   *  referenced, otherwise @c false.
+   */
+  bool isExpired() const
+  {
+    return !tracker || RefBase::isExpired(tracker);
+  }
+  /*! Object assignment operator.
+   */
+  WeakRef<T>& operator = (T* newObject)
+  {
+    RefTracker* newTracker = NULL;
+    if (newObject)
+      newTracker = track(newObject);
+
+    if (tracker)
+      untrack(tracker);
+
+    tracker = newTracker;
+    return *this;
+  }
+  /*! Assignment operator.
+   */
+  WeakRef<T>& operator = (const WeakRef<T>& source)
+  {
+    if (source.tracker)
+      retain(source.tracker);
+
+    if (tracker)
+      untrack(tracker);
+
+    tracker = source.tracker;
+    return *this;
+  }
+private:
+  RefTracker* tracker;
+};
+
+///////////////////////////////////////////////////////////////////////
+
 /*! @brief %Singleton template mixin.
  *
  *  Inherit from this to become a compatible singleton.
@@ -482,6 +639,8 @@ public:
    */
   virtual ~LogConsumer();
   /*! Called for each message generated by log, logWarning and logError.
+   *  @remarks This may be called from any thread that logs, such as resource
+   *  loader workers, but never by two threads at the same time.
    */
   virtual void onLogEntry(LogEntryType type, const char* message) = 0;
 };
@@ -59,6 +59,8 @@ private:
     ITEM_POINTS,
     ITEM_LINES,
     ITEM_TRIANGLES,
+    ITEM_UNIFORMS,
+    ITEM_SKIPPED_UNIFORMS,
     ITEM_TEXTURES,
     ITEM_VERTEXBUFFERS,
     ITEM_INDEXBUFFERS,
@@ -31,6 +31,12 @@
 #include <wendy/RenderState.h>
 #include <wendy/RenderScene.h>
 
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 ///////////////////////////////////////////////////////////////////////
 
 namespace wendy
@@ -45,6 +51,11 @@ namespace wendy
  */
 class SharedProgramState : public render::SharedProgramState
 {
+public:
+  /*! Constructor.
+   *  @param[in] mode The desired shared uniform mode.
+   */
+  SharedProgramState(Mode mode = UNIFORM_MODE);
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -65,20 +76,88 @@ public:
   /*! The shared program state to be used by the renderer.
    */
   Ref<SharedProgramState> state;
+  /*! Whether submitted scenes are to be rendered on a dedicated render
+   *  thread.  Defaults to @c false.
+   *
+   *  @remarks Threaded mode is experimental.  The OpenGL context is handed
+   *  between the calling thread and the render thread every frame, which
+   *  costs a context switch on each side, and the geometry pool is shared
+   *  rather than double-buffered.  Measure before enabling it.
+   */
+  bool threaded;
 };
 
 ///////////////////////////////////////////////////////////////////////
 
 /*! @brief Forward renderer.
  *  @ingroup renderer
+ *
+ *  @remarks Runs of sorted operations sharing the same pass and primitive
+ *  range are rendered as a single instanced draw if the program of the pass
+ *  declares the per-instance model matrix attribute.  The per-instance model
+ *  matrices are streamed through the geometry pool.
+ *
+ *  @remarks For scenes that rarely change, the sorted and batched operations
+ *  can be recorded into a command buffer once and replayed in later frames.
+ *
+ *  @remarks In the experimental threaded mode, submitted scenes are rendered
+ *  on a dedicated thread that owns the OpenGL context while it renders.  The passes used by
+ *  a submitted scene are copied on submission, so materials may be changed or
+ *  released right away.  Only work that makes no OpenGL calls overlaps with
+ *  rendering, such as simulation, scene graph updates and enqueueing models.
+ *  The geometry pool is not double-buffered, so sprites, text and other
+ *  geometry allocated from it may only be enqueued, like any other OpenGL
+ *  call, after Renderer::synchronize has been called.  Models and other
+ *  resources referenced by a submitted scene must stay alive until then.
  */
 class Renderer : public render::System
 {
 public:
+  /*! Destructor.
+   */
+  ~Renderer();
+  /*! Submits the specified scene for rendering to the current framebuffer
+   *  using the specified camera, and empties the scene.
+   *
+   *  In threaded mode, the contents of the scene are exchanged with those of
+   *  the scene last rendered by the render thread, which then renders them
+   *  with private copies of their passes while this call returns
+   *  immediately.  Otherwise, the scene is rendered before this call returns.
+   */
+  void submit(render::Scene& scene, const Camera& camera);
+  /*! Waits for the render thread to finish rendering the last submitted
+   *  scene and makes the OpenGL context current on the calling thread.  Does
+   *  nothing if the renderer is not in threaded mode.
+   */
+  void synchronize();
+  /*! @return @c true if this renderer renders submitted scenes on a
+   *  dedicated render thread, otherwise @c false.
+   */
+  bool isThreaded() const;
   /*! Renders the specified scene to the current framebuffer using the
    *  specified camera.
    */
   void render(const render::Scene& scene, const Camera& camera);
+  /*! Replays the specified recorded command buffer to the current framebuffer
+   *  using the specified camera.
+   *  @remarks The camera matrices are taken from the specified camera, but
+   *  culling and sorting were done for the camera the scene was enqueued with
+   *  when the buffer was recorded.
+   */
+  void render(const render::CommandBuffer& buffer, const Camera& camera);
+  /*! Records the sorted and batched operations of the specified scene into
+   *  the specified command buffer, replacing its previous contents.
+   *  @param[in] revision The revision of the source data, for example the
+   *  revision of the scene graph the scene was enqueued from.
+   *  @return @c true if successful, or @c false if an error occurred.
+   *
+   *  @remarks Scenes containing geometry allocated from the geometry pool,
+   *  such as sprites, text or UI drawing, cannot be recorded, as that
+   *  geometry is overwritten by later frames.  The buffer is left invalid.
+   */
+  bool record(render::CommandBuffer& buffer,
+              const render::Scene& scene,
+              uint revision = 0);
   /*! @return The shared program state object used by this renderer.
    */
   SharedProgramState& getSharedProgramState();
@@ -91,9 +170,28 @@ public:
 private:
   Renderer(render::GeometryPool& pool);
   bool init(const Config& config);
+  void runRenderThread();
+  void renderScene(const render::Scene& scene, const Camera& camera);
+  void beginRender(const Camera& camera);
+  void endRender();
   void renderOperations(const render::Queue& queue);
+  void recordOperations(render::CommandBuffer& buffer,
+                        const render::Queue& queue);
   void releaseObjects();
+  void snapshotPasses(render::Queue& queue);
   Ref<SharedProgramState> state;
+  std::vector<mat4> transforms;
+  Ptr<render::Scene> submitted;
+  std::deque<render::Pass> passes;
+  std::unordered_map<const render::Pass*, const render::Pass*> passCopies;
+  Camera submittedCamera;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool pending;
+  bool quitting;
+  bool detached;
+  bool instancingFailed;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -86,6 +86,42 @@ public:
    *  @remarks Even partial intersection counts.
    */
   bool intersects(const AABB& box) const;
+  /*! Checks which of the specified spheres intersect this frustum.
+   *
+   *  The spheres are given in structure-of-arrays layout, with one array per
+   *  component.  The result for each sphere is written to the corresponding
+   *  element of @a results, as @c 1 if it intersects and @c 0 if it doesn't.
+   *
+   *  @remarks Even partial intersection counts.
+   */
+  void intersects(const float* centerX,
+                  const float* centerY,
+                  const float* centerZ,
+                  const float* radius,
+                  size_t count,
+                  uint8* results) const;
+  /*! Checks which of the specified bounding boxes intersect this frustum.
+   *
+   *  The boxes are given in structure-of-arrays layout, with one array per
+   *  component of their minimum and maximum points.  The result for each box
+   *  is written to the corresponding element of @a results, as @c 1 if it
+   *  intersects and @c 0 if it doesn't.
+   *
+   *  @remarks Even partial intersection counts.
+   */
+  void intersects(const float* minX,
+                  const float* minY,
+                  const float* minZ,
+                  const float* maxX,
+                  const float* maxY,
+                  const float* maxZ,
+                  size_t count,
+                  uint8* results) const;
+  /*! Calculates the corner points of this frustum, in the order near top
+   *  left, near top right, near bottom right, near bottom left, followed by
+   *  the same corners of the far plane.
+   */
+  void getCorners(vec3 corners[8]) const;
   /*! Transforms the planes of this frustum by the specified transform.
    */
   void transformBy(const Transform3& transform);
@@ -103,8 +139,15 @@ public:
   void setOrtho(float minX, float minY, float minZ,
                 float maxX, float maxY, float maxZ);
   /*! The planes of this frustum.
+   *
+   *  @remarks Use the set and transform functions to change the planes, as
+   *  data derived from them is cached.
    */
   Plane planes[6];
+private:
+  void updateCornerBounds();
+  vec3 cornerMinimum;
+  vec3 cornerMaximum;
 };
 
 ///////////////////////////////////////////////////////////////////////
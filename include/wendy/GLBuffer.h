@@ -72,7 +72,14 @@ enum LockType
   LOCK_WRITE_ONLY,
   /*! Requests read and write access.
    */
-  LOCK_READ_WRITE
+  LOCK_READ_WRITE,
+  /*! Requests write-only access without synchronizing with pending rendering.
+   *  The previous contents of the locked range are discarded.
+   *
+   *  @remarks It is the responsibility of the caller to ensure that the locked
+   *  range is not used by any pending rendering.
+   */
+  LOCK_WRITE_UNSYNCHRONIZED
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -105,6 +112,13 @@ public:
    *  @return The base address of the vertices.
    */
   void* lock(LockType type = LOCK_WRITE_ONLY);
+  /*! Locks the specified range of this vertex buffer for reading and writing.
+   *  @param[in] start The index of the first vertex to lock.
+   *  @param[in] count The number of vertices to lock.
+   *  @param[in] type The desired type of lock.
+   *  @return The address of the first locked vertex.
+   */
+  void* lock(size_t start, size_t count, LockType type = LOCK_WRITE_ONLY);
   /*! Unlocks this vertex buffer, finalizing any changes.
    */
   void unlock();
@@ -202,6 +216,13 @@ public:
    *  @return The base address of the index elements.
    */
   void* lock(LockType type = LOCK_WRITE_ONLY);
+  /*! Locks the specified range of this index buffer for reading and writing.
+   *  @param[in] start The index of the first index element to lock.
+   *  @param[in] count The number of index elements to lock.
+   *  @param[in] type The desired type of lock.
+   *  @return The address of the first locked index element.
+   */
+  void* lock(size_t start, size_t count, LockType type = LOCK_WRITE_ONLY);
   /*! Unlocks this index buffer, finalizing any changes.
    */
   void unlock();
@@ -413,6 +434,14 @@ public:
                  size_t start,
                  size_t count,
                  size_t base = 0);
+  /*! @return @c true if this primitive range refers to the same primitives as
+   *  the specified range, or @c false otherwise.
+   */
+  bool operator == (const PrimitiveRange& other) const;
+  /*! @return @c true if this primitive range does not refer to the same
+   *  primitives as the specified range, or @c false otherwise.
+   */
+  bool operator != (const PrimitiveRange& other) const;
   /*! @return @c true if this primitive range contains zero primitives,
    *  otherwise @c false.
    */
@@ -450,10 +479,11 @@ class VertexRangeLock
 public:
   /*! Constructor.
    *  @param[in] range The vertex range to lock.
+   *  @param[in] type The desired type of lock.
    *  @remarks The vertex range must not already be locked.
    *  @remarks The specified vertex range object is copied, not referenced.
    */
-  VertexRangeLock(VertexRange& initRange):
+  VertexRangeLock(VertexRange& initRange, LockType type = LOCK_WRITE_ONLY):
     range(initRange),
     vertices(NULL)
   {
@@ -469,7 +499,7 @@ public:
       }
     }
 
-    vertices = (T*) range.lock();
+    vertices = (T*) range.lock(type);
     if (!vertices)
       panic("Failed to lock vertex buffer");
   }
@@ -503,10 +533,11 @@ class IndexRangeLock
 public:
   /*! Constructor.
    *  @param[in] range The index range to lock.
+   *  @param[in] type The desired type of lock.
    *  @remarks The index range must not already be locked.
    *  @remarks The specified index range object is copied, not referenced.
    */
-  IndexRangeLock(IndexRange& range);
+  IndexRangeLock(IndexRange& range, LockType type = LOCK_WRITE_ONLY);
   /*! Destructor.
    *  Releases any lock held.
    */
@@ -690,11 +721,11 @@ private:
 ///////////////////////////////////////////////////////////////////////
 
 template <>
-IndexRangeLock<uint8>::IndexRangeLock(IndexRange &range);
+IndexRangeLock<uint8>::IndexRangeLock(IndexRange &range, LockType type);
 template <>
-IndexRangeLock<uint16>::IndexRangeLock(IndexRange &range);
+IndexRangeLock<uint16>::IndexRangeLock(IndexRange &range, LockType type);
 template <>
-IndexRangeLock<uint32>::IndexRangeLock(IndexRange &range);
+IndexRangeLock<uint32>::IndexRangeLock(IndexRange &range, LockType type);
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -34,6 +34,7 @@
 #include <wendy/Timer.h>
 
 #include <deque>
+#include <map>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -51,7 +52,9 @@ namespace wendy
 class VertexBuffer;
 class IndexBuffer;
 class Context;
+class VertexRange;
 class PrimitiveRange;
+class UniformBlock;
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -341,6 +344,12 @@ public:
   /*! The number of available vertex attributes.
    */
   uint maxVertexAttributes;
+  /*! The number of available uniform buffer binding points.
+   */
+  uint maxUniformBufferBindings;
+  /*! The required alignment, in bytes, of uniform buffer range offsets.
+   */
+  uint uniformBufferOffsetAlignment;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -361,11 +370,15 @@ public:
     uint pointCount;
     uint lineCount;
     uint triangleCount;
+    uint uniformUploadCount;
+    uint skippedUniformUploadCount;
     Time duration;
   };
   Stats();
   void addFrame();
   void addStateChange();
+  void addUniformUpload();
+  void addSkippedUniformUpload();
   void addPrimitives(PrimitiveType type, uint vertexCount);
   void addTexture(size_t size);
   void removeTexture(size_t size);
@@ -409,6 +422,7 @@ class SharedProgramState : public RefObject
 public:
   virtual void updateTo(Uniform& uniform) = 0;
   virtual void updateTo(Sampler& uniform) = 0;
+  virtual void updateTo(UniformBlock& block) = 0;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -422,6 +436,10 @@ public:
  */
 class Context : public Singleton<Context>
 {
+  friend class UniformBlock;
+  friend class Program;
+  friend class VertexBuffer;
+  friend class IndexBuffer;
 public:
   /*! Refresh mode enumeration.
    */
@@ -473,6 +491,14 @@ public:
               uint start,
               uint count,
               uint base = 0);
+  /*! Renders the specified primitive range to the current framebuffer once
+   *  for each per-instance model matrix in the specified vertex range, using
+   *  the current GLSL program.
+   *  @pre A GLSL program with a per-instance model matrix attribute must be
+   *  set before calling this method.
+   *  @remarks The vertices of the instance range must each be a single @c mat4.
+   */
+  void render(const PrimitiveRange& range, const VertexRange& instances);
   /*! Makes Context::update to return when in manual refresh mode, forcing
    *  a new iteration of the render loop.
    */
@@ -486,18 +512,51 @@ public:
    *  emitted.
    */
   void requestClose();
+  /*! Makes this context current on the calling thread.
+   *  @remarks The context must not be current on any other thread.
+   */
+  void makeCurrent();
+  /*! Detaches this context from the calling thread, so that it can be made
+   *  current on another thread.
+   */
+  void releaseCurrent();
+  /*! @return @c true if this context is current on the calling thread,
+   *  otherwise @c false.
+   */
+  bool isCurrent() const;
   /*! Reserves the specified sampler uniform signature as shared.
    */
   void createSharedSampler(const char* name, SamplerType type, int ID);
   /*! Reserves the specified non-sampler uniform signature as shared.
+   *  @param[in] name The name of the uniform.
+   *  @param[in] type The type of the uniform.
+   *  @param[in] ID The shared ID of the uniform.
+   *  @param[in] blockID The shared ID of the uniform block to declare the
+   *  uniform in, or @c INVALID_SHARED_STATE_ID to declare it on its own.
+   *
+   *  @remarks Block members are laid out in std140 order of reservation.
+   */
+  void createSharedUniform(const char* name,
+                           UniformType type,
+                           int ID,
+                           int blockID = INVALID_SHARED_STATE_ID);
+  /*! Reserves the specified uniform block name as shared, backed by a
+   *  uniform buffer owned by this context.
+   *  @param[in] name The name of the uniform block.
+   *  @param[in] ID The shared ID of the uniform block, which is also the
+   *  uniform buffer binding point it is bound to.
+   *  @return @c true if successful, or @c false otherwise.
    */
-  void createSharedUniform(const char* name, UniformType type, int ID);
+  bool createSharedUniformBlock(const char* name, int ID);
   /*! @return The shared ID of the specified sampler uniform signature.
    */
   int getSharedSamplerID(const char* name, SamplerType type) const;
   /*! @return The shared ID of the specified non-sampler uniform signature.
    */
   int getSharedUniformID(const char* name, UniformType type) const;
+  /*! @return The shared ID of the specified uniform block.
+   */
+  int getSharedUniformBlockID(const char* name) const;
   /*! @return The current shared program state, or @c NULL if no shared program
    *  state is currently set.
    */
@@ -613,6 +672,37 @@ public:
   /*! @return The OpenGL version.
    */
   Version getVersion() const;
+  /*! @return @c true if this context supports instanced rendering with
+   *  per-instance attributes, or @c false otherwise.
+   */
+  bool isInstancingSupported() const;
+  /*! @return @c true if this context supports uniform blocks backed by
+   *  uniform buffers, or @c false otherwise.
+   */
+  bool isUniformBufferSupported() const;
+  /*! @return @c true if this context caches vertex attribute bindings in
+   *  vertex array objects, or @c false otherwise.
+   */
+  bool isVertexArraySupported() const;
+  /*! @return @c true if this context can retrieve and load linked program
+   *  binaries, or @c false otherwise.
+   */
+  bool isProgramBinarySupported() const;
+  /*! @return @c true if this context supports packed 2-10-10-10 vertex
+   *  components, or @c false otherwise.
+   */
+  bool isPackedVertexSupported() const;
+  /*! @return The directory where linked program binaries are cached, or an
+   *  empty path if program binary caching is disabled.
+   */
+  const Path& getProgramCachePath() const;
+  /*! Sets the directory where linked program binaries are cached.  Programs
+   *  created after this call are loaded from this cache when possible, and
+   *  are added to it otherwise.
+   *  @param[in] newPath The desired cache directory, or an empty path to
+   *  disable program binary caching.
+   */
+  void setProgramCachePath(const Path& newPath);
   /*! @return The signal for per-frame post-render clean-up.
    */
   SignalProxy0<void> getFinishSignal();
@@ -636,6 +726,13 @@ private:
   Context(const Context& source);
   Context& operator = (const Context& source);
   bool init(const WindowConfig& wc, const ContextConfig& cc);
+  bool bindAttributes();
+  bool setupAttributes(bool enable);
+  void unbindVertexArray();
+  void deleteVertexArrays(const void* object);
+  void draw(PrimitiveType type, uint start, uint count, uint base, uint instanceCount);
+  void updateSharedUniformBlock(int ID, const void* data);
+  void updateDeclaration();
   void applyState(const RenderState& newState);
   void forceState(const RenderState& newState);
   static void sizeCallback(GLFWwindow* window, int width, int height);
@@ -643,6 +740,17 @@ private:
   static void refreshCallback(GLFWwindow* window);
   class SharedSampler;
   class SharedUniform;
+  class SharedUniformBlock;
+  /*! @internal
+   */
+  struct VertexArrayKey
+  {
+    bool operator < (const VertexArrayKey& other) const;
+    Program* program;
+    VertexBuffer* vertexBuffer;
+    IndexBuffer* indexBuffer;
+  };
+  typedef std::map<VertexArrayKey, uint> VertexArrayMap;
   ResourceCache& cache;
   Signal0<void> finishSignal;
   Signal0<bool> closeRequestSignal;
@@ -656,6 +764,12 @@ private:
   int swapInterval;
   bool needsRefresh;
   bool needsClosing;
+  bool instancing;
+  bool uniformBuffers;
+  bool vertexArrays;
+  bool programBinaries;
+  bool packedVertices;
+  Path programCachePath;
   Recti scissorArea;
   Recti viewportArea;
   bool dirtyBinding;
@@ -670,8 +784,11 @@ private:
   Ref<Framebuffer> currentFramebuffer;
   Ref<SharedProgramState> currentSharedState;
   Ref<DefaultFramebuffer> defaultFramebuffer;
+  VertexArrayMap vertexArrayCache;
+  uint currentVertexArray;
   std::vector<SharedSampler> samplers;
   std::vector<SharedUniform> uniforms;
+  std::vector<SharedUniformBlock> blocks;
   String declaration;
   Stats* stats;
 };
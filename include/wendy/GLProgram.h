@@ -45,6 +45,15 @@ class Program;
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! The name of the optional per-instance model matrix attribute.
+ *
+ *  @remarks Vertex shaders opt in to instanced rendering by declaring a @c mat4
+ *  attribute with this name.
+ */
+const char* const INSTANCE_MATRIX_ATTRIBUTE = "wyInstanceM";
+
+///////////////////////////////////////////////////////////////////////
+
 /*! @brief GLSL shader type enumeration.
  *  @ingroup opengl
  */
@@ -78,9 +87,13 @@ public:
 private:
   Shader(const ResourceInfo& info, Context& context, ShaderType type);
   bool init(const String& text);
+  bool compile();
   Context& context;
   ShaderType type;
   uint shaderID;
+  String source;
+  String nameList;
+  uint64 sourceHash;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -106,10 +119,12 @@ class Attribute
   friend class Program;
   friend class Context;
 public:
-  /*! Binds this attribute to the specified stride and offset of the
-   *  current vertex buffer.
+  /*! Binds this attribute to the specified component of the current vertex
+   *  buffer.  Integer components are normalized to floating-point.
+   *  @param[in] component The vertex component to bind to.
+   *  @param[in] stride The size, in bytes, of each vertex.
    */
-  void bind(size_t stride, size_t offset);
+  void bind(const VertexComponent& component, size_t stride);
   /*! @return @c true if the name of this attribute matches the specified
    *  string, or @c false otherwise.
    */
@@ -162,6 +177,9 @@ class Sampler
   friend class Program;
 public:
   /*! Binds this sampler to the specified texture unit.
+   *
+   *  @remarks The texture unit last bound is cached and the OpenGL call is
+   *  skipped if it has not changed.
    */
   void bind(uint unit);
   /*! @return @c true if the name of this sampler matches the specified string,
@@ -188,10 +206,12 @@ public:
    */
   static const char* getTypeName(SamplerType type);
 private:
+  Context* context;
   String name;
   SamplerType type;
   int location;
   int sharedID;
+  int unit;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -224,6 +244,9 @@ public:
    *
    *  @remarks It is the responsibility of the caller to ensure that the source
    *  data type matches.
+   *
+   *  @remarks The value last uploaded is cached and the OpenGL call is skipped
+   *  if it has not changed.
    */
   void copyFrom(const void* data);
   /*! @return @c true if the name of this uniform matches the specified string,
@@ -262,10 +285,52 @@ public:
    */
   static const char* getTypeName(UniformType type);
 private:
+  Context* context;
   String name;
   UniformType type;
   int location;
   int sharedID;
+  bool cached;
+  float cache[16];
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief GLSL program uniform block.
+ *  @ingroup opengl
+ *
+ *  Uniform blocks are always shared and are backed by a uniform buffer owned
+ *  by the context, so a single upload is seen by every program using them.
+ */
+class UniformBlock
+{
+  friend class Program;
+public:
+  /*! Copies new values for all members of this uniform block from the
+   *  specified address.
+   *  @param[in] data The address of the values to use.
+   *
+   *  @remarks It is the responsibility of the caller to ensure that the source
+   *  data matches the std140 layout of the block.
+   *
+   *  @remarks The contents last uploaded are cached and the upload is skipped
+   *  if they have not changed.
+   */
+  void copyFrom(const void* data);
+  /*! @return @c true if the name of this uniform block matches the specified
+   *  string, or @c false otherwise.
+   */
+  bool operator == (const char* string) const;
+  /*! @return The name of this uniform block.
+   */
+  const String& getName() const;
+  /*! @return The shared ID of this uniform block.
+   */
+  int getSharedID() const;
+private:
+  Context* context;
+  String name;
+  int sharedID;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -284,6 +349,8 @@ public:
   const Sampler* findSampler(const char* name) const;
   Uniform* findUniform(const char* name);
   const Uniform* findUniform(const char* name) const;
+  UniformBlock* findUniformBlock(const char* name);
+  const UniformBlock* findUniformBlock(const char* name) const;
   uint getAttributeCount() const;
   Attribute& getAttribute(uint index);
   const Attribute& getAttribute(uint index) const;
@@ -293,6 +360,13 @@ public:
   uint getUniformCount() const;
   Uniform& getUniform(uint index);
   const Uniform& getUniform(uint index) const;
+  uint getUniformBlockCount() const;
+  UniformBlock& getUniformBlock(uint index);
+  const UniformBlock& getUniformBlock(uint index) const;
+  /*! @return @c true if this program has a per-instance model matrix
+   *  attribute, or @c false otherwise.
+   */
+  bool hasInstanceAttribute() const;
   Context& getContext() const;
   static Ref<Program> create(const ResourceInfo& info,
                              Context& context,
@@ -305,7 +379,11 @@ private:
   Program(const ResourceInfo& info, Context& context);
   Program(const Program& source);
   bool init(Shader& vertexShader, Shader& fragmentShader);
+  bool link();
+  bool loadBinary(const Path& path, uint64 key);
+  void saveBinary(const Path& path, uint64 key);
   bool retrieveUniforms();
+  bool retrieveUniformBlocks();
   bool retrieveAttributes();
   void bind();
   void unbind();
@@ -316,9 +394,11 @@ private:
   Ref<Shader> vertexShader;
   Ref<Shader> fragmentShader;
   uint programID;
+  int instanceLocation;
   std::vector<Attribute> attributes;
   std::vector<Sampler> samplers;
   std::vector<Uniform> uniforms;
+  std::vector<UniformBlock> blocks;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -79,6 +79,39 @@ private:
   bool active;
 };
 
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Fence sync object.
+ *  @ingroup opengl
+ *
+ *  A fence is signaled once the OpenGL commands issued before its creation
+ *  have been completed.
+ */
+class Fence
+{
+public:
+  /*! Destructor.
+   */
+  ~Fence();
+  /*! @return @c true if this fence has been signaled, otherwise @c false.
+   */
+  bool isSignaled() const;
+  /*! Blocks until this fence has been signaled.
+   *  @return @c true if successful, or @c false if an error occurred.
+   */
+  bool wait() const;
+  /*! Creates a fence after all previously issued OpenGL commands.
+   *  @param[in] context The context within which to create the fence.
+   *  @return The newly created fence object, or @c NULL if an error occurred.
+   */
+  static Fence* create(Context& context);
+private:
+  Fence(Context& context);
+  bool init();
+  Context& context;
+  void* syncObject;
+};
+
 ///////////////////////////////////////////////////////////////////////
 
   } /*namespace GL*/
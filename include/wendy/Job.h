@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////
+// Wendy core library
+// Copyright (c) 2013 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any
+// damages arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any
+// purpose, including commercial applications, and to alter it and
+// redistribute it freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you
+//     must not claim that you wrote the original software. If you use
+//     this software in a product, an acknowledgment in the product
+//     documentation would be appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and
+//     must not be misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source
+//     distribution.
+//
+///////////////////////////////////////////////////////////////////////
+#ifndef WENDY_JOB_H
+#define WENDY_JOB_H
+///////////////////////////////////////////////////////////////////////
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+///////////////////////////////////////////////////////////////////////
+
+namespace wendy
+{
+
+///////////////////////////////////////////////////////////////////////
+
+class Job;
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Function executed by a job.
+ */
+typedef std::function<void ()> JobFunction;
+
+/*! @brief Function executed by JobSystem::parallelFor for the indices from
+ *  @a first up to but not including @a last.
+ */
+typedef std::function<void (size_t first, size_t last)> RangeFunction;
+
+/*! @brief Shared handle to a job.
+ */
+typedef std::shared_ptr<Job> JobRef;
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Unit of work executed by a job system.
+ *
+ *  A job is finished once its function has returned and all of its child
+ *  jobs have finished.
+ */
+class Job
+{
+  friend class JobSystem;
+public:
+  /*! @return @c true if this job and all its children have finished,
+   *  otherwise @c false.
+   */
+  bool isFinished() const;
+private:
+  Job(const JobFunction& function, const JobRef& parent);
+  Job(const Job& source);
+  Job& operator = (const Job& source);
+  JobFunction function;
+  JobRef parent;
+  std::atomic<uint> pending;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Work-stealing job system.
+ *
+ *  Each worker thread has its own queue of jobs.  Jobs run from a worker are
+ *  added to the back of its own queue and taken from there, while idle
+ *  workers steal from the front of the queues of other workers.  Threads
+ *  that aren't workers share a queue of their own.
+ *
+ *  Waiting for a job executes other queued jobs on the waiting thread until
+ *  the job has finished, so jobs may safely wait for their children.
+ */
+class JobSystem : public RefObject
+{
+public:
+  /*! Destructor.  Waits for running jobs and discards queued ones.
+   */
+  ~JobSystem();
+  /*! Creates a job without a parent.  The job is not run until it is passed
+   *  to JobSystem::run.
+   *  @param[in] function The function to execute, or an empty function to
+   *  create a job that only groups its children.
+   */
+  JobRef createJob(const JobFunction& function);
+  /*! Creates a child job of the specified parent.  The parent will not finish
+   *  until the child has finished.  The job is not run until it is passed to
+   *  JobSystem::run.
+   *  @param[in] parent The parent job.  It must not already have finished.
+   *  @param[in] function The function to execute.
+   */
+  JobRef createJob(const JobRef& parent, const JobFunction& function);
+  /*! Queues the specified job for execution.
+   */
+  void run(const JobRef& job);
+  /*! Executes queued jobs on the calling thread until the specified job has
+   *  finished.
+   */
+  void wait(const Job& job);
+  /*! Calls the specified function for consecutive ranges of indices from
+   *  zero up to but not including @a count, spread over the workers, and
+   *  waits for all of them to finish.
+   *  @param[in] count The number of indices.
+   *  @param[in] grainSize The maximum number of indices per call, or zero to
+   *  choose one from the number of workers.
+   *  @param[in] function The function to call.
+   */
+  void parallelFor(size_t count, size_t grainSize, const RangeFunction& function);
+  /*! @return The number of workers, including the slot shared by threads
+   *  that aren't worker threads.
+   */
+  uint getWorkerCount() const;
+  /*! @return The index of the worker running on the calling thread, or zero
+   *  if it isn't a worker thread.
+   */
+  uint getCurrentWorker() const;
+  /*! Creates a job system.
+   *  @param[in] threadCount The number of worker threads, or zero to use one
+   *  less than the number of hardware threads.
+   *  @return The newly created job system, or @c NULL if an error occurred.
+   */
+  static Ref<JobSystem> create(uint threadCount = 0);
+private:
+  class Worker;
+  JobSystem();
+  JobSystem(const JobSystem& source);
+  JobSystem& operator = (const JobSystem& source);
+  bool init(uint threadCount);
+  bool execute(uint worker);
+  void finish(Job& job);
+  void work(uint worker);
+  std::vector<std::thread> threads;
+  std::vector<Worker*> workers;
+  std::atomic<size_t> queuedCount;
+  std::atomic<uint> sleepingCount;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::atomic<bool> stopping;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+} /*namespace wendy*/
+
+///////////////////////////////////////////////////////////////////////
+#endif /*WENDY_JOB_H*/
+///////////////////////////////////////////////////////////////////////
@@ -69,6 +69,10 @@ class MeshSection
 {
 public:
   std::vector<MeshTriangle> triangles;
+  /*! Simplified versions of the triangles of this section, in order of
+   *  decreasing detail.  They use the same vertices as the triangles.
+   */
+  std::vector<std::vector<MeshTriangle>> levels;
   String materialName;
 };
 
@@ -94,13 +98,44 @@ public:
   /*! Merges all the sections in this mesh and assigns the specified material
    *  name to the resulting section.
    *  @remarks Duplicate vertices and triangles are not merged.
+   *  @remarks Any detail levels are removed.
    */
   void mergeSections(const char* materialName);
+  /*! Merges vertices with equal positions into shared positions, keeping
+   *  separate vertices only where normals or texture coordinates differ.
+   *  Unreferenced vertices are removed.
+   *  @remarks This is useful for raw imported data where every triangle has
+   *  its own vertices, before generating smooth normals.
+   *  @remarks Any detail levels are removed.
+   */
+  void weld();
+  /*! Reorders the triangles of each section for post-transform vertex
+   *  cache locality, then reorders the vertices by first use.
+   *  @param[in] reduceOverdraw @c true to also reorder clusters of
+   *  triangles within each section so that outward facing clusters are
+   *  drawn first, at a small cost in cache locality.
+   *  @remarks Unreferenced vertices are removed.
+   */
+  void optimize(bool reduceOverdraw = false);
+  /*! Generates simplified detail levels for each section of this mesh,
+   *  using quadric error metrics and collapsing vertices into their
+   *  neighbours.  Each level targets the specified fraction of the
+   *  triangles of the previous one.
+   *  @param[in] count The number of levels to generate.
+   *  @param[in] ratio The fraction of triangles to keep for each level.
+   *  @remarks Vertices on open borders, texture coordinate seams and
+   *  material boundaries are never removed.  Vertices split only by normals
+   *  are simplified as one, using the normal of their first copy.
+   *  @remarks Sections stop getting new levels once they can no longer be
+   *  simplified.
+   */
+  void generateLevels(uint count, float ratio = 0.5f);
   /*! Returns the section with the specified material name.
    */
   MeshSection* findSection(const char* materialName);
   /*! Generates and stores triangle and vertex normals for this
    *  mesh, according to the specified generation mode.
+   *  @remarks Any detail levels are removed.
    */
   void generateNormals(NormalType type = SMOOTH_FACES);
   /*! Generates and stores triangle normals for this mesh.
@@ -115,9 +150,17 @@ public:
   /*! @return @c true if this mesh is valid, otherwise @c false.
    */
   bool isValid() const;
+  /*! @return The average number of vertex cache misses per triangle
+   *  for this mesh, for a 32 entry FIFO vertex cache.
+   */
+  float calculateACMR() const;
   /*! @return The number of triangles in all sections of this mesh.
    */
   size_t getTriangleCount() const;
+  /*! @return The number of indices in all sections and detail levels of
+   *  this mesh.
+   */
+  size_t getIndexCount() const;
   static Ref<Mesh> read(ResourceCache& cache, const String& name);
   typedef std::vector<MeshVertex> VertexList;
   /*! The list of sections in this mesh.
@@ -130,17 +173,98 @@ public:
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @brief Read-only view of a binary mesh file.
+ *
+ *  A binary mesh holds the final deduplicated vertex array, the index array
+ *  and material name of each section and the precomputed bounds of a mesh,
+ *  laid out so that it can be used without parsing.  Packed files are used
+ *  in place in the mapped pack and other files are read with a single read.
+ *
+ *  The indices of all sections use the smallest index type able to address
+ *  every vertex index of the mesh.
+ */
+class BinaryMesh
+{
+public:
+  /*! Binary mesh section detail level.
+   */
+  class Level
+  {
+  public:
+    const void* indices;
+    size_t indexCount;
+  };
+  /*! Binary mesh section.
+   */
+  class Section
+  {
+  public:
+    String materialName;
+    const void* indices;
+    size_t indexCount;
+    std::vector<Level> levels;
+  };
+  /*! Constructor.
+   */
+  BinaryMesh();
+  /*! Reads a binary mesh from the specified stream.
+   *  @return @c true if successful, or @c false if the stream does not hold a
+   *  valid binary mesh.
+   */
+  bool read(ResourceStream& stream);
+  /*! @return The vertices of this mesh.
+   */
+  const MeshVertex* getVertices() const;
+  /*! @return The number of vertices in this mesh.
+   */
+  size_t getVertexCount() const;
+  /*! @return The size, in bytes, of each index in this mesh.
+   */
+  size_t getIndexSize() const;
+  /*! @return The total number of indices in all sections and detail levels
+   *  of this mesh.
+   */
+  size_t getIndexCount() const;
+  /*! @return The sections of this mesh.
+   */
+  const std::vector<Section>& getSections() const;
+  /*! @return The precomputed minimum corner of the bounding box.
+   */
+  const vec3& getMinimum() const;
+  /*! @return The precomputed maximum corner of the bounding box.
+   */
+  const vec3& getMaximum() const;
+  /*! @return The precomputed center of the bounding sphere.
+   */
+  const vec3& getCenter() const;
+  /*! @return The precomputed radius of the bounding sphere.
+   */
+  float getRadius() const;
+  /*! @return @c true if the specified stream starts with a binary mesh
+   *  header, otherwise @c false.  The stream is rewound.
+   */
+  static bool isBinaryMesh(std::istream& stream);
+private:
+  std::vector<char> buffer;
+  const MeshVertex* vertices;
+  size_t vertexCount;
+  size_t indexSize;
+  size_t indexCount;
+  std::vector<Section> sections;
+  vec3 minimum;
+  vec3 maximum;
+  vec3 center;
+  float radius;
+};
+
+///////////////////////////////////////////////////////////////////////
+
 class MeshReader : public ResourceReader<Mesh>
 {
 public:
   MeshReader(ResourceCache& cache);
   using ResourceReader<Mesh>::read;
   Ref<Mesh> read(const String& name, const Path& path);
-private:
-  String parseName(const char** text);
-  int parseInteger(const char** text);
-  float parseFloat(const char** text);
-  bool interesting(const char** text);
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -148,7 +272,12 @@ private:
 class MeshWriter
 {
 public:
+  /*! Writes the specified mesh in OBJ format.
+   */
   bool write(const Path& path, const Mesh& mesh);
+  /*! Writes the specified mesh in binary format.
+   */
+  bool writeBinary(const Path& path, const Mesh& mesh);
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -59,13 +59,31 @@ private:
 class Profile
 {
 public:
+  /*! Constructor.
+   */
+  Profile();
   void beginFrame();
   void endFrame();
   void beginNode(const char* name);
   void endNode();
   const ProfileNode& getRootNode() const;
+  /*! @return The time spent executing jobs by the specified job system
+   *  worker during the last frame.
+   */
+  Time getWorkerTime(uint worker) const;
+  /*! @return The number of job system workers that have executed jobs during
+   *  the last frame.
+   */
+  uint getWorkerCount() const;
   static Profile* getCurrent();
   static void setCurrent(Profile* newProfile);
+  /*! Adds time spent executing jobs by the specified job system worker.  The
+   *  time is collected by the current profile at the end of the frame.
+   *  @remarks Unlike the other methods, this may be called from any thread.
+   *  It takes no locks and each worker writes to its own cache line.
+   *  @remarks Workers with an index of 64 or higher are not tracked.
+   */
+  static void addWorkerTime(uint worker, Time duration);
 private:
   void beginNode(ProfileNode& node);
   static void resetNode(ProfileNode& node);
@@ -73,6 +91,7 @@ private:
   ProfileNode root;
   Stack stack;
   Timer timer;
+  std::vector<Time> workerTimes;
   static Profile* current;
 };
 
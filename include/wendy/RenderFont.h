@@ -109,7 +109,6 @@ private:
   float descender;
   UniformStateIndex colorIndex;
   Pass pass;
-  std::vector<Vertex2ft2fv> vertices;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -139,12 +138,16 @@ public:
 
 ///////////////////////////////////////////////////////////////////////
 
-class FontReader : public ResourceReader<Font>
+class FontReader : public DocumentReader<Font>
 {
 public:
   FontReader(GeometryPool& pool);
-  using ResourceReader<Font>::read;
-  Ref<Font> read(const String& name, const Path& path);
+  bool decode(const String& name,
+              const ResourceDocument& document,
+              Ref<RefObject>& data);
+  Ref<Font> create(const String& name,
+                   const ResourceDocument& document,
+                   RefObject* data);
 private:
   bool extractGlyphs(FontData& data,
                      const String& name,
@@ -120,12 +120,16 @@ private:
 /*! @brief Codec for XML format render materials.
  *  @ingroup renderer
  */
-class MaterialReader : public ResourceReader<Material>
+class MaterialReader : public DocumentReader<Material>
 {
 public:
   MaterialReader(System& system);
-  using ResourceReader<Material>::read;
-  Ref<Material> read(const String& name, const Path& path);
+  bool decode(const String& name,
+              const ResourceDocument& document,
+              Ref<RefObject>& data);
+  Ref<Material> create(const String& name,
+                       const ResourceDocument& document,
+                       RefObject* data);
 private:
   System& system;
 };
@@ -27,6 +27,7 @@
 ///////////////////////////////////////////////////////////////////////
 
 #include <wendy/Core.h>
+#include <wendy/AABB.h>
 #include <wendy/Sphere.h>
 #include <wendy/Mesh.h>
 
@@ -45,26 +46,54 @@ namespace wendy
  *  @ingroup renderer
  *
  *  This class represents a section of triangles in a model using a single
- *  material.
+ *  material, plus any simplified detail levels of those triangles.
  */
 class ModelSection
 {
 public:
   /*! Constructor.
+   *  @param[in] range The range of indices used by the full detail level.
+   *  @param[in] material The material to use.
+   *  @param[in] boundingAABB The bounding box of the triangles.
+   *  @param[in] boundingSphere The bounding sphere of the triangles.
    */
-  ModelSection(const GL::IndexRange& range, Material* material);
+  ModelSection(const GL::IndexRange& range,
+               Material* material,
+               const AABB& boundingAABB,
+               const Sphere& boundingSphere);
   /*! @return The range of indices used by this geometry.
    */
   const GL::IndexRange& getIndexRange() const;
+  /*! @return The range of indices used by the specified detail level of
+   *  this geometry, where level zero is full detail.  Levels beyond the
+   *  last one use the last one.
+   */
+  const GL::IndexRange& getIndexRange(uint level) const;
+  /*! @return The number of detail levels of this geometry, including full
+   *  detail.
+   */
+  uint getLevelCount() const;
+  /*! Adds a detail level to this geometry.
+   */
+  void addLevel(const GL::IndexRange& range);
   /*! @return The %render material used by this geometry.
    */
   Material* getMaterial() const;
   /*! Sets the material of this geometry.
    */
   void setMaterial(Material* newMaterial);
+  /*! @return The bounding box of this geometry, in model space.
+   */
+  const AABB& getBoundingAABB() const;
+  /*! @return The bounding sphere of this geometry, in model space.
+   */
+  const Sphere& getBoundingSphere() const;
 private:
   GL::IndexRange range;
+  std::vector<GL::IndexRange> levels;
   Ref<Material> material;
+  AABB boundingAABB;
+  Sphere boundingSphere;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -86,6 +115,11 @@ class Model : public Renderable, public Resource
 public:
   typedef std::map<String, Ref<Material>> MaterialMap;
   void enqueue(Scene& scene, const Camera& camera, const Transform3& transform) const;
+  /*! @return The detail level to use for this model when seen through the
+   *  specified camera with the specified transform, based on the projected
+   *  size of its bounding sphere.
+   */
+  uint selectLevel(const Camera& camera, const Transform3& transform) const;
   /*! @return The bounding AABB of this model.
    */
   const AABB& getBoundingAABB() const;
@@ -112,13 +146,36 @@ public:
    *  @param[in] system The render system within which to create the texture.
    *  @param[in] data The mesh to use.
    *  @param[in] materials The materials to use.
+   *  @param[in] quantize @c true to pack normals into 10-bit integers and
+   *  texture coordinates into half floats where supported, or @c false to
+   *  keep them as floats.  Half floats lose precision on texture coordinates
+   *  far outside the unit range.
    *  @return The newly created model, or @c NULL if an error
    *  occurred.
    */
   static Ref<Model> create(const ResourceInfo& info,
                            System& system,
                            const Mesh& data,
-                           const MaterialMap& materials);
+                           const MaterialMap& materials,
+                           bool quantize = false);
+  /*! Creates a model from the specified binary mesh, copying its vertices
+   *  and indices directly into the buffers of the model.
+   *  @param[in] info The resource info for the model.
+   *  @param[in] system The render system within which to create the model.
+   *  @param[in] data The binary mesh to use.
+   *  @param[in] materials The materials to use.
+   *  @param[in] quantize @c true to pack normals into 10-bit integers and
+   *  texture coordinates into half floats where supported, or @c false to
+   *  keep them as floats.  Half floats lose precision on texture coordinates
+   *  far outside the unit range.
+   *  @return The newly created model, or @c NULL if an error
+   *  occurred.
+   */
+  static Ref<Model> create(const ResourceInfo& info,
+                           System& system,
+                           const BinaryMesh& data,
+                           const MaterialMap& materials,
+                           bool quantize = false);
   /*! Creates a model specification using the specified file.
    *  @param[in] context The OpenGL context within which to create the texture.
    *  @param[in] path The path of the specification file to use.
@@ -129,8 +186,20 @@ private:
   Model(const ResourceInfo& info);
   Model(const Model& source);
   Model& operator = (const Model& source);
-  bool init(System& system, const Mesh& data, const MaterialMap& materials);
+  bool init(System& system,
+            const Mesh& data,
+            const MaterialMap& materials,
+            bool quantize);
+  bool init(System& system,
+            const BinaryMesh& data,
+            const MaterialMap& materials,
+            bool quantize);
+  bool initVertices(GL::Context& context,
+                    const MeshVertex* vertices,
+                    size_t count,
+                    bool quantize);
   ModelSectionList sections;
+  uint levelCount;
   Ref<GL::VertexBuffer> vertexBuffer;
   Ref<GL::IndexBuffer> indexBuffer;
   Sphere boundingSphere;
@@ -139,14 +208,19 @@ private:
 
 ///////////////////////////////////////////////////////////////////////
 
-class ModelReader : public ResourceReader<Model>
+class ModelReader : public DocumentReader<Model>
 {
 public:
   ModelReader(System& system);
-  using ResourceReader<Model>::read;
-  Ref<Model> read(const String& name, const Path& path);
+  bool decode(const String& name,
+              const ResourceDocument& document,
+              Ref<RefObject>& data);
+  Ref<Model> create(const String& name,
+                    const ResourceDocument& document,
+                    RefObject* data);
 private:
   System& system;
+  MaterialReader materialReader;
 };
 
 ///////////////////////////////////////////////////////////////////////
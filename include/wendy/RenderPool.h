@@ -31,6 +31,9 @@
 
 #include <wendy/GLTexture.h>
 #include <wendy/GLBuffer.h>
+#include <wendy/GLQuery.h>
+
+#include <deque>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -43,10 +46,22 @@ namespace wendy
 
 /*! @brief Geometry pool.
  *  @ingroup renderer
+ *
+ *  Temporary geometry is allocated from a single ring buffer per vertex format
+ *  and index type.  The region of the ring used by each frame is guarded by a
+ *  fence, so up to three frames may be in flight before an allocation waits
+ *  for the GPU.  A ring that fills up within a single frame is replaced by a
+ *  larger one.
+ *
+ *  Allocating may grow a ring, which issues OpenGL calls, so it may only be
+ *  done on the thread the context is current on.
  */
 class GeometryPool : public Trackable, public RefObject
 {
 public:
+  /*! Destructor.
+   */
+  ~GeometryPool();
   /*! Allocates a range of temporary indices of the specified type.
    *  @param[out] range The newly allocated index range.
    *  @param[in] count The number of indices to allocate.
@@ -56,6 +71,9 @@ public:
    *
    *  @remarks The allocated index range is only valid until the end of the
    *  current frame.
+   *
+   *  @remarks The allocated index range is not used by any pending rendering
+   *  and may be locked with GL::LOCK_WRITE_UNSYNCHRONIZED.
    */
   bool allocateIndices(GL::IndexRange& range,
                        uint count,
@@ -69,10 +87,17 @@ public:
    *
    *  @remarks The allocated vertex range is only valid until the end of the
    *  current frame.
+   *
+   *  @remarks The allocated vertex range is not used by any pending rendering
+   *  and may be locked with GL::LOCK_WRITE_UNSYNCHRONIZED.
    */
   bool allocateVertices(GL::VertexRange& range,
                         uint count,
                         const VertexFormat& format);
+  /*! @return @c true if the specified primitive range uses vertices or
+   *  indices allocated from this pool, otherwise @c false.
+   */
+  bool isTransient(const GL::PrimitiveRange& range) const;
   /*! @return The OpenGL context used by this pool.
    */
   GL::Context& getContext() const;
@@ -85,25 +110,49 @@ public:
 private:
   GeometryPool(GL::Context& context);
   bool init(size_t granularity);
+  /*! @internal
+   */
+  struct Frame
+  {
+    Ptr<GL::Fence> fence;
+    size_t end;
+  };
+  /*! @internal
+   */
+  class Ring
+  {
+  public:
+    Ring();
+    bool allocate(size_t& start, size_t count);
+    void finish(GL::Context& context);
+    void reset(size_t capacity);
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    std::deque<Frame> frames;
+  };
   /*! @internal
    */
   struct IndexBufferSlot
   {
     Ref<GL::IndexBuffer> indexBuffer;
-    uint available;
+    Ring ring;
   };
   /*! @internal
    */
   struct VertexBufferSlot
   {
     Ref<GL::VertexBuffer> vertexBuffer;
-    uint available;
+    Ring ring;
   };
+  size_t getRingCapacity(size_t previous, size_t count) const;
   void onContextFinish();
   GL::Context& context;
   size_t granularity;
-  std::vector<IndexBufferSlot> indexBufferPool;
-  std::vector<VertexBufferSlot> vertexBufferPool;
+  std::deque<IndexBufferSlot> indexBufferPool;
+  std::deque<VertexBufferSlot> vertexBufferPool;
+  std::vector<Ref<GL::IndexBuffer>> retiredIndexBuffers;
+  std::vector<Ref<GL::VertexBuffer>> retiredVertexBuffers;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -78,6 +78,10 @@ public:
  */
 typedef std::vector<uint64> SortKeyList;
 
+/*! @ingroup renderer
+ */
+typedef std::vector<uint32> OperationIndexList;
+
 ///////////////////////////////////////////////////////////////////////
 
 /*! @brief Render operation in the 3D pipeline.
@@ -121,29 +125,73 @@ typedef std::vector<Operation> OperationList;
  *  @remarks To avoid thrashing the heap, keep your queue objects around
  *  between frames when possible.
  *
- *  @remarks Each queue can only contain 65536 render operations.
+ *  @remarks In comparison sort mode, each queue can only contain 65536 render
+ *  operations, as the operation index is stored in the sort key.
  */
 class Queue
 {
 public:
+  /*! Sort mode enumeration.
+   */
+  enum SortMode
+  {
+    /*! Sort keys with std::sort, storing the operation index in the key.
+     */
+    COMPARISON_SORT,
+    /*! Sort keys with an LSD radix sort, storing the operation index
+     *  separately.
+     */
+    RADIX_SORT
+  };
   /*! Constructor.
    */
-  Queue();
+  Queue(SortMode mode = RADIX_SORT);
   /*! Adds a render operation in this render queue.
    */
   void addOperation(const Operation& operation, SortKey key);
   /*! Destroys all render operations in this render queue.
    */
   void removeOperations();
+  /*! Adds copies of the render operations in the specified render queue to
+   *  the end of this render queue, in their original order.
+   *  @pre Both queues must use the same sort mode.
+   */
+  void append(const Queue& other);
+  /*! @return The render operations in this render queue.
+   *  @remarks The sort keys are not updated if the operations are changed.
+   */
+  OperationList& getOperations();
   /*! @return The render operations in this render queue.
    */
   const OperationList& getOperations() const;
-  /*! @return The sor keys in this render queue.
+  /*! @return The sort keys in this render queue, in sorted order.
+   *  @remarks The index member of the returned keys is only valid in
+   *  comparison sort mode.  Use Queue::getSortedIndices instead.
    */
   const SortKeyList& getSortKeys() const;
+  /*! @return The indices of the render operations in this render queue, in
+   *  sorted order.
+   */
+  const OperationIndexList& getSortedIndices() const;
+  /*! @return The sort mode of this render queue.
+   */
+  SortMode getSortMode() const;
+  /*! Sets the sort mode of this render queue.
+   *  @pre The queue must be empty.
+   */
+  void setSortMode(SortMode newMode);
+  /*! Exchanges the contents of this render queue with those of the
+   *  specified render queue.
+   */
+  void swap(Queue& other);
 private:
+  void sort() const;
   OperationList operations;
+  SortMode mode;
   mutable SortKeyList keys;
+  mutable SortKeyList tempKeys;
+  mutable OperationIndexList indices;
+  mutable OperationIndexList tempIndices;
   mutable bool sorted;
 };
 
@@ -161,6 +209,11 @@ public:
                         const Material& material,
                         float depth);
   void removeOperations();
+  /*! Adds the render operations and lights of the specified scene to this
+   *  scene, after its own.  This is used to merge scenes filled by separate
+   *  threads in a deterministic order.
+   */
+  void append(const Scene& other);
   void attachLight(Light& light);
   void detachLights();
   const LightList& getLights() const;
@@ -173,6 +226,10 @@ public:
   const Queue& getBlendedQueue() const;
   Phase getPhase() const;
   void setPhase(Phase newPhase);
+  /*! Exchanges the operations, lights, ambient intensity and phase of this
+   *  scene with those of the specified scene.
+   */
+  void swap(Scene& other);
 private:
   Ref<GeometryPool> pool;
   Phase phase;
@@ -184,6 +241,128 @@ private:
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @brief Recorded render command.
+ *  @ingroup renderer
+ *
+ *  This is a single fully resolved draw in a command buffer, i.e. a render
+ *  pass, a primitive range and either a single local-to-world transformation
+ *  or a range of per-instance transformations.
+ */
+class Command
+{
+public:
+  /*! Constructor.
+   */
+  Command();
+  /*! The primitive range to render.
+   */
+  GL::PrimitiveRange range;
+  /*! The render pass to apply.
+   */
+  const Pass* state;
+  /*! The local-to-world transformation.  Ignored for instanced commands.
+   */
+  mat4 transform;
+  /*! The index of the first per-instance transformation of this command in
+   *  the instance buffer of the command buffer.
+   */
+  uint32 instanceStart;
+  /*! The number of per-instance transformations, or zero if this command is
+   *  not instanced.
+   */
+  uint32 instanceCount;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @ingroup renderer
+ */
+typedef std::vector<Command> CommandList;
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Recorded sequence of render commands.
+ *  @ingroup renderer
+ *
+ *  A command buffer holds the fully sorted and batched sequence of draws
+ *  produced from a render scene, so that it can be replayed in later frames
+ *  without enqueueing, sorting or batching the operations again.  The
+ *  per-instance transformations of instanced commands are stored in a static
+ *  vertex buffer owned by the command buffer.
+ *
+ *  @remarks Pass state such as uniform and sampler values is applied when the
+ *  buffer is replayed, but the set of passes and primitive ranges, as well as
+ *  culling and sorting, are fixed when it is recorded.  Invalidate it when the
+ *  recorded graph changes or when passes are added to or removed from a
+ *  material.
+ *
+ *  @remarks The passes referenced by a command buffer must outlive it, or the
+ *  buffer must be invalidated before they are destroyed.
+ */
+class CommandBuffer : public RefObject
+{
+public:
+  /*! Discards all recorded commands and begins recording.
+   *  @param[in] revision The revision of the source data being recorded.
+   */
+  void begin(uint revision = 0);
+  /*! Adds a single non-instanced command.
+   */
+  void addCommand(const Pass& state,
+                  const GL::PrimitiveRange& range,
+                  const mat4& transform);
+  /*! Adds a single instanced command with the specified per-instance
+   *  transformations.
+   */
+  void addInstancedCommand(const Pass& state,
+                           const GL::PrimitiveRange& range,
+                           const mat4* transforms,
+                           size_t count);
+  /*! Ends recording and uploads the per-instance transformations.
+   *  @return @c true if successful, or @c false if an error occurred.
+   */
+  bool end();
+  /*! Marks this command buffer as needing to be recorded again.
+   */
+  void invalidate();
+  /*! @return @c true if this command buffer has been successfully recorded
+   *  and not since invalidated, otherwise @c false.
+   */
+  bool isValid() const;
+  /*! @return @c true if this command buffer is valid and was recorded from
+   *  the specified revision of its source data, otherwise @c false.
+   */
+  bool isCurrent(uint revision) const;
+  /*! @return The revision this command buffer was recorded from.
+   */
+  uint getRevision() const;
+  /*! @return The recorded commands in this command buffer.
+   */
+  const CommandList& getCommands() const;
+  /*! @return The per-instance transformations of the specified command.
+   */
+  GL::VertexRange getInstances(const Command& command) const;
+  /*! Creates an empty command buffer.
+   */
+  static Ref<CommandBuffer> create(GL::Context& context);
+  /*! The vertex format of the per-instance model matrices of instanced
+   *  draws.
+   */
+  static const VertexFormat instanceFormat;
+private:
+  CommandBuffer(GL::Context& context);
+  CommandBuffer(const CommandBuffer& source);
+  CommandBuffer& operator = (const CommandBuffer& source);
+  GL::Context& context;
+  CommandList commands;
+  std::vector<mat4> transforms;
+  Ref<GL::VertexBuffer> instances;
+  uint revision;
+  bool valid;
+};
+
+///////////////////////////////////////////////////////////////////////
+
 /*! @brief Abstract renderable object.
  *  @ingroup renderer
  *
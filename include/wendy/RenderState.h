@@ -74,6 +74,16 @@ enum
 
 ///////////////////////////////////////////////////////////////////////
 
+enum
+{
+  SHARED_FRAME_BLOCK,
+  SHARED_OBJECT_BLOCK,
+
+  SHARED_BLOCK_CUSTOM_BASE
+};
+
+///////////////////////////////////////////////////////////////////////
+
 typedef uint16 StateID;
 
 ///////////////////////////////////////////////////////////////////////
@@ -81,13 +91,33 @@ typedef uint16 StateID;
 class SharedProgramState : public GL::SharedProgramState
 {
 public:
+  /*! Shared uniform mode enumeration.
+   */
+  enum Mode
+  {
+    /*! All shared values are uploaded as plain uniforms to each program.
+     */
+    UNIFORM_MODE,
+    /*! Per-frame and per-object values are uploaded once to uniform buffers
+     *  shared by all programs, via the @c wyFrame and @c wyObject blocks.
+     */
+    BUFFER_MODE
+  };
   /*! Constructor.
+   *  @param[in] mode The desired shared uniform mode.
    */
-  SharedProgramState();
+  SharedProgramState(Mode mode = UNIFORM_MODE);
   /*! Reserves the supported uniform and sampler signatures as shared in the
    *  specified context.
+   *
+   *  @remarks In buffer mode, this falls back to plain uniforms if the
+   *  context does not support uniform buffers or if another shared program
+   *  state has already reserved them as plain uniforms.
    */
   virtual bool reserveSupported(GL::Context& context) const;
+  /*! @return The shared uniform mode of this shared program state.
+   */
+  Mode getMode() const;
   /*! @return The current model matrix.
    */
   const mat4& getModelMatrix() const;
@@ -125,7 +155,9 @@ public:
   virtual void setOrthoProjectionMatrix(float width, float height);
   /*! Sets an orthographic projection matrix as ([minX..maxX], [minY..maxY],
    *  [minZ, maxZ]).
-   *  @param[in] volume The desired projection volume.
+   *  @param[in] volume The desired projection volume.  Its bounds are those
+   *  returned by AABB::getBounds, i.e. half its size on each side of its
+   *  center.
    */
   virtual void setOrthoProjectionMatrix(const AABB& volume);
   /*! Sets a perspective projection matrix.
@@ -148,7 +180,9 @@ public:
 protected:
   virtual void updateTo(GL::Uniform& uniform);
   virtual void updateTo(GL::Sampler& uniform);
+  virtual void updateTo(GL::UniformBlock& block);
 private:
+  Mode mode;
   bool dirtyModelView;
   bool dirtyViewProj;
   bool dirtyModelViewProj;
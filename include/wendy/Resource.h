@@ -27,6 +27,17 @@
 ///////////////////////////////////////////////////////////////////////
 
 #include <fstream>
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+///////////////////////////////////////////////////////////////////////
+
+namespace pugi { class xml_document; }
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -39,6 +50,64 @@ class ResourceCache;
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @brief Read-only memory-mapped archive of resource files.
+ *
+ *  A pack holds the contents of a directory tree in a single file.  Its table
+ *  of contents is read once into a hash map and the file is memory-mapped, so
+ *  looking up and reading a packed file requires no system calls.
+ *
+ *  Packs are added to a resource cache like search path directories.
+ */
+class ResourcePack : public RefObject
+{
+public:
+  /*! Destructor.
+   */
+  ~ResourcePack();
+  /*! Looks up the contents of the specified file in this pack.
+   *  @param[in] name The name of the file, relative to the root of the pack.
+   *  @param[out] size The size of the file, in bytes.
+   *  @return The mapped contents of the file, or @c NULL if it is not in this
+   *  pack.
+   */
+  const char* findFile(const String& name, size_t& size) const;
+  /*! @return The path of this pack.
+   */
+  const Path& getPath() const;
+  /*! @return @c true if the specified file is a pack, otherwise @c false.
+   */
+  static bool isPack(const Path& path);
+  /*! Opens and maps the specified pack.
+   *  @return The opened pack, or @c NULL if an error occurred.
+   */
+  static Ref<ResourcePack> open(const Path& path);
+  /*! Writes all files in the specified directory tree to a pack.
+   *  @param[in] path The path of the pack to create.
+   *  @param[in] root The root directory of the files to pack.
+   *  @return @c true if successful, or @c false if an error occurred.
+   */
+  static bool write(const Path& path, const Path& root);
+private:
+  struct Entry
+  {
+    uint64 offset;
+    uint64 size;
+  };
+  typedef std::unordered_map<String, Entry> EntryMap;
+  ResourcePack(const Path& path);
+  ResourcePack(const ResourcePack& source);
+  ResourcePack& operator = (const ResourcePack& source);
+  bool init();
+  Path path;
+  EntryMap entries;
+  const char* data;
+  size_t size;
+  void* file;
+  void* mapping;
+};
+
+///////////////////////////////////////////////////////////////////////
+
 class ResourceInfo
 {
 public:
@@ -65,11 +134,20 @@ public:
 private:
   ResourceCache& cache;
   String name;
+  StringHash hash;
   Path path;
 };
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @remarks The search path list may contain both directories and packs.
+ *  Files are looked up in search path order, and files found in packs are
+ *  given paths inside the pack, for example @c data.pack/models/box.model.
+ *  Open files found through the cache with ResourceStream.
+ *
+ *  @remarks The resource cache is thread safe, but two threads creating or
+ *  reading a resource with the same name at the same time is still an error.
+ */
 class ResourceCache
 {
   friend class Resource;
@@ -77,15 +155,21 @@ public:
   ~ResourceCache();
   bool addSearchPath(const Path& path);
   void removeSearchPath(const Path& path);
-  Resource* findResource(const String& name) const;
+  /*! @return A reference to the resource with the specified name, or @c NULL
+   *  if there is none.
+   *  @remarks Resources being destroyed are never returned, so this is safe
+   *  to call on any thread.
+   */
+  Ref<Resource> findResource(const String& name) const;
+  Ref<Resource> findResource(const String& name, StringHash hash) const;
   template <typename T>
-  T* find(const String& name) const
+  Ref<T> find(const String& name) const
   {
-    Resource* cached = findResource(name);
+    Ref<Resource> cached = findResource(name);
     if (!cached)
       return NULL;
 
-    T* cast = dynamic_cast<T*>(cached);
+    T* cast = dynamic_cast<T*>(cached.getObject());
     if (!cast)
     {
       logError("Resource \'%s\' exists as another type", name.c_str());
@@ -95,10 +179,68 @@ public:
     return cast;
   }
   Path findFile(const String& name) const;
+  /*! Looks up the contents of the specified packed file.
+   *  @param[in] path A path returned by ResourceCache::findFile.
+   *  @param[out] size The size of the file, in bytes.
+   *  @return The mapped contents of the file, or @c NULL if the path does not
+   *  refer to a file in a pack.
+   */
+  const char* findPackedFile(const Path& path, size_t& size) const;
   const PathList& getSearchPaths() const;
 private:
+  struct Entry
+  {
+    Resource* resource;
+    WeakRef<Resource> reference;
+  };
+  typedef std::unordered_multimap<StringHash, Entry> ResourceMap;
+  const Entry* findEntryLocked(const String& name, StringHash hash) const;
   PathList paths;
-  std::vector<Resource*> resources;
+  std::vector<Ref<ResourcePack>> packs;
+  ResourceMap resources;
+  mutable std::mutex mutex;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Input stream for a file found through a resource cache.
+ *
+ *  Reads packed files directly from their mapped memory, and other files
+ *  through a binary file stream.
+ */
+class ResourceStream : public std::istream
+{
+public:
+  /*! Constructor.  Opens the specified file.
+   *  @param[in] cache The resource cache the path was found through.
+   *  @param[in] path The path of the file to open.
+   */
+  ResourceStream(const ResourceCache& cache, const Path& path);
+  /*! Closes the file, if it is not packed.
+   */
+  void close();
+  /*! @return The mapped contents of the file if it is packed, otherwise
+   *  @c NULL.
+   */
+  const char* getData() const;
+  /*! @return The size of the file if it is packed, otherwise zero.
+   */
+  size_t getSize() const;
+private:
+  class MemoryBuffer : public std::streambuf
+  {
+  public:
+    void setData(const char* data, size_t size);
+  protected:
+    pos_type seekoff(off_type offset,
+                     std::ios::seekdir direction,
+                     std::ios::openmode mode);
+    pos_type seekpos(pos_type position, std::ios::openmode mode);
+  };
+  std::filebuf file;
+  MemoryBuffer memory;
+  const char* data;
+  size_t size;
 };
 
 ///////////////////////////////////////////////////////////////////////
@@ -113,7 +255,7 @@ public:
   }
   Ref<T> read(const String& name)
   {
-    if (T* cached = cache.find<T>(name))
+    if (Ref<T> cached = cache.find<T>(name))
       return cached;
 
     const Path path = cache.findFile(name);
@@ -126,12 +268,436 @@ public:
     return read(name, path);
   }
   virtual Ref<T> read(const String& name, const Path& path) = 0;
+  ResourceCache& getCache() const { return cache; }
 protected:
   ResourceCache& cache;
 };
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @brief Parsed XML source of a resource.
+ */
+class ResourceDocument : public RefObject
+{
+public:
+  /*! Destructor.
+   */
+  ~ResourceDocument();
+  /*! @return The parsed document.
+   */
+  const pugi::xml_document& getDocument() const;
+  /*! @return The path of the file the document was parsed from.
+   */
+  const Path& getPath() const;
+  /*! Parses the specified XML file.  Touches only the file system and the
+   *  CPU, so it may be called on any thread.
+   *  @param[in] cache The resource cache the path was found through.
+   *  @param[in] name The name of the resource, used for error messages.
+   *  @param[in] path The path of the file to parse.
+   *  @return The parsed document, or @c NULL if an error occurred.
+   */
+  static Ref<ResourceDocument> read(const ResourceCache& cache,
+                                    const String& name,
+                                    const Path& path);
+private:
+  ResourceDocument(const Path& path);
+  ResourceDocument(const ResourceDocument& source);
+  ResourceDocument& operator = (const ResourceDocument& source);
+  Ptr<pugi::xml_document> document;
+  Path path;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Reader for resources described by an XML document.
+ *
+ *  Reading is split into parsing the document and decoding the source data it
+ *  refers to, which touch only the file system and the CPU, and creating the
+ *  resource from them, which may touch OpenGL or OpenAL.  ResourceLoader
+ *  parses and decodes on a worker thread and creates on the owning thread.
+ */
+template <typename T>
+class DocumentReader : public ResourceReader<T>
+{
+public:
+  DocumentReader(ResourceCache& cache):
+    ResourceReader<T>(cache)
+  {
+  }
+  using ResourceReader<T>::read;
+  Ref<T> read(const String& name, const Path& path)
+  {
+    Ref<ResourceDocument> document = ResourceDocument::read(this->cache, name, path);
+    if (!document)
+      return NULL;
+
+    Ref<RefObject> data;
+    if (!decode(name, *document, data))
+      return NULL;
+
+    return create(name, *document, data);
+  }
+  /*! Decodes the source data, such as meshes and images, that the named
+   *  resource needs from its parsed document.  Touches only the file system
+   *  and the CPU, so it may be called on any thread.
+   *  @param[in] name The name of the resource.
+   *  @param[in] document The parsed document of the resource.
+   *  @param[out] data The decoded data, which is passed on to create, or @c
+   *  NULL if there is none.
+   *  @return @c true if successful, or @c false if an error occurred.
+   */
+  virtual bool decode(const String& name,
+                      const ResourceDocument& document,
+                      Ref<RefObject>& data)
+  {
+    return true;
+  }
+  /*! Creates the named resource from its parsed document and the data
+   *  decoded from it.
+   */
+  virtual Ref<T> create(const String& name,
+                        const ResourceDocument& document,
+                        RefObject* data) = 0;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Handle to a resource being loaded asynchronously.
+ *
+ *  A future is only ever updated by ResourceLoader::update, so it may be
+ *  polled from the thread owning the loader without synchronization.
+ */
+template <typename T>
+class ResourceFuture : public RefObject
+{
+  friend class ResourceLoader;
+public:
+  /*! @return @c true if loading has finished, whether or not it succeeded.
+   */
+  bool isReady() const { return ready; }
+  /*! @return The loaded resource, or @c NULL if loading has not yet finished
+   *  or has failed.
+   */
+  T* get() const { return resource; }
+  /*! @return The name of the resource being loaded.
+   */
+  const String& getName() const { return name; }
+private:
+  ResourceFuture(const String& initName):
+    name(initName),
+    ready(false)
+  {
+  }
+  void complete(T* newResource)
+  {
+    resource = newResource;
+    ready = true;
+  }
+  String name;
+  Ref<T> resource;
+  bool ready;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Asynchronous resource loader.
+ *
+ *  The loader reads and decodes resources on a pool of worker threads and
+ *  queues any finalization that must happen on the owning thread, such as
+ *  creating OpenGL or OpenAL objects, until ResourceLoader::update is called.
+ *
+ *  Readers that only touch the file system and the CPU, such as the image,
+ *  mesh and sample readers, can run entirely on a worker thread.  Resources
+ *  owning OpenGL or OpenAL objects are loaded by decoding their source data
+ *  on a worker thread and creating the final resource in a finisher.
+ *  Document readers, such as the model, material and font readers, parse
+ *  their XML and decode the meshes and images it refers to on a worker
+ *  thread, and create the resource on the owning thread.
+ *
+ *  @remarks The readers passed to a loader must outlive the loads using them.
+ *  @remarks Resources decoded on worker threads must not be read synchronously
+ *  by the owning thread while they are still being loaded.
+ */
+class ResourceLoader : public RefObject
+{
+public:
+  /*! Destructor.  Waits for running jobs and discards unfinished ones.
+   */
+  ~ResourceLoader();
+  /*! Reads the specified resource on a worker thread.
+   *  @param[in] reader The reader to use.  It must not touch OpenGL or
+   *  OpenAL.
+   *  @param[in] name The name of the resource.
+   *  @return A future for the resource.
+   */
+  template <typename T>
+  Ref<ResourceFuture<T>> read(ResourceReader<T>& reader, const String& name);
+  /*! Reads the source data of the specified resource on a worker thread,
+   *  then creates the resource from it using the specified finisher on the
+   *  owning thread.
+   *  @param[in] decoder The reader for the source data.  It must not touch
+   *  OpenGL or OpenAL.
+   *  @param[in] name The name of the source data.
+   *  @param[in] finisher The function creating the resource from the source
+   *  data, called during ResourceLoader::update.
+   *  @return A future for the resource.
+   */
+  template <typename T, typename U>
+  Ref<ResourceFuture<T>> read(ResourceReader<U>& decoder,
+                              const String& name,
+                              std::function<Ref<T> (U&)> finisher);
+  /*! Parses the XML document of the specified resource and decodes its
+   *  source data on a worker thread, then creates the resource from them on
+   *  the owning thread.
+   *  @param[in] reader The reader to use.
+   *  @param[in] name The name of the resource.
+   *  @return A future for the resource.
+   */
+  template <typename T>
+  Ref<ResourceFuture<T>> read(DocumentReader<T>& reader, const String& name);
+  /*! Completes finished loads on the calling thread until either the queue is
+   *  empty or the specified time budget is exhausted.  At least one finished
+   *  load is completed per call, if any are available.
+   *  @param[in] budget The time budget, in seconds.
+   */
+  void update(Time budget);
+  /*! @return The number of loads not yet completed by ResourceLoader::update.
+   */
+  size_t getPendingCount() const;
+  /*! @return @c true if the calling thread is a worker thread of any
+   *  resource loader, otherwise @c false.  Readers can use this to avoid
+   *  starting threads of their own while the loader already runs several
+   *  reads in parallel.
+   */
+  static bool isWorkerThread();
+  /*! @return The resource cache used by this loader.
+   */
+  ResourceCache& getCache() const;
+  /*! Creates a resource loader.
+   *  @param[in] cache The resource cache to use.
+   *  @param[in] threadCount The number of worker threads, or zero to use one
+   *  less than the number of hardware threads.
+   *  @return The newly created loader, or @c NULL if an error occurred.
+   */
+  static Ref<ResourceLoader> create(ResourceCache& cache, uint threadCount = 0);
+private:
+  class Job;
+  template <typename T>
+  class ReadJob;
+  template <typename T, typename U>
+  class DecodeJob;
+  template <typename T>
+  class ParseJob;
+  ResourceLoader(ResourceCache& cache);
+  ResourceLoader(const ResourceLoader& source);
+  ResourceLoader& operator = (const ResourceLoader& source);
+  bool init(uint threadCount);
+  template <typename T>
+  Ref<ResourceFuture<T>> findPending(const String& name) const;
+  void submit(Job* job, const String& name, RefObject* future);
+  void run();
+  typedef std::map<String, Ref<RefObject>> FutureMap;
+  ResourceCache& cache;
+  std::vector<std::thread> threads;
+  std::deque<Job*> queued;
+  std::deque<Job*> finished;
+  FutureMap pending;
+  mutable std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @internal
+ */
+class ResourceLoader::Job
+{
+public:
+  virtual ~Job() { }
+  /*! Called on a worker thread.
+   */
+  virtual void work() = 0;
+  /*! Called on the owning thread.
+   */
+  virtual void finish() = 0;
+  String name;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @internal
+ */
+template <typename T>
+class ResourceLoader::ReadJob : public ResourceLoader::Job
+{
+public:
+  ReadJob(ResourceReader<T>& initReader, ResourceFuture<T>& initFuture):
+    reader(initReader),
+    future(&initFuture)
+  {
+  }
+  void work()
+  {
+    resource = reader.read(name);
+  }
+  void finish()
+  {
+    future->complete(resource);
+  }
+private:
+  ResourceReader<T>& reader;
+  Ref<ResourceFuture<T>> future;
+  Ref<T> resource;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @internal
+ */
+template <typename T, typename U>
+class ResourceLoader::DecodeJob : public ResourceLoader::Job
+{
+public:
+  DecodeJob(ResourceReader<U>& initDecoder,
+            ResourceFuture<T>& initFuture,
+            std::function<Ref<T> (U&)> initFinisher):
+    decoder(initDecoder),
+    future(&initFuture),
+    finisher(initFinisher)
+  {
+  }
+  void work()
+  {
+    source = decoder.read(name);
+  }
+  void finish()
+  {
+    if (source)
+      future->complete(finisher(*source));
+    else
+      future->complete(NULL);
+  }
+private:
+  ResourceReader<U>& decoder;
+  Ref<ResourceFuture<T>> future;
+  std::function<Ref<T> (U&)> finisher;
+  Ref<U> source;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @internal
+ */
+template <typename T>
+class ResourceLoader::ParseJob : public ResourceLoader::Job
+{
+public:
+  ParseJob(DocumentReader<T>& initReader, ResourceFuture<T>& initFuture):
+    reader(initReader),
+    future(&initFuture)
+  {
+  }
+  void work()
+  {
+    ResourceCache& cache = reader.getCache();
+
+    const Path path = cache.findFile(name);
+    if (path.isEmpty())
+    {
+      logError("Failed to find resource \'%s\'", name.c_str());
+      return;
+    }
+
+    document = ResourceDocument::read(cache, name, path);
+    if (document && !reader.decode(name, *document, data))
+      document = NULL;
+  }
+  void finish()
+  {
+    if (Ref<T> cached = reader.getCache().template find<T>(name))
+      future->complete(cached);
+    else if (document)
+      future->complete(reader.create(name, *document, data));
+    else
+      future->complete(NULL);
+  }
+private:
+  DocumentReader<T>& reader;
+  Ref<ResourceFuture<T>> future;
+  Ref<ResourceDocument> document;
+  Ref<RefObject> data;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+template <typename T>
+inline Ref<ResourceFuture<T>> ResourceLoader::read(ResourceReader<T>& reader,
+                                                   const String& name)
+{
+  if (Ref<ResourceFuture<T>> future = findPending<T>(name))
+    return future;
+
+  Ref<ResourceFuture<T>> future(new ResourceFuture<T>(name));
+
+  if (Ref<T> cached = cache.find<T>(name))
+    future->complete(cached);
+  else
+    submit(new ReadJob<T>(reader, *future), name, future);
+
+  return future;
+}
+
+template <typename T, typename U>
+inline Ref<ResourceFuture<T>> ResourceLoader::read(ResourceReader<U>& decoder,
+                                                   const String& name,
+                                                   std::function<Ref<T> (U&)> finisher)
+{
+  if (Ref<ResourceFuture<T>> future = findPending<T>(name))
+    return future;
+
+  Ref<ResourceFuture<T>> future(new ResourceFuture<T>(name));
+  submit(new DecodeJob<T,U>(decoder, *future, finisher), name, future);
+  return future;
+}
+
+template <typename T>
+inline Ref<ResourceFuture<T>> ResourceLoader::read(DocumentReader<T>& reader,
+                                                   const String& name)
+{
+  if (Ref<ResourceFuture<T>> future = findPending<T>(name))
+    return future;
+
+  Ref<ResourceFuture<T>> future(new ResourceFuture<T>(name));
+
+  if (Ref<T> cached = cache.find<T>(name))
+    future->complete(cached);
+  else
+    submit(new ParseJob<T>(reader, *future), name, future);
+
+  return future;
+}
+
+template <typename T>
+inline Ref<ResourceFuture<T>> ResourceLoader::findPending(const String& name) const
+{
+  auto f = pending.find(name);
+  if (f == pending.end())
+    return NULL;
+
+  ResourceFuture<T>* future = dynamic_cast<ResourceFuture<T>*>((RefObject*) f->second);
+  if (!future)
+  {
+    logError("Resource \'%s\' is already being loaded as another type",
+             name.c_str());
+    return NULL;
+  }
+
+  return future;
+}
+
+///////////////////////////////////////////////////////////////////////
+
 } /*namespace wendy*/
 
 ///////////////////////////////////////////////////////////////////////
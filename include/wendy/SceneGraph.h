@@ -40,6 +40,75 @@ namespace wendy
 
 class Node;
 class Graph;
+class NodeTree;
+class TransformHierarchy;
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @brief Dynamic bounding volume hierarchy of scene graph nodes.
+ *  @ingroup scene
+ *
+ *  This is a binary tree of axis-aligned boxes, kept balanced by rotations as
+ *  nodes are inserted and removed.  Each node is stored with a box slightly
+ *  larger than its bounds, so that small movements don't require it to be
+ *  moved within the tree.
+ *
+ *  Graphs keep their root nodes in a node tree, and nodes with many children
+ *  keep their children in one, so that large child lists are culled without
+ *  testing every child.
+ */
+class NodeTree
+{
+public:
+  /*! Constructor.
+   */
+  NodeTree();
+  /*! Inserts the specified node into this tree.
+   *  @param[in] node The node to insert.
+   *  @param[in] bounds The world space bounds of the node.
+   *  @return The proxy identifying the node in this tree.
+   */
+  uint insert(Node& node, const Sphere& bounds);
+  /*! Removes the specified proxy from this tree.
+   */
+  void remove(uint proxy);
+  /*! Updates the bounds of the specified proxy, moving it within the tree if
+   *  it no longer fits inside its enlarged box.
+   */
+  void update(uint proxy, const Sphere& bounds);
+  /*! Retrieves the nodes whose bounds intersect the specified sphere.
+   */
+  void query(const Sphere& sphere, std::vector<Node*>& nodes) const;
+  /*! Retrieves the nodes whose bounds intersect the specified frustum.
+   */
+  void query(const Frustum& frustum, std::vector<Node*>& nodes) const;
+  /*! The proxy value representing no proxy.
+   */
+  static const uint NONE = 0xffffffff;
+private:
+  struct Entry
+  {
+    bool isLeaf() const { return left == NONE; }
+    vec3 minimum;
+    vec3 maximum;
+    Sphere bounds;
+    Node* node;
+    uint parent;
+    uint left;
+    uint right;
+    int height;
+  };
+  uint allocate();
+  void release(uint index);
+  void insertLeaf(uint leaf);
+  void removeLeaf(uint leaf);
+  uint balance(uint index);
+  void refit(uint index);
+  void collect(uint index, std::vector<Node*>& nodes) const;
+  std::vector<Entry> entries;
+  uint root;
+  uint freeList;
+};
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -52,6 +121,7 @@ class Graph;
 class Node
 {
   friend class Graph;
+  friend class TransformHierarchy;
 public:
   typedef std::vector<Node*> List;
   /*! Constructor.
@@ -97,6 +167,9 @@ public:
   void setLocalRotation(const quat& newRotation);
   void setLocalScale(float newScale);
   /*! @return The local-to-world transform of this scene node.
+   *
+   *  @remarks The returned reference is only valid until nodes are added to
+   *  or removed from the graph.
    */
   const Transform3& getWorldTransform() const;
   /*! @return The local space bounds of this node.
@@ -121,19 +194,38 @@ protected:
    *  @param[in,out] queue The render queue for collecting operations.
    */
   virtual void enqueue(render::Scene& scene, const Camera& camera) const;
+  /*! Increments the revision of the graph this node is attached to.  Call
+   *  this when a change affects the render operations of this node.
+   */
+  void invalidateGraph();
 private:
   Node(const Node& source);
   Node& operator = (const Node& source);
+  static void enqueueNodes(const List& nodes,
+                           render::Scene& scene,
+                           const Camera& camera);
   void invalidateBounds();
   void invalidateWorldTransform();
+  void invalidateTree();
+  void invalidateChildProxy();
+  bool updateChildTree() const;
   void setGraph(Graph* newGraph);
+  Sphere getWorldBounds() const;
   bool needsUpdate;
   Node* parent;
   Graph* graph;
+  uint proxy;
+  bool dirtyTree;
+  uint childProxy;
+  bool dirtyChildProxy;
+  mutable Ptr<NodeTree> childTree;
+  mutable List movedChildren;
+  mutable Transform3 childTreeTransform;
+  mutable bool dirtyChildTree;
+  uint slot;
   List children;
   Transform3 local;
   mutable Transform3 world;
-  mutable bool dirtyWorld;
   Sphere localBounds;
   mutable Sphere totalBounds;
   mutable bool dirtyBounds;
@@ -141,6 +233,57 @@ private:
 
 ///////////////////////////////////////////////////////////////////////
 
+/*! @brief Flattened transform hierarchy of scene graph nodes.
+ *  @ingroup scene
+ *
+ *  The local and world transforms of all nodes in a graph are stored in
+ *  arrays where parents always precede their children, so that all changed
+ *  world transforms can be updated in a single linear pass.
+ */
+class TransformHierarchy
+{
+public:
+  /*! Constructor.
+   */
+  TransformHierarchy();
+  /*! Adds the specified node to this hierarchy.
+   *  @param[in] node The node to add.
+   *  @param[in] parent The slot of the parent of the node, or @c NONE if it
+   *  is a root node.  The parent must already have been added.
+   *  @return The slot of the node.
+   */
+  uint insert(Node& node, uint parent, const Transform3& local);
+  /*! Removes the node in the specified slot from this hierarchy.  Its
+   *  children must be removed as well.
+   */
+  void remove(uint slot);
+  /*! Sets the local transform of the node in the specified slot.
+   */
+  void setLocalTransform(uint slot, const Transform3& local);
+  /*! @return The world transform of the node in the specified slot.
+   */
+  const Transform3& getWorldTransform(uint slot);
+  /*! Updates the world transforms of all changed nodes and their
+   *  descendants.
+   */
+  void update();
+  /*! The slot value representing no slot.
+   */
+  static const uint NONE = 0xffffffff;
+private:
+  bool refresh(uint slot);
+  void compact();
+  std::vector<Transform3> locals;
+  std::vector<Transform3> worlds;
+  std::vector<uint> parents;
+  std::vector<Node*> nodes;
+  std::vector<uint8> dirty;
+  size_t deadCount;
+  std::atomic<bool> anyDirty;
+};
+
+///////////////////////////////////////////////////////////////////////
+
 /*! @brief %Scene graph.
  *  @ingroup scene
  *
@@ -151,6 +294,7 @@ class Graph
 {
   friend class Node;
 public:
+  Graph();
   ~Graph();
   void update();
   void enqueue(render::Scene& scene, const Camera& camera) const;
@@ -159,9 +303,40 @@ public:
   void addRootNode(Node& node);
   void destroyRootNodes();
   const Node::List& getNodes() const;
+  /*! @return The revision of this graph.  This is incremented whenever nodes
+   *  are added, removed, moved or have their bounds or renderables changed,
+   *  and can be used to tell when recorded render commands are out of date.
+   */
+  uint getRevision() const;
+  /*! @return The job system used to update and enqueue nodes, or @c NULL if
+   *  they are processed on the calling thread.
+   */
+  JobSystem* getJobSystem() const;
+  /*! Sets the job system used to update and enqueue nodes.
+   *  @param[in] newJobSystem The job system to use, or @c NULL to process
+   *  nodes on the calling thread.
+   *
+   *  @remarks With a job system, nodes under different root nodes may be
+   *  updated and enqueued on different threads.  Their update and enqueue
+   *  methods may then only modify their own subtree, may not add or remove
+   *  nodes, may not make OpenGL calls and may not allocate from the geometry
+   *  pool of the scene.
+   */
+  void setJobSystem(JobSystem* newJobSystem);
 private:
+  void updateGroups();
+  void updateTree() const;
   Node::List roots;
   Node::List updated;
+  std::vector<Node::List> groups;
+  bool dirtyGroups;
+  mutable Node::List moved;
+  mutable std::mutex movedMutex;
+  mutable NodeTree tree;
+  mutable TransformHierarchy transforms;
+  mutable std::vector<render::Scene> chunks;
+  std::atomic<uint> revision;
+  Ref<JobSystem> jobs;
 };
 
 ///////////////////////////////////////////////////////////////////////
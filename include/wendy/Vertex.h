@@ -46,7 +46,27 @@ public:
   {
     /*! Component elements are 32-bit floating-point (float).
      */
-    FLOAT32
+    FLOAT32,
+    /*! Component elements are 16-bit floating-point (half).
+     */
+    FLOAT16,
+    /*! Component elements are 8-bit signed integers normalized to [-1,1].
+     */
+    SNORM8,
+    /*! Component elements are 8-bit unsigned integers normalized to [0,1].
+     */
+    UNORM8,
+    /*! Component elements are 16-bit signed integers normalized to [-1,1].
+     */
+    SNORM16,
+    /*! Component elements are 16-bit unsigned integers normalized to [0,1].
+     */
+    UNORM16,
+    /*! Component elements are 10-bit signed integers normalized to [-1,1],
+     *  with an optional 2-bit fourth element, packed into a single 32-bit
+     *  integer with the first element in the least significant bits.
+     */
+    INT_2_10_10_10_REV
   };
   /*! Constructor.
    */
@@ -33,6 +33,7 @@
 #include <wendy/Signal.h>
 #include <wendy/Timer.h>
 #include <wendy/Profile.h>
+#include <wendy/Job.h>
 
 #include <wendy/Transform.h>
 
@@ -140,12 +140,14 @@ void AABB::normalize()
 void AABB::getBounds(float& minX, float& minY, float& minZ,
                      float& maxX, float& maxY, float& maxZ) const
 {
-  minX = center.x - abs(size.x);
-  minY = center.y - abs(size.y);
-  minZ = center.z - abs(size.z);
-  maxX = center.x + abs(size.x);
-  maxY = center.y + abs(size.y);
-  maxZ = center.z + abs(size.z);
+  const vec3 extent = abs(size) / 2.f;
+
+  minX = center.x - extent.x;
+  minY = center.y - extent.y;
+  minZ = center.z - extent.z;
+  maxX = center.x + extent.x;
+  maxY = center.y + extent.y;
+  maxZ = center.z + extent.z;
 }
 
 void AABB::setBounds(float minX, float minY, float minZ,
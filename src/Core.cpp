@@ -29,6 +29,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 
@@ -68,6 +69,23 @@ namespace
 
 std::vector<LogConsumer*> consumers;
 
+// Serializes log entries from different threads, as well as changes to the
+// consumer list.  Recursive so that consumers may themselves log.
+std::recursive_mutex logMutex;
+
+void writeLogEntry(LogEntryType type, const char* prefix, const char* message)
+{
+  std::lock_guard<std::recursive_mutex> lock(logMutex);
+
+  if (consumers.empty())
+    std::cerr << prefix << message << std::endl;
+  else
+  {
+    for (auto c = consumers.begin();  c != consumers.end();  c++)
+      (*c)->onLogEntry(type, message);
+  }
+}
+
 } /*namespace*/
 
 ///////////////////////////////////////////////////////////////////////
@@ -267,13 +285,7 @@ void logError(const char* format, ...)
   if (result < 0)
     return;
 
-  if (consumers.empty())
-    std::cerr << "Error: " << message << std::endl;
-  else
-  {
-    for (auto c = consumers.begin();  c != consumers.end();  c++)
-      (*c)->onLogEntry(ERROR_LOG_ENTRY, message);
-  }
+  writeLogEntry(ERROR_LOG_ENTRY, "Error: ", message);
 
   std::free(message);
 }
@@ -291,13 +303,7 @@ void logWarning(const char* format, ...)
   if (result < 0)
     return;
 
-  if (consumers.empty())
-    std::cerr << "Warning: " << message << std::endl;
-  else
-  {
-    for (auto c = consumers.begin();  c != consumers.end();  c++)
-      (*c)->onLogEntry(WARNING_LOG_ENTRY, message);
-  }
+  writeLogEntry(WARNING_LOG_ENTRY, "Warning: ", message);
 
   std::free(message);
 }
@@ -315,13 +321,7 @@ void log(const char* format, ...)
   if (result < 0)
     return;
 
-  if (consumers.empty())
-    std::cerr << message << std::endl;
-  else
-  {
-    for (auto c = consumers.begin();  c != consumers.end();  c++)
-      (*c)->onLogEntry(INFO_LOG_ENTRY, message);
-  }
+  writeLogEntry(INFO_LOG_ENTRY, "", message);
 
   std::free(message);
 }
@@ -356,35 +356,148 @@ const char* Exception::what() const throw()
 
 ///////////////////////////////////////////////////////////////////////
 
-bool RefBase::unreferenced(RefObject* object)
+/*! @internal
+ *  @brief Shared state between a reference counted object and its weak
+ *  references.
+ */
+class RefTracker
 {
-  return object->count == 0;
-}
+public:
+  RefTracker(RefObject* object);
+  mutable std::mutex mutex;
+  RefObject* object;
+  std::atomic<uint> count;
+};
+
+///////////////////////////////////////////////////////////////////////
 
 void RefBase::increment(RefObject* object)
 {
-  object->count++;
+#if WENDY_ATOMIC_REFCOUNTS
+  // A new reference can only be made from an existing one, which already
+  // orders it with respect to other threads
+  object->count.fetch_add(1, std::memory_order_relaxed);
+#else
+  object->count.store(object->count.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+#endif
+}
+
+bool RefBase::decrement(RefObject* object)
+{
+#if WENDY_ATOMIC_REFCOUNTS
+  // All uses of the object through other references must happen before it is
+  // destroyed by whichever thread drops the last one
+  return object->count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#else
+  const uint count = object->count.load(std::memory_order_relaxed) - 1;
+  object->count.store(count, std::memory_order_relaxed);
+  return count == 0;
+#endif
+}
+
+RefTracker* RefBase::track(RefObject* object)
+{
+  RefTracker* tracker = object->tracker.load(std::memory_order_acquire);
+  if (tracker)
+  {
+    retain(tracker);
+    return tracker;
+  }
+
+  // The tracker is shared by the object and every weak reference to it
+  RefTracker* created = new RefTracker(object);
+
+  if (object->tracker.compare_exchange_strong(tracker, created,
+                                              std::memory_order_acq_rel))
+  {
+    return created;
+  }
+
+  delete created;
+  retain(tracker);
+  return tracker;
 }
 
-void RefBase::decrement(RefObject* object)
+void RefBase::retain(RefTracker* tracker)
+{
+  tracker->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RefBase::untrack(RefTracker* tracker)
+{
+  if (tracker->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete tracker;
+}
+
+RefObject* RefBase::lock(RefTracker* tracker)
+{
+  // The destructor of the object takes this lock before the object goes away,
+  // so it may safely be inspected here
+  std::lock_guard<std::mutex> lock(tracker->mutex);
+
+  RefObject* object = tracker->object;
+  if (!object)
+    return NULL;
+
+  // An object whose count has reached zero is being destroyed and may not be
+  // brought back
+  uint count = object->count.load(std::memory_order_relaxed);
+
+  do
+  {
+    if (count == 0)
+      return NULL;
+  }
+  while (!object->count.compare_exchange_weak(count, count + 1,
+                                              std::memory_order_relaxed));
+
+  return object;
+}
+
+bool RefBase::isExpired(const RefTracker* tracker)
+{
+  std::lock_guard<std::mutex> lock(tracker->mutex);
+
+  return !tracker->object ||
+         tracker->object->count.load(std::memory_order_relaxed) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+RefTracker::RefTracker(RefObject* initObject):
+  object(initObject),
+  count(2)
 {
-  object->count--;
 }
 
 ///////////////////////////////////////////////////////////////////////
 
 RefObject::RefObject():
-  count(0)
+  count(0),
+  tracker(NULL)
 {
 }
 
 RefObject::RefObject(const RefObject& source):
-  count(0)
+  count(0),
+  tracker(NULL)
 {
 }
 
 RefObject::~RefObject()
 {
+  RefTracker* current = tracker.load(std::memory_order_acquire);
+  if (current)
+  {
+    {
+      std::lock_guard<std::mutex> lock(current->mutex);
+      current->object = NULL;
+    }
+
+    if (current->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete current;
+  }
 }
 
 RefObject& RefObject::operator = (const RefObject& source)
@@ -396,11 +509,13 @@ RefObject& RefObject::operator = (const RefObject& source)
 
 LogConsumer::LogConsumer()
 {
+  std::lock_guard<std::recursive_mutex> lock(logMutex);
   consumers.push_back(this);
 }
 
 LogConsumer::~LogConsumer()
 {
+  std::lock_guard<std::recursive_mutex> lock(logMutex);
   consumers.erase(std::find(consumers.begin(), consumers.end(), this));
 }
 
@@ -108,7 +108,7 @@ Interface::Interface(input::Window& window, UI::Drawer& drawer):
   root(NULL)
 {
   root = new Panel(*this);
-  root->setArea(Rect(0.f, 0.f, 150.f, 220.f));
+  root->setArea(Rect(0.f, 0.f, 150.f, 260.f));
   addRootWidget(*root);
 
   UI::Layout* layout = new UI::Layout(*this, UI::VERTICAL, true);
@@ -138,6 +138,8 @@ void Interface::update()
     updateCountItem(ITEM_POINTS, "points / f", frame.pointCount);
     updateCountItem(ITEM_LINES, "lines / f", frame.lineCount);
     updateCountItem(ITEM_TRIANGLES, "triangles / f", frame.triangleCount);
+    updateCountItem(ITEM_UNIFORMS, "uniforms / f", frame.uniformUploadCount);
+    updateCountItem(ITEM_SKIPPED_UNIFORMS, "skipped / f", frame.skippedUniformUploadCount);
 
     updateCountItem(ITEM_PROGRAMS, "programs", stats->getProgramCount());
     updateCountSizeItem(ITEM_TEXTURES,
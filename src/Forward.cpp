@@ -52,42 +52,228 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+// Returns the end of the run of sorted operations starting at the specified
+// position that share its pass and primitive range, if its program can render
+// them as a single instanced draw
+size_t findInstanceRun(const GL::Context& context,
+                       const render::OperationIndexList& indices,
+                       const render::OperationList& operations,
+                       size_t first)
+{
+  if (!context.isInstancingSupported())
+    return first;
+
+  const render::Operation& op = operations[indices[first]];
+
+  GL::Program* program = op.state->getProgram();
+  if (!program || !program->hasInstanceAttribute())
+    return first;
+
+  size_t last = first + 1;
+
+  while (last < indices.size())
+  {
+    const render::Operation& next = operations[indices[last]];
+    if (next.state != op.state || next.range != op.range)
+      break;
+
+    last++;
+  }
+
+  return last;
+}
+
+// Returns whether any operation in the specified queue uses geometry from the
+// specified pool, which is overwritten by later frames
+bool usesTransientGeometry(const render::GeometryPool& pool,
+                           const render::Queue& queue)
+{
+  const render::OperationList& operations = queue.getOperations();
+
+  for (auto o = operations.begin();  o != operations.end();  o++)
+  {
+    if (pool.isTransient(o->range))
+      return true;
+  }
+
+  return false;
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
+SharedProgramState::SharedProgramState(Mode mode):
+  render::SharedProgramState(mode)
+{
+}
+
+///////////////////////////////////////////////////////////////////////
+
 Config::Config(render::GeometryPool& initPool):
-  pool(&initPool)
+  pool(&initPool),
+  threaded(false)
 {
 }
 
 ///////////////////////////////////////////////////////////////////////
 
+Renderer::~Renderer()
+{
+  if (thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quitting = true;
+    }
+
+    condition.notify_all();
+    thread.join();
+
+    if (detached)
+      getContext().makeCurrent();
+  }
+}
+
+void Renderer::submit(render::Scene& scene, const Camera& camera)
+{
+  ProfileNodeCall call("forward::Renderer::submit");
+
+  if (!thread.joinable())
+  {
+    renderScene(scene, camera);
+
+    scene.removeOperations();
+    scene.detachLights();
+    return;
+  }
+
+  synchronize();
+
+  // The render thread is done with the passes of the previous frame, and the
+  // caller may change the originals of the new ones once this returns
+  passes.clear();
+  passCopies.clear();
+
+  snapshotPasses(scene.getOpaqueQueue());
+  snapshotPasses(scene.getBlendedQueue());
+
+  // Hand the filled scene to the render thread and recycle the storage of the
+  // previous frame for the caller to fill next
+
+  submitted->swap(scene);
+  submittedCamera = camera;
+
+  scene.removeOperations();
+  scene.detachLights();
+
+  getContext().releaseCurrent();
+  detached = true;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = true;
+  }
+
+  condition.notify_all();
+}
+
+void Renderer::synchronize()
+{
+  if (!thread.joinable())
+    return;
+
+  ProfileNodeCall call("forward::Renderer::synchronize");
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (pending)
+      condition.wait(lock);
+  }
+
+  if (detached)
+  {
+    getContext().makeCurrent();
+    detached = false;
+  }
+}
+
+bool Renderer::isThreaded() const
+{
+  return thread.joinable();
+}
+
 void Renderer::render(const render::Scene& scene, const Camera& camera)
 {
-  ProfileNodeCall call("forward::Renderer::render");
+  synchronize();
+
+  renderScene(scene, camera);
+}
+
+void Renderer::render(const render::CommandBuffer& buffer, const Camera& camera)
+{
+  synchronize();
+
+  ProfileNodeCall call("forward::Renderer::replay");
+
+  if (!buffer.isValid())
+  {
+    logError("Cannot replay an invalid command buffer");
+    return;
+  }
 
   GL::Context& context = getContext();
-  context.setCurrentSharedProgramState(state);
 
-  const Recti& viewportArea = context.getViewportArea();
-  state->setViewportSize(float(viewportArea.size.x),
-                         float(viewportArea.size.y));
+  beginRender(camera);
 
-  state->setProjectionMatrix(camera.getProjectionMatrix());
-  state->setViewMatrix(camera.getViewTransform());
+  const render::CommandList& commands = buffer.getCommands();
 
-  if (camera.isPerspective())
+  for (auto c = commands.begin();  c != commands.end();  c++)
   {
-    state->setCameraProperties(camera.getTransform().position,
-                               camera.getFOV(),
-                               camera.getAspectRatio(),
-                               camera.getNearZ(),
-                               camera.getFarZ());
+    if (c->instanceCount)
+    {
+      state->setModelMatrix(mat4());
+      c->state->apply();
+
+      context.render(c->range, buffer.getInstances(*c));
+    }
+    else
+    {
+      state->setModelMatrix(c->transform);
+      c->state->apply();
+
+      context.render(c->range);
+    }
   }
 
-  renderOperations(scene.getOpaqueQueue());
-  renderOperations(scene.getBlendedQueue());
+  endRender();
+}
 
-  context.setCurrentSharedProgramState(NULL);
+bool Renderer::record(render::CommandBuffer& buffer,
+                      const render::Scene& scene,
+                      uint revision)
+{
+  synchronize();
 
-  releaseObjects();
+  ProfileNodeCall call("forward::Renderer::record");
+
+  buffer.begin(revision);
+
+  if (usesTransientGeometry(getGeometryPool(), scene.getOpaqueQueue()) ||
+      usesTransientGeometry(getGeometryPool(), scene.getBlendedQueue()))
+  {
+    logError("Cannot record operations using geometry from the geometry pool");
+    return false;
+  }
+
+  recordOperations(buffer, scene.getOpaqueQueue());
+  recordOperations(buffer, scene.getBlendedQueue());
+
+  return buffer.end();
 }
 
 SharedProgramState& Renderer::getSharedProgramState()
@@ -111,7 +297,11 @@ Ref<Renderer> Renderer::create(const Config& config)
 }
 
 Renderer::Renderer(render::GeometryPool& pool):
-  render::System(pool, render::System::FORWARD)
+  render::System(pool, render::System::FORWARD),
+  pending(false),
+  quitting(false),
+  detached(false),
+  instancingFailed(false)
 {
 }
 
@@ -126,24 +316,210 @@ bool Renderer::init(const Config& config)
 
   state->reserveSupported(context);
 
+  if (config.threaded)
+  {
+    submitted = new render::Scene(getGeometryPool());
+    thread = std::thread(&Renderer::runRenderThread, this);
+  }
+
   return true;
 }
 
+void Renderer::runRenderThread()
+{
+  GL::Context& context = getContext();
+
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;)
+  {
+    while (!pending && !quitting)
+      condition.wait(lock);
+
+    if (quitting)
+      break;
+
+    lock.unlock();
+
+    context.makeCurrent();
+    renderScene(*submitted, submittedCamera);
+    context.releaseCurrent();
+
+    lock.lock();
+
+    pending = false;
+    condition.notify_all();
+  }
+}
+
+void Renderer::snapshotPasses(render::Queue& queue)
+{
+  render::OperationList& operations = queue.getOperations();
+
+  for (auto o = operations.begin();  o != operations.end();  o++)
+  {
+    auto entry = passCopies.insert(std::make_pair(o->state, (const render::Pass*) NULL));
+    if (entry.second)
+    {
+      passes.push_back(*(o->state));
+      entry.first->second = &passes.back();
+    }
+
+    // Operations sharing a pass share its copy, so instancing is unaffected
+    o->state = entry.first->second;
+  }
+}
+
+void Renderer::renderScene(const render::Scene& scene, const Camera& camera)
+{
+  ProfileNodeCall call("forward::Renderer::render");
+
+  beginRender(camera);
+
+  renderOperations(scene.getOpaqueQueue());
+  renderOperations(scene.getBlendedQueue());
+
+  endRender();
+}
+
+void Renderer::beginRender(const Camera& camera)
+{
+  GL::Context& context = getContext();
+  context.setCurrentSharedProgramState(state);
+
+  const Recti& viewportArea = context.getViewportArea();
+  state->setViewportSize(float(viewportArea.size.x),
+                         float(viewportArea.size.y));
+
+  state->setProjectionMatrix(camera.getProjectionMatrix());
+  state->setViewMatrix(camera.getViewTransform());
+
+  if (camera.isPerspective())
+  {
+    state->setCameraProperties(camera.getTransform().position,
+                               camera.getFOV(),
+                               camera.getAspectRatio(),
+                               camera.getNearZ(),
+                               camera.getFarZ());
+  }
+}
+
+void Renderer::endRender()
+{
+  getContext().setCurrentSharedProgramState(NULL);
+
+  releaseObjects();
+}
+
 void Renderer::renderOperations(const render::Queue& queue)
 {
   GL::Context& context = getContext();
-  const render::SortKeyList& keys = queue.getSortKeys();
+  const render::OperationIndexList& indices = queue.getSortedIndices();
   const render::OperationList& operations = queue.getOperations();
 
-  for (auto k = keys.begin();  k != keys.end();  k++)
+  const size_t count = indices.size();
+  size_t first = 0;
+
+  while (first < count)
   {
-    const render::SortKey key(*k);
-    const render::Operation& op = operations[key.index];
+    const render::Operation& op = operations[indices[first]];
+
+    const size_t last = findInstanceRun(context, indices, operations, first);
+    if (last > first)
+    {
+      // Collapse the run of operations sharing this pass and primitive range
+      // into a single instanced draw
+
+      GL::VertexRange instances;
+      mat4* transforms = NULL;
+
+      const VertexFormat& format = render::CommandBuffer::instanceFormat;
+
+      if (getGeometryPool().allocateVertices(instances, last - first, format))
+      {
+        transforms = (mat4*) instances.lock(GL::LOCK_WRITE_UNSYNCHRONIZED);
+      }
+
+      if (transforms)
+      {
+        // Write the per-instance model matrices directly into the pool
+        for (size_t i = first;  i < last;  i++)
+          transforms[i - first] = operations[indices[i]].transform;
+
+        instances.unlock();
+
+        state->setModelMatrix(mat4());
+        op.state->apply();
+
+        context.render(op.range, instances);
+      }
+      else
+      {
+        if (!instancingFailed)
+        {
+          logError("Failed to allocate instance transforms; "
+                   "rendering instances one at a time");
+          instancingFailed = true;
+        }
+
+        for (size_t i = first;  i < last;  i++)
+        {
+          state->setModelMatrix(operations[indices[i]].transform);
+          op.state->apply();
+
+          context.render(op.range);
+        }
+      }
+
+      first = last;
+    }
+    else
+    {
+      state->setModelMatrix(op.transform);
+      op.state->apply();
+
+      context.render(op.range);
+
+      first++;
+    }
+  }
+}
 
-    state->setModelMatrix(op.transform);
-    op.state->apply();
+void Renderer::recordOperations(render::CommandBuffer& buffer,
+                                const render::Queue& queue)
+{
+  const render::OperationIndexList& indices = queue.getSortedIndices();
+  const render::OperationList& operations = queue.getOperations();
 
-    context.render(op.range);
+  const size_t count = indices.size();
+  size_t first = 0;
+
+  while (first < count)
+  {
+    const render::Operation& op = operations[indices[first]];
+
+    const size_t last = findInstanceRun(getContext(),
+                                        indices,
+                                        operations,
+                                        first);
+    if (last > first)
+    {
+      transforms.resize(last - first);
+
+      for (size_t i = first;  i < last;  i++)
+        transforms[i - first] = operations[indices[i]].transform;
+
+      buffer.addInstancedCommand(*op.state, op.range,
+                                 &transforms[0], transforms.size());
+
+      first = last;
+    }
+    else
+    {
+      buffer.addCommand(*op.state, op.range, op.transform);
+
+      first++;
+    }
   }
 }
 
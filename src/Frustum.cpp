@@ -32,6 +32,18 @@
 #include <wendy/AABB.h>
 #include <wendy/Frustum.h>
 
+#include <glm/gtx/compatibility.hpp>
+
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define WENDY_FRUSTUM_SIMD 1
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define WENDY_FRUSTUM_SIMD 1
+#endif
+
 ///////////////////////////////////////////////////////////////////////
 
 namespace wendy
@@ -39,8 +51,102 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+#if defined(__AVX__)
+
+typedef __m256 Lanes;
+
+const size_t LANE_COUNT = 8;
+
+inline Lanes load(const float* values) { return _mm256_loadu_ps(values); }
+inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+inline Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+inline Lanes either(Lanes a, Lanes b) { return _mm256_or_ps(a, b); }
+inline Lanes zero() { return _mm256_setzero_ps(); }
+inline Lanes greater(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline Lanes less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline Lanes notLess(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_NLT_UQ); }
+inline int mask(Lanes a) { return _mm256_movemask_ps(a); }
+
+#elif defined(WENDY_FRUSTUM_SIMD)
+
+typedef __m128 Lanes;
+
+const size_t LANE_COUNT = 4;
+
+inline Lanes load(const float* values) { return _mm_loadu_ps(values); }
+inline Lanes splat(float value) { return _mm_set1_ps(value); }
+inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes either(Lanes a, Lanes b) { return _mm_or_ps(a, b); }
+inline Lanes zero() { return _mm_setzero_ps(); }
+inline Lanes greater(Lanes a, Lanes b) { return _mm_cmpgt_ps(a, b); }
+inline Lanes less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+inline Lanes notLess(Lanes a, Lanes b) { return _mm_cmpnlt_ps(a, b); }
+inline int mask(Lanes a) { return _mm_movemask_ps(a); }
+
+#endif /*WENDY_FRUSTUM_SIMD*/
+
+vec3 intersectPlanes(const Plane& a, const Plane& b, const Plane& c)
+{
+  const vec3 bc = cross(b.normal, c.normal);
+  const vec3 ca = cross(c.normal, a.normal);
+  const vec3 ab = cross(a.normal, b.normal);
+
+  return (bc * a.distance + ca * b.distance + ab * c.distance) /
+         dot(a.normal, bc);
+}
+
+bool isSphereOutside(const Plane* planes, const vec3& center, float radius)
+{
+  for (size_t i = 0;  i < 6;  i++)
+  {
+    if (dot(planes[i].normal, center) - radius > planes[i].distance)
+      return true;
+  }
+
+  return false;
+}
+
+bool isBoxOutside(const Plane* planes,
+                  float minX, float minY, float minZ,
+                  float maxX, float maxY, float maxZ)
+{
+  for (size_t i = 0;  i < 6;  i++)
+  {
+    const vec3 negative(planes[i].normal.x < 0.f ? maxX : minX,
+                        planes[i].normal.y < 0.f ? maxY : minY,
+                        planes[i].normal.z < 0.f ? maxZ : minZ);
+
+    if (!planes[i].contains(negative))
+      return true;
+  }
+
+  return false;
+}
+
+bool isBoxOutside(const vec3& cornerMinimum,
+                  const vec3& cornerMaximum,
+                  float minX, float minY, float minZ,
+                  float maxX, float maxY, float maxZ)
+{
+  return maxX < cornerMinimum.x || minX > cornerMaximum.x ||
+         maxY < cornerMinimum.y || minY > cornerMaximum.y ||
+         maxZ < cornerMinimum.z || minZ > cornerMaximum.z;
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
 Frustum::Frustum()
 {
+  updateCornerBounds();
 }
 
 Frustum::Frustum(float FOV, float aspectRatio, float nearZ, float farZ)
@@ -90,37 +196,169 @@ bool Frustum::contains(const AABB& box) const
 
 bool Frustum::intersects(const Sphere& sphere) const
 {
+  return !isSphereOutside(planes, sphere.center, sphere.radius);
+}
+
+bool Frustum::intersects(const AABB& box) const
+{
+  float minX, minY, minZ, maxX, maxY, maxZ;
+  box.getBounds(minX, minY, minZ, maxX, maxY, maxZ);
+
+  if (isBoxOutside(planes, minX, minY, minZ, maxX, maxY, maxZ))
+    return false;
+
+  return !isBoxOutside(cornerMinimum, cornerMaximum,
+                       minX, minY, minZ, maxX, maxY, maxZ);
+}
+
+void Frustum::intersects(const float* centerX,
+                         const float* centerY,
+                         const float* centerZ,
+                         const float* radius,
+                         size_t count,
+                         uint8* results) const
+{
+  size_t index = 0;
+
+#if defined(WENDY_FRUSTUM_SIMD)
+  Lanes normalX[6], normalY[6], normalZ[6], distance[6];
+
   for (size_t i = 0;  i < 6;  i++)
   {
-    if (dot(planes[i].normal, sphere.center) - sphere.radius > planes[i].distance)
-      return false;
+    normalX[i] = splat(planes[i].normal.x);
+    normalY[i] = splat(planes[i].normal.y);
+    normalZ[i] = splat(planes[i].normal.z);
+    distance[i] = splat(planes[i].distance);
   }
 
-  return true;
+  for (;  index + LANE_COUNT <= count;  index += LANE_COUNT)
+  {
+    const Lanes x = load(centerX + index);
+    const Lanes y = load(centerY + index);
+    const Lanes z = load(centerZ + index);
+    const Lanes r = load(radius + index);
+
+    Lanes outside = zero();
+
+    for (size_t i = 0;  i < 6;  i++)
+    {
+      const Lanes d = add(add(mul(normalX[i], x), mul(normalY[i], y)),
+                          mul(normalZ[i], z));
+
+      outside = either(outside, greater(sub(d, r), distance[i]));
+    }
+
+    const int bits = mask(outside);
+
+    for (size_t i = 0;  i < LANE_COUNT;  i++)
+      results[index + i] = ((bits >> i) & 1) ^ 1;
+  }
+#endif /*WENDY_FRUSTUM_SIMD*/
+
+  for (;  index < count;  index++)
+  {
+    const vec3 center(centerX[index], centerY[index], centerZ[index]);
+    results[index] = !isSphereOutside(planes, center, radius[index]);
+  }
 }
 
-bool Frustum::intersects(const AABB& box) const
+void Frustum::intersects(const float* minX,
+                         const float* minY,
+                         const float* minZ,
+                         const float* maxX,
+                         const float* maxY,
+                         const float* maxZ,
+                         size_t count,
+                         uint8* results) const
 {
-  float minX, minY, minZ, maxX, maxY, maxZ;
-  box.getBounds(minX, minY, minZ, maxX, maxY, maxZ);
+  size_t index = 0;
+
+#if defined(WENDY_FRUSTUM_SIMD)
+  Lanes normalX[6], normalY[6], normalZ[6], distance[6];
 
   for (size_t i = 0;  i < 6;  i++)
   {
-    const vec3 negative(planes[i].normal.x < 0.f ? maxX : minX,
-                        planes[i].normal.y < 0.f ? maxY : minY,
-                        planes[i].normal.z < 0.f ? maxZ : minZ);
+    normalX[i] = splat(planes[i].normal.x);
+    normalY[i] = splat(planes[i].normal.y);
+    normalZ[i] = splat(planes[i].normal.z);
+    distance[i] = splat(planes[i].distance);
+  }
 
-    if (!planes[i].contains(negative))
-      return false;
+  const Lanes cornerMinX = splat(cornerMinimum.x);
+  const Lanes cornerMinY = splat(cornerMinimum.y);
+  const Lanes cornerMinZ = splat(cornerMinimum.z);
+  const Lanes cornerMaxX = splat(cornerMaximum.x);
+  const Lanes cornerMaxY = splat(cornerMaximum.y);
+  const Lanes cornerMaxZ = splat(cornerMaximum.z);
+
+  for (;  index + LANE_COUNT <= count;  index += LANE_COUNT)
+  {
+    const Lanes x0 = load(minX + index);
+    const Lanes y0 = load(minY + index);
+    const Lanes z0 = load(minZ + index);
+    const Lanes x1 = load(maxX + index);
+    const Lanes y1 = load(maxY + index);
+    const Lanes z1 = load(maxZ + index);
+
+    Lanes outside = either(either(less(x1, cornerMinX), greater(x0, cornerMaxX)),
+                           either(less(y1, cornerMinY), greater(y0, cornerMaxY)));
+    outside = either(outside,
+                     either(less(z1, cornerMinZ), greater(z0, cornerMaxZ)));
+
+    for (size_t i = 0;  i < 6;  i++)
+    {
+      // The normal is the same for the whole batch, so the corner nearest the
+      // inside of the plane can be chosen per plane instead of per box
+      const vec3& normal = planes[i].normal;
+      const Lanes x = normal.x < 0.f ? x1 : x0;
+      const Lanes y = normal.y < 0.f ? y1 : y0;
+      const Lanes z = normal.z < 0.f ? z1 : z0;
+
+      const Lanes d = add(add(mul(normalX[i], x), mul(normalY[i], y)),
+                          mul(normalZ[i], z));
+
+      outside = either(outside, notLess(d, distance[i]));
+    }
+
+    const int bits = mask(outside);
+
+    for (size_t i = 0;  i < LANE_COUNT;  i++)
+      results[index + i] = ((bits >> i) & 1) ^ 1;
   }
+#endif /*WENDY_FRUSTUM_SIMD*/
 
-  return true;
+  for (;  index < count;  index++)
+  {
+    results[index] = !isBoxOutside(planes,
+                                   minX[index], minY[index], minZ[index],
+                                   maxX[index], maxY[index], maxZ[index]) &&
+                     !isBoxOutside(cornerMinimum, cornerMaximum,
+                                   minX[index], minY[index], minZ[index],
+                                   maxX[index], maxY[index], maxZ[index]);
+  }
+}
+
+void Frustum::getCorners(vec3 corners[8]) const
+{
+  const FrustumPlane depths[] = { FRUSTUM_NEAR, FRUSTUM_FAR };
+
+  for (size_t i = 0;  i < 2;  i++)
+  {
+    const Plane& depth = planes[depths[i]];
+
+    corners[i * 4 + 0] = intersectPlanes(depth, planes[FRUSTUM_TOP], planes[FRUSTUM_LEFT]);
+    corners[i * 4 + 1] = intersectPlanes(depth, planes[FRUSTUM_TOP], planes[FRUSTUM_RIGHT]);
+    corners[i * 4 + 2] = intersectPlanes(depth, planes[FRUSTUM_BOTTOM], planes[FRUSTUM_RIGHT]);
+    corners[i * 4 + 3] = intersectPlanes(depth, planes[FRUSTUM_BOTTOM], planes[FRUSTUM_LEFT]);
+  }
 }
 
 void Frustum::transformBy(const Transform3& transform)
 {
   for (size_t i = 0;  i < 6;  i++)
     planes[i].transformBy(transform);
+
+  updateCornerBounds();
 }
 
 void Frustum::setPerspective(float FOV, float aspectRatio, float nearZ, float farZ)
@@ -146,6 +384,8 @@ void Frustum::setPerspective(float FOV, float aspectRatio, float nearZ, float fa
 
   planes[FRUSTUM_NEAR].set(vec3(0.f, 0.f, 1.f), -nearZ);
   planes[FRUSTUM_FAR].set(vec3(0.f, 0.f, -1.f), farZ);
+
+  updateCornerBounds();
 }
 
 void Frustum::setOrtho(const AABB& volume)
@@ -168,6 +408,33 @@ void Frustum::setOrtho(float minX, float minY, float minZ,
   planes[FRUSTUM_LEFT].set(vec3(-1.f, 0.f, 0.f), -minX);
   planes[FRUSTUM_NEAR].set(vec3(0.f, 0.f, 1.f), maxZ);
   planes[FRUSTUM_FAR].set(vec3(0.f, 0.f, -1.f), -minZ);
+
+  updateCornerBounds();
+}
+
+// Calculates the bounding box of the corners of the frustum.  This rejects
+// boxes that pass all six plane tests while lying outside a corner of the
+// frustum, which is common for large boxes and wide frustums.
+void Frustum::updateCornerBounds()
+{
+  vec3 corners[8];
+  getCorners(corners);
+
+  cornerMinimum = cornerMaximum = corners[0];
+
+  for (size_t i = 0;  i < 8;  i++)
+  {
+    if (!all(isfinite(corners[i])))
+    {
+      // Degenerate frustums have no corners to test against
+      cornerMinimum = vec3(-std::numeric_limits<float>::infinity());
+      cornerMaximum = vec3(std::numeric_limits<float>::infinity());
+      return;
+    }
+
+    cornerMinimum = min(cornerMinimum, corners[i]);
+    cornerMaximum = max(cornerMaximum, corners[i]);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -49,16 +49,20 @@ namespace wendy
 namespace
 {
 
-GLenum convertToGL(LockType type)
+GLbitfield convertToGL(LockType type)
 {
   switch (type)
   {
     case LOCK_READ_ONLY:
-      return GL_READ_ONLY;
+      return GL_MAP_READ_BIT;
     case LOCK_WRITE_ONLY:
-      return GL_WRITE_ONLY;
+      return GL_MAP_WRITE_BIT;
     case LOCK_READ_WRITE:
-      return GL_READ_WRITE;
+      return GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
+    case LOCK_WRITE_UNSYNCHRONIZED:
+      return GL_MAP_WRITE_BIT |
+             GL_MAP_INVALIDATE_RANGE_BIT |
+             GL_MAP_UNSYNCHRONIZED_BIT;
   }
 
   panic("Invalid lock type %u", type);
@@ -155,6 +159,8 @@ VertexBuffer::~VertexBuffer()
   if (locked)
     logWarning("Vertex buffer destroyed while locked");
 
+  context.deleteVertexArrays(this);
+
   if (bufferID)
     glDeleteBuffers(1, &bufferID);
 
@@ -163,6 +169,11 @@ VertexBuffer::~VertexBuffer()
 }
 
 void* VertexBuffer::lock(LockType type)
+{
+  return lock(0, count, type);
+}
+
+void* VertexBuffer::lock(size_t start, size_t rangeCount, LockType type)
 {
   if (locked)
   {
@@ -170,9 +181,19 @@ void* VertexBuffer::lock(LockType type)
     return NULL;
   }
 
+  if (start + rangeCount > count)
+  {
+    logError("Cannot lock vertices outside of vertex buffer");
+    return NULL;
+  }
+
   context.setCurrentVertexBuffer(this);
 
-  void* mapping = glMapBuffer(GL_ARRAY_BUFFER, convertToGL(type));
+  const size_t size = format.getSize();
+  void* mapping = glMapBufferRange(GL_ARRAY_BUFFER,
+                                   start * size,
+                                   rangeCount * size,
+                                   convertToGL(type));
   if (mapping == NULL)
   {
     checkGL("Failed to lock vertex buffer");
@@ -336,6 +357,8 @@ IndexBuffer::~IndexBuffer()
   if (locked)
     logWarning("Index buffer destroyed while locked");
 
+  context.deleteVertexArrays(this);
+
   if (bufferID)
     glDeleteBuffers(1, &bufferID);
 
@@ -344,6 +367,11 @@ IndexBuffer::~IndexBuffer()
 }
 
 void* IndexBuffer::lock(LockType type)
+{
+  return lock(0, count, type);
+}
+
+void* IndexBuffer::lock(size_t start, size_t rangeCount, LockType type)
 {
   if (locked)
   {
@@ -351,9 +379,19 @@ void* IndexBuffer::lock(LockType type)
     return NULL;
   }
 
+  if (start + rangeCount > count)
+  {
+    logError("Cannot lock indices outside of index buffer");
+    return NULL;
+  }
+
   context.setCurrentIndexBuffer(this);
 
-  void* mapping = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, convertToGL(type));
+  const size_t size = getTypeSize(this->type);
+  void* mapping = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER,
+                                   start * size,
+                                   rangeCount * size,
+                                   convertToGL(type));
   if (mapping == NULL)
   {
     checkGL("Failed to lock index buffer");
@@ -559,11 +597,7 @@ void* VertexRange::lock(LockType type) const
     return NULL;
   }
 
-  uint8* vertices = (uint8*) vertexBuffer->lock(type);
-  if (!vertices)
-    return NULL;
-
-  return vertices + start * vertexBuffer->getFormat().getSize();
+  return vertexBuffer->lock(start, count, type);
 }
 
 void VertexRange::unlock() const
@@ -643,11 +677,7 @@ void* IndexRange::lock(LockType type) const
     return NULL;
   }
 
-  uint8* indices = (uint8*) indexBuffer->lock(type);
-  if (!indices)
-    return NULL;
-
-  return indices + start * IndexBuffer::getTypeSize(indexBuffer->getType());
+  return indexBuffer->lock(start, count, type);
 }
 
 void IndexRange::unlock() const
@@ -789,6 +819,21 @@ PrimitiveRange::PrimitiveRange(PrimitiveType initType,
 {
 }
 
+bool PrimitiveRange::operator == (const PrimitiveRange& other) const
+{
+  return type == other.type &&
+         vertexBuffer == other.vertexBuffer &&
+         indexBuffer == other.indexBuffer &&
+         start == other.start &&
+         count == other.count &&
+         base == other.base;
+}
+
+bool PrimitiveRange::operator != (const PrimitiveRange& other) const
+{
+  return !(*this == other);
+}
+
 bool PrimitiveRange::isEmpty() const
 {
   if (vertexBuffer == NULL)
@@ -830,7 +875,7 @@ size_t PrimitiveRange::getBase() const
 ///////////////////////////////////////////////////////////////////////
 
 template <>
-IndexRangeLock<uint8>::IndexRangeLock(IndexRange& initRange):
+IndexRangeLock<uint8>::IndexRangeLock(IndexRange& initRange, LockType type):
   range(initRange),
   indices(NULL)
 {
@@ -840,13 +885,13 @@ IndexRangeLock<uint8>::IndexRangeLock(IndexRange& initRange):
       panic("Index buffer is not of type UINT8");
   }
 
-  indices = (uint8*) range.lock();
+  indices = (uint8*) range.lock(type);
   if (!indices)
     panic("Failed to lock index buffer");
 }
 
 template <>
-IndexRangeLock<uint16>::IndexRangeLock(IndexRange& initRange):
+IndexRangeLock<uint16>::IndexRangeLock(IndexRange& initRange, LockType type):
   range(initRange),
   indices(NULL)
 {
@@ -856,13 +901,13 @@ IndexRangeLock<uint16>::IndexRangeLock(IndexRange& initRange):
       panic("Index buffer is not of type UINT16");
   }
 
-  indices = (uint16*) range.lock();
+  indices = (uint16*) range.lock(type);
   if (!indices)
     panic("Failed to lock index buffer");
 }
 
 template <>
-IndexRangeLock<uint32>::IndexRangeLock(IndexRange& initRange):
+IndexRangeLock<uint32>::IndexRangeLock(IndexRange& initRange, LockType type):
   range(initRange),
   indices(NULL)
 {
@@ -872,7 +917,7 @@ IndexRangeLock<uint32>::IndexRangeLock(IndexRange& initRange):
       panic("Index buffer is not of type UINT32");
   }
 
-  indices = (uint32*) range.lock();
+  indices = (uint32*) range.lock(type);
   if (!indices)
     panic("Failed to lock index buffer");
 }
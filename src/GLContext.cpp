@@ -43,6 +43,7 @@
 #include <GL/glfw3.h>
 
 #include <algorithm>
+#include <cstring>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -170,6 +171,51 @@ const char* getFramebufferStatusMessage(GLenum status)
   return "Unknown framebuffer status";
 }
 
+// Number of aligned slots in the ring of each shared uniform block buffer
+const size_t UNIFORM_BLOCK_SLOT_COUNT = 256;
+
+size_t getStd140Alignment(UniformType type)
+{
+  switch (type)
+  {
+    case UNIFORM_FLOAT:
+      return 4;
+    case UNIFORM_VEC2:
+      return 8;
+    case UNIFORM_VEC3:
+    case UNIFORM_VEC4:
+    case UNIFORM_MAT2:
+    case UNIFORM_MAT3:
+    case UNIFORM_MAT4:
+      return 16;
+  }
+
+  panic("Invalid GLSL uniform type %u", type);
+}
+
+size_t getStd140Size(UniformType type)
+{
+  switch (type)
+  {
+    case UNIFORM_FLOAT:
+      return 4;
+    case UNIFORM_VEC2:
+      return 8;
+    case UNIFORM_VEC3:
+      return 12;
+    case UNIFORM_VEC4:
+      return 16;
+    case UNIFORM_MAT2:
+      return 32;
+    case UNIFORM_MAT3:
+      return 48;
+    case UNIFORM_MAT4:
+      return 64;
+  }
+
+  panic("Invalid GLSL uniform type %u", type);
+}
+
 GLenum convertToGL(PrimitiveType type)
 {
   switch (type)
@@ -312,8 +358,7 @@ bool isCompatible(const Attribute& attribute, const VertexComponent& component)
   {
     case ATTRIBUTE_FLOAT:
     {
-      if (component.getType() == VertexComponent::FLOAT32 &&
-          component.getElementCount() == 1)
+      if (component.getElementCount() == 1)
         return true;
 
       break;
@@ -321,8 +366,7 @@ bool isCompatible(const Attribute& attribute, const VertexComponent& component)
 
     case ATTRIBUTE_VEC2:
     {
-      if (component.getType() == VertexComponent::FLOAT32 &&
-          component.getElementCount() == 2)
+      if (component.getElementCount() == 2)
         return true;
 
       break;
@@ -330,8 +374,7 @@ bool isCompatible(const Attribute& attribute, const VertexComponent& component)
 
     case ATTRIBUTE_VEC3:
     {
-      if (component.getType() == VertexComponent::FLOAT32 &&
-          component.getElementCount() == 3)
+      if (component.getElementCount() == 3)
         return true;
 
       break;
@@ -339,8 +382,7 @@ bool isCompatible(const Attribute& attribute, const VertexComponent& component)
 
     case ATTRIBUTE_VEC4:
     {
-      if (component.getType() == VertexComponent::FLOAT32 &&
-          component.getElementCount() == 4)
+      if (component.getElementCount() == 4)
         return true;
 
       break;
@@ -358,6 +400,16 @@ void setBooleanState(uint state, bool value)
     glDisable(state);
 }
 
+// Instanced arrays are core in OpenGL 3.3, where the extension may not be
+// listed and its entry point may be missing
+void setAttribDivisor(GLuint index, GLuint divisor)
+{
+  if (GLEW_VERSION_3_3)
+    glVertexAttribDivisor(index, divisor);
+  else
+    glVertexAttribDivisorARB(index, divisor);
+}
+
 } /*namespace (and Gandalf)*/
 
 ///////////////////////////////////////////////////////////////////////
@@ -488,6 +540,17 @@ Limits::Limits(Context& context)
   maxTextureCoords = getInteger(GL_MAX_TEXTURE_COORDS);
   maxVertexAttributes = getInteger(GL_MAX_VERTEX_ATTRIBS);
 
+  if (context.isUniformBufferSupported())
+  {
+    maxUniformBufferBindings = getInteger(GL_MAX_UNIFORM_BUFFER_BINDINGS);
+    uniformBufferOffsetAlignment = getInteger(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  }
+  else
+  {
+    maxUniformBufferBindings = 0;
+    uniformBufferOffsetAlignment = 1;
+  }
+
   if (GLEW_EXT_texture_filter_anisotropic)
     maxTextureAnisotropy = getFloat(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT);
   else
@@ -541,6 +604,18 @@ void Stats::addStateChange()
   frame.stateChangeCount++;
 }
 
+void Stats::addUniformUpload()
+{
+  Frame& frame = frames.front();
+  frame.uniformUploadCount++;
+}
+
+void Stats::addSkippedUniformUpload()
+{
+  Frame& frame = frames.front();
+  frame.skippedUniformUploadCount++;
+}
+
 void Stats::addPrimitives(PrimitiveType type, uint vertexCount)
 {
   Frame& frame = frames.front();
@@ -677,6 +752,8 @@ Stats::Frame::Frame():
   pointCount(0),
   lineCount(0),
   triangleCount(0),
+  uniformUploadCount(0),
+  skippedUniformUploadCount(0),
   duration(0.0)
 {
 }
@@ -702,28 +779,77 @@ public:
 class Context::SharedUniform
 {
 public:
-  SharedUniform(const char* name, UniformType type, int ID):
+  SharedUniform(const char* name, UniformType type, int ID, int blockID):
     name(name),
     type(type),
-    ID(ID)
+    ID(ID),
+    blockID(blockID)
   {
   }
   String name;
   UniformType type;
   int ID;
+  int blockID;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+class Context::SharedUniformBlock
+{
+public:
+  SharedUniformBlock(const char* name, int ID):
+    name(name),
+    ID(ID),
+    size(0),
+    stride(0),
+    offset(0),
+    bufferID(0)
+  {
+  }
+  String name;
+  int ID;
+  size_t size;
+  size_t stride;
+  size_t offset;
+  uint bufferID;
+  std::vector<char> data;
 };
 
 ///////////////////////////////////////////////////////////////////////
 
+bool Context::VertexArrayKey::operator < (const VertexArrayKey& other) const
+{
+  if (program != other.program)
+    return program < other.program;
+
+  if (vertexBuffer != other.vertexBuffer)
+    return vertexBuffer < other.vertexBuffer;
+
+  return indexBuffer < other.indexBuffer;
+}
+
+///////////////////////////////////////////////////////////////////////
+
 Context::~Context()
 {
   if (defaultFramebuffer)
     setDefaultFramebufferCurrent();
 
+  unbindVertexArray();
+
+  for (auto v = vertexArrayCache.begin();  v != vertexArrayCache.end();  v++)
+    glDeleteVertexArrays(1, &v->second);
+
   setCurrentVertexBuffer(NULL);
   setCurrentIndexBuffer(NULL);
   setCurrentProgram(NULL);
 
+  for (auto b = blocks.begin();  b != blocks.end();  b++)
+  {
+    if (b->bufferID)
+      glDeleteBuffers(1, &b->bufferID);
+  }
+
   for (size_t i = 0;  i < textureUnits.size();  i++)
   {
     setActiveTextureUnit(i);
@@ -836,76 +962,99 @@ void Context::render(PrimitiveType type,
 {
   ProfileNodeCall call("GL::Context::render");
 
-  if (!currentProgram)
+  if (!bindAttributes())
+    return;
+
+  const int location = currentProgram->instanceLocation;
+  if (location != -1)
   {
-    logError("Cannot render without a current shader program");
+    // NOTE: Without an instance range the per-instance model matrix falls back
+    //       to identity, i.e. the geometry is assumed to be in world space
+    glVertexAttrib4f(location + 0, 1.f, 0.f, 0.f, 0.f);
+    glVertexAttrib4f(location + 1, 0.f, 1.f, 0.f, 0.f);
+    glVertexAttrib4f(location + 2, 0.f, 0.f, 1.f, 0.f);
+    glVertexAttrib4f(location + 3, 0.f, 0.f, 0.f, 1.f);
+  }
+
+  draw(type, start, count, base, 1);
+}
+
+void Context::render(const PrimitiveRange& range, const VertexRange& instances)
+{
+  ProfileNodeCall call("GL::Context::render");
+
+  if (range.isEmpty())
+  {
+    logWarning("Rendering empty primitive range with shader program \'%s\'",
+               currentProgram->getName().c_str());
     return;
   }
 
-  if (!currentVertexBuffer)
+  VertexBuffer* instanceBuffer = instances.getVertexBuffer();
+  if (!instanceBuffer || !instances.getCount())
+    return;
+
+  if (!instancing)
   {
-    logError("Cannot render without a current vertex buffer");
+    logError("Cannot render instances without support for instanced arrays");
     return;
   }
 
-  if (dirtyBinding)
+  if (instanceBuffer->getFormat().getSize() != sizeof(mat4))
   {
-    const VertexFormat& format = currentVertexBuffer->getFormat();
+    logError("Instance vertex format \'%s\' is not a single matrix",
+             instanceBuffer->getFormat().asString().c_str());
+    return;
+  }
 
-    if (currentProgram->getAttributeCount() > format.getComponentCount())
-    {
-      logError("Shader program \'%s\' has more attributes than vertex format has components",
-               currentProgram->getName().c_str());
-      return;
-    }
+  setCurrentVertexBuffer(range.getVertexBuffer());
+  setCurrentIndexBuffer(range.getIndexBuffer());
 
-    for (size_t i = 0;  i < currentProgram->getAttributeCount();  i++)
-    {
-      Attribute& attribute = currentProgram->getAttribute(i);
+  if (!bindAttributes())
+    return;
 
-      const VertexComponent* component = format.findComponent(attribute.getName().c_str());
-      if (!component)
-      {
-        logError("Attribute \'%s\' of program \'%s\' has no corresponding vertex format component",
-                 attribute.getName().c_str(),
-                 currentProgram->getName().c_str());
-        return;
-      }
+  const int location = currentProgram->instanceLocation;
+  if (location == -1)
+  {
+    logError("Shader program \'%s\' has no per-instance model matrix attribute",
+             currentProgram->getName().c_str());
+    return;
+  }
 
-      if (!isCompatible(attribute, *component))
-      {
-        logError("Attribute \'%s\' of shader program \'%s\' has incompatible type",
-                 attribute.getName().c_str(),
-                 currentProgram->getName().c_str());
-        return;
-      }
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer->bufferID);
 
-      attribute.bind(format.getSize(), component->getOffset());
-    }
+  const size_t offset = instances.getStart() * sizeof(mat4);
 
-    dirtyBinding = false;
+  for (uint i = 0;  i < 4;  i++)
+  {
+    glEnableVertexAttribArray(location + i);
+    glVertexAttribPointer(location + i,
+                          4,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          sizeof(mat4),
+                          (const void*) (offset + i * sizeof(vec4)));
+    setAttribDivisor(location + i, 1);
   }
 
+  glBindBuffer(GL_ARRAY_BUFFER, currentVertexBuffer->bufferID);
+
 #if WENDY_DEBUG
-  if (!currentProgram->isValid())
+  if (!checkGL("Failed to bind per-instance model matrix attribute"))
     return;
 #endif
 
-  if (currentIndexBuffer)
-  {
-    const size_t size = IndexBuffer::getTypeSize(currentIndexBuffer->getType());
+  draw(range.getType(),
+       range.getStart(),
+       range.getCount(),
+       range.getBase(),
+       instances.getCount());
 
-    glDrawElementsBaseVertex(convertToGL(type),
-                             count,
-                             convertToGL(currentIndexBuffer->getType()),
-                             (GLvoid*) (size * start),
-                             base);
+  for (uint i = 0;  i < 4;  i++)
+  {
+    setAttribDivisor(location + i, 0);
+    glDisableVertexAttribArray(location + i);
   }
-  else
-    glDrawArrays(convertToGL(type), start, count);
-
-  if (stats)
-    stats->addPrimitives(type, count);
 }
 
 void Context::refresh()
@@ -944,6 +1093,21 @@ void Context::requestClose()
   closeCallback(handle);
 }
 
+void Context::makeCurrent()
+{
+  glfwMakeContextCurrent(handle);
+}
+
+void Context::releaseCurrent()
+{
+  glfwMakeContextCurrent(NULL);
+}
+
+bool Context::isCurrent() const
+{
+  return glfwGetCurrentContext() == handle;
+}
+
 void Context::createSharedSampler(const char* name, SamplerType type, int ID)
 {
   assert(ID != INVALID_SHARED_STATE_ID);
@@ -951,21 +1115,86 @@ void Context::createSharedSampler(const char* name, SamplerType type, int ID)
   if (getSharedSamplerID(name, type) != INVALID_SHARED_STATE_ID)
     return;
 
-  declaration += format("uniform %s %s;\n", Sampler::getTypeName(type), name);
-
   samplers.push_back(SharedSampler(name, type, ID));
+
+  updateDeclaration();
 }
 
-void Context::createSharedUniform(const char* name, UniformType type, int ID)
+void Context::createSharedUniform(const char* name,
+                                  UniformType type,
+                                  int ID,
+                                  int blockID)
 {
   assert(ID != INVALID_SHARED_STATE_ID);
 
   if (getSharedUniformID(name, type) != INVALID_SHARED_STATE_ID)
     return;
 
-  declaration += format("uniform %s %s;\n", Uniform::getTypeName(type), name);
+  if (blockID != INVALID_SHARED_STATE_ID)
+  {
+    auto b = blocks.begin();
+    while (b != blocks.end() && b->ID != blockID)
+      b++;
+
+    if (b == blocks.end())
+    {
+      logError("Cannot add shared uniform \'%s\' to unknown uniform block %i",
+               name, blockID);
+      return;
+    }
+
+    if (b->bufferID)
+    {
+      logError("Cannot add shared uniform \'%s\' to uniform block \'%s\' already in use",
+               name, b->name.c_str());
+      return;
+    }
+
+    const size_t alignment = getStd140Alignment(type);
+    b->size = (b->size + alignment - 1) / alignment * alignment;
+    b->size += getStd140Size(type);
+  }
+
+  uniforms.push_back(SharedUniform(name, type, ID, blockID));
 
-  uniforms.push_back(SharedUniform(name, type, ID));
+  updateDeclaration();
+}
+
+bool Context::createSharedUniformBlock(const char* name, int ID)
+{
+  assert(ID != INVALID_SHARED_STATE_ID);
+
+  if (getSharedUniformBlockID(name) != INVALID_SHARED_STATE_ID)
+    return true;
+
+  if (!uniformBuffers)
+  {
+    logError("Cannot create shared uniform block \'%s\' without uniform buffer support",
+             name);
+    return false;
+  }
+
+  if (ID < 0 || uint(ID) >= limits->maxUniformBufferBindings)
+  {
+    logError("Shared uniform block \'%s\' has ID %i outside the range of binding points",
+             name, ID);
+    return false;
+  }
+
+  for (auto b = blocks.begin();  b != blocks.end();  b++)
+  {
+    if (b->ID == ID)
+    {
+      logError("Shared uniform block ID %i is already used by \'%s\'",
+               ID, b->name.c_str());
+      return false;
+    }
+  }
+
+  blocks.push_back(SharedUniformBlock(name, ID));
+
+  updateDeclaration();
+  return true;
 }
 
 int Context::getSharedSamplerID(const char* name, SamplerType type) const
@@ -990,6 +1219,17 @@ int Context::getSharedUniformID(const char* name, UniformType type) const
   return INVALID_SHARED_STATE_ID;
 }
 
+int Context::getSharedUniformBlockID(const char* name) const
+{
+  for (auto b = blocks.begin(); b != blocks.end(); b++)
+  {
+    if (b->name == name)
+      return b->ID;
+  }
+
+  return INVALID_SHARED_STATE_ID;
+}
+
 SharedProgramState* Context::getCurrentSharedProgramState() const
 {
   return currentSharedState;
@@ -1113,6 +1353,8 @@ void Context::setCurrentProgram(Program* newProgram)
 {
   if (newProgram != currentProgram)
   {
+    unbindVertexArray();
+
     if (currentProgram)
       currentProgram->unbind();
 
@@ -1159,6 +1401,8 @@ void Context::setCurrentIndexBuffer(IndexBuffer* newIndexBuffer)
 {
   if (newIndexBuffer != currentIndexBuffer)
   {
+    unbindVertexArray();
+
     currentIndexBuffer = newIndexBuffer;
     dirtyBinding = true;
 
@@ -1293,6 +1537,41 @@ Version Context::getVersion() const
   return version;
 }
 
+bool Context::isInstancingSupported() const
+{
+  return instancing;
+}
+
+bool Context::isUniformBufferSupported() const
+{
+  return uniformBuffers;
+}
+
+bool Context::isVertexArraySupported() const
+{
+  return vertexArrays;
+}
+
+bool Context::isProgramBinarySupported() const
+{
+  return programBinaries;
+}
+
+bool Context::isPackedVertexSupported() const
+{
+  return packedVertices;
+}
+
+const Path& Context::getProgramCachePath() const
+{
+  return programCachePath;
+}
+
+void Context::setProgramCachePath(const Path& newPath)
+{
+  programCachePath = newPath;
+}
+
 const Limits& Context::getLimits() const
 {
   return *limits;
@@ -1331,10 +1610,16 @@ Context::Context(ResourceCache& initCache):
   refreshMode(AUTOMATIC_REFRESH),
   needsRefresh(false),
   needsClosing(false),
+  instancing(false),
+  uniformBuffers(false),
+  vertexArrays(false),
+  programBinaries(false),
+  packedVertices(false),
   dirtyBinding(true),
   dirtyState(true),
   cullingInverted(false),
   activeTextureUnit(0),
+  currentVertexArray(0),
   stats(NULL)
 {
 }
@@ -1428,6 +1713,18 @@ bool Context::init(const WindowConfig& wc, const ContextConfig& cc)
       glDebugMessageCallbackARB(debugCallback, NULL);
       glDebugMessageControlARB(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
     }
+
+    instancing = GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays;
+    uniformBuffers = GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object;
+    vertexArrays = GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+    packedVertices = GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev;
+
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+    {
+      GLint formatCount;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+      programBinaries = formatCount > 0;
+    }
   }
 
   // All extensions are there; figure out their limits
@@ -1484,6 +1781,300 @@ bool Context::init(const WindowConfig& wc, const ContextConfig& cc)
   return true;
 }
 
+bool Context::bindAttributes()
+{
+  if (!currentProgram)
+  {
+    logError("Cannot render without a current shader program");
+    return false;
+  }
+
+  if (!currentVertexBuffer)
+  {
+    logError("Cannot render without a current vertex buffer");
+    return false;
+  }
+
+  if (dirtyBinding)
+  {
+    if (vertexArrays)
+    {
+      VertexArrayKey key;
+      key.program = currentProgram;
+      key.vertexBuffer = currentVertexBuffer;
+      key.indexBuffer = currentIndexBuffer;
+
+      auto entry = vertexArrayCache.find(key);
+      if (entry == vertexArrayCache.end())
+      {
+        // Attributes are matched to vertex components by name only once, when
+        // the vertex array object for this combination is created
+
+        uint arrayID;
+        glGenVertexArrays(1, &arrayID);
+        glBindVertexArray(arrayID);
+        currentVertexArray = arrayID;
+
+        if (currentIndexBuffer)
+          glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, currentIndexBuffer->bufferID);
+
+        if (!setupAttributes(true))
+        {
+          unbindVertexArray();
+          glDeleteVertexArrays(1, &arrayID);
+          return false;
+        }
+
+        vertexArrayCache[key] = arrayID;
+      }
+      else if (entry->second != currentVertexArray)
+      {
+        glBindVertexArray(entry->second);
+        currentVertexArray = entry->second;
+      }
+    }
+    else
+    {
+      if (!setupAttributes(false))
+        return false;
+    }
+
+    dirtyBinding = false;
+  }
+
+#if WENDY_DEBUG
+  if (!currentProgram->isValid())
+    return false;
+#endif
+
+  return true;
+}
+
+bool Context::setupAttributes(bool enable)
+{
+  const VertexFormat& format = currentVertexBuffer->getFormat();
+
+  if (currentProgram->getAttributeCount() > format.getComponentCount())
+  {
+    logError("Shader program \'%s\' has more attributes than vertex format has components",
+             currentProgram->getName().c_str());
+    return false;
+  }
+
+  for (size_t i = 0;  i < currentProgram->getAttributeCount();  i++)
+  {
+    Attribute& attribute = currentProgram->getAttribute(i);
+
+    const VertexComponent* component = format.findComponent(attribute.getName().c_str());
+    if (!component)
+    {
+      logError("Attribute \'%s\' of program \'%s\' has no corresponding vertex format component",
+               attribute.getName().c_str(),
+               currentProgram->getName().c_str());
+      return false;
+    }
+
+    if (!isCompatible(attribute, *component))
+    {
+      logError("Attribute \'%s\' of shader program \'%s\' has incompatible type",
+               attribute.getName().c_str(),
+               currentProgram->getName().c_str());
+      return false;
+    }
+
+    if (enable)
+      glEnableVertexAttribArray(attribute.location);
+
+    attribute.bind(*component, format.getSize());
+  }
+
+  return true;
+}
+
+void Context::unbindVertexArray()
+{
+  if (!currentVertexArray)
+    return;
+
+  glBindVertexArray(0);
+  currentVertexArray = 0;
+  dirtyBinding = true;
+
+  // The index buffer binding is part of vertex array state
+  if (currentIndexBuffer)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, currentIndexBuffer->bufferID);
+  else
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Context::deleteVertexArrays(const void* object)
+{
+  auto entry = vertexArrayCache.begin();
+
+  while (entry != vertexArrayCache.end())
+  {
+    const VertexArrayKey& key = entry->first;
+
+    if (key.program == object ||
+        key.vertexBuffer == object ||
+        key.indexBuffer == object)
+    {
+      if (entry->second == currentVertexArray)
+        unbindVertexArray();
+
+      glDeleteVertexArrays(1, &entry->second);
+      vertexArrayCache.erase(entry++);
+    }
+    else
+      entry++;
+  }
+}
+
+void Context::draw(PrimitiveType type,
+                   uint start,
+                   uint count,
+                   uint base,
+                   uint instanceCount)
+{
+  if (currentIndexBuffer)
+  {
+    const size_t size = IndexBuffer::getTypeSize(currentIndexBuffer->getType());
+
+    if (instanceCount == 1)
+    {
+      glDrawElementsBaseVertex(convertToGL(type),
+                               count,
+                               convertToGL(currentIndexBuffer->getType()),
+                               (GLvoid*) (size * start),
+                               base);
+    }
+    else
+    {
+      glDrawElementsInstancedBaseVertex(convertToGL(type),
+                                        count,
+                                        convertToGL(currentIndexBuffer->getType()),
+                                        (GLvoid*) (size * start),
+                                        instanceCount,
+                                        base);
+    }
+  }
+  else
+  {
+    if (instanceCount == 1)
+      glDrawArrays(convertToGL(type), start, count);
+    else
+      glDrawArraysInstanced(convertToGL(type), start, count, instanceCount);
+  }
+
+  if (stats)
+    stats->addPrimitives(type, count * instanceCount);
+}
+
+void Context::updateSharedUniformBlock(int ID, const void* data)
+{
+  auto block = blocks.begin();
+  while (block != blocks.end() && block->ID != ID)
+    block++;
+
+  if (block == blocks.end())
+  {
+    logError("Cannot update unknown shared uniform block %i", ID);
+    return;
+  }
+
+  const size_t size = (block->size + 15) & ~size_t(15);
+
+  if (!block->data.empty() && std::memcmp(&block->data[0], data, size) == 0)
+  {
+    if (stats)
+      stats->addSkippedUniformUpload();
+
+    return;
+  }
+
+  GLbitfield access = GL_MAP_WRITE_BIT |
+                      GL_MAP_INVALIDATE_RANGE_BIT |
+                      GL_MAP_UNSYNCHRONIZED_BIT;
+
+  if (block->bufferID)
+  {
+    glBindBuffer(GL_UNIFORM_BUFFER, block->bufferID);
+
+    // Orphan the storage once the ring wraps around, as earlier slots may
+    // still be in use by queued draws
+    if (block->offset + block->stride > block->stride * UNIFORM_BLOCK_SLOT_COUNT)
+    {
+      block->offset = 0;
+      access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    }
+  }
+  else
+  {
+    const size_t alignment = limits->uniformBufferOffsetAlignment;
+    block->stride = (size + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &block->bufferID);
+    glBindBuffer(GL_UNIFORM_BUFFER, block->bufferID);
+    glBufferData(GL_UNIFORM_BUFFER,
+                 block->stride * UNIFORM_BLOCK_SLOT_COUNT,
+                 NULL,
+                 GL_STREAM_DRAW);
+  }
+
+  void* target = glMapBufferRange(GL_UNIFORM_BUFFER, block->offset, size, access);
+  if (!target)
+  {
+    checkGL("Failed to map buffer of shared uniform block \'%s\'",
+            block->name.c_str());
+    return;
+  }
+
+  std::memcpy(target, data, size);
+  glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+  glBindBufferRange(GL_UNIFORM_BUFFER, block->ID, block->bufferID, block->offset, size);
+  block->offset += block->stride;
+
+  block->data.assign((const char*) data, (const char*) data + size);
+
+  if (stats)
+    stats->addUniformUpload();
+
+#if WENDY_DEBUG
+  checkGL("Failed to update shared uniform block \'%s\'", block->name.c_str());
+#endif
+}
+
+void Context::updateDeclaration()
+{
+  declaration.clear();
+
+  for (auto s = samplers.begin();  s != samplers.end();  s++)
+    declaration += format("uniform %s %s;\n", Sampler::getTypeName(s->type), s->name.c_str());
+
+  for (auto u = uniforms.begin();  u != uniforms.end();  u++)
+  {
+    if (u->blockID == INVALID_SHARED_STATE_ID)
+      declaration += format("uniform %s %s;\n", Uniform::getTypeName(u->type), u->name.c_str());
+  }
+
+  for (auto b = blocks.begin();  b != blocks.end();  b++)
+  {
+    if (!b->size)
+      continue;
+
+    declaration += format("layout(std140) uniform %s\n{\n", b->name.c_str());
+
+    for (auto u = uniforms.begin();  u != uniforms.end();  u++)
+    {
+      if (u->blockID == b->ID)
+        declaration += format("  %s %s;\n", Uniform::getTypeName(u->type), u->name.c_str());
+    }
+
+    declaration += "};\n";
+  }
+}
+
 void Context::applyState(const RenderState& newState)
 {
   if (stats)
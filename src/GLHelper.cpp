@@ -124,6 +124,18 @@ GLenum convertToGL(VertexComponent::Type type)
   {
     case VertexComponent::FLOAT32:
       return GL_FLOAT;
+    case VertexComponent::FLOAT16:
+      return GL_HALF_FLOAT;
+    case VertexComponent::SNORM8:
+      return GL_BYTE;
+    case VertexComponent::UNORM8:
+      return GL_UNSIGNED_BYTE;
+    case VertexComponent::SNORM16:
+      return GL_SHORT;
+    case VertexComponent::UNORM16:
+      return GL_UNSIGNED_SHORT;
+    case VertexComponent::INT_2_10_10_10_REV:
+      return GL_INT_2_10_10_10_REV;
   }
 
   panic("Invalid vertex component type %u", type);
@@ -68,7 +68,7 @@ void Preprocessor::parse(const char* name)
     throw Exception("Failed to find shader file");
   }
 
-  std::ifstream stream(path.asString().c_str());
+  ResourceStream stream(cache, path);
   if (stream.fail())
   {
     if (files.empty())
@@ -54,18 +54,49 @@ namespace wendy
 namespace
 {
 
-GLenum getElementType(AttributeType type)
+const uint32 PROGRAM_BINARY_MAGIC = 0x42505957;
+
+// Header of a cached program binary file
+struct ProgramBinaryHeader
 {
-  switch (type)
+  uint32 magic;
+  uint32 format;
+  uint64 key;
+  uint64 size;
+};
+
+const uint64 FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64 FNV_PRIME = 1099511628211ull;
+
+// 64-bit FNV-1a hash
+uint64 hashBytes(const void* data, size_t size, uint64 hash = FNV_OFFSET_BASIS)
+{
+  const uint8* bytes = (const uint8*) data;
+
+  for (size_t i = 0;  i < size;  i++)
   {
-    case ATTRIBUTE_FLOAT:
-    case ATTRIBUTE_VEC2:
-    case ATTRIBUTE_VEC3:
-    case ATTRIBUTE_VEC4:
-      return GL_FLOAT;
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
   }
 
-  panic("Invalid GLSL attribute type %u", type);
+  return hash;
+}
+
+// Identifies the driver that produced a program binary, so that binaries are
+// not even offered to a different driver or driver version
+uint64 hashDriver()
+{
+  uint64 hash = FNV_OFFSET_BASIS;
+
+  const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+  for (size_t i = 0;  i < sizeof(names) / sizeof(names[0]);  i++)
+  {
+    if (const char* string = (const char*) glGetString(names[i]))
+      hash = hashBytes(string, std::strlen(string), hash);
+  }
+
+  return hash;
 }
 
 bool isSupportedAttributeType(GLenum type)
@@ -258,7 +289,7 @@ Ref<Shader> Shader::read(Context& context,
     return NULL;
   }
 
-  std::ifstream stream(path.asString().c_str());
+  ResourceStream stream(cache, path);
   if (stream.fail())
   {
     logError("Failed to open shader file \'%s\'", path.asString().c_str());
@@ -282,7 +313,8 @@ Shader::Shader(const ResourceInfo& info,
   Resource(info),
   context(initContext),
   type(initType),
-  shaderID(0)
+  shaderID(0),
+  sourceHash(0)
 {
 }
 
@@ -300,24 +332,53 @@ bool Shader::init(const String& text)
     return false;
   }
 
-  String shader;
-
   if (spp.hasVersion())
   {
-    shader += "#version ";
-    shader += spp.getVersion();
-    shader += "\n";
+    source += "#version ";
+    source += spp.getVersion();
+    source += "\n";
   }
 
-  shader += "#line 0 0 /*shared program state*/\n";
-  shader += context.getSharedProgramStateDeclaration();
-  shader += spp.getOutput();
+  source += "#line 0 0 /*shared program state*/\n";
+  source += context.getSharedProgramStateDeclaration();
+  source += spp.getOutput();
+
+  nameList = spp.getNameList();
+
+  // The preprocessed source already contains the text of every included
+  // file, but their paths are hashed as well to tell apart identical sources
+  // with different origins
+  sourceHash = hashBytes(source.data(), source.length());
+
+  const PathList& paths = spp.getPaths();
+
+  for (auto p = paths.begin();  p != paths.end();  p++)
+  {
+    const String& path = p->asString();
+    sourceHash = hashBytes(path.data(), path.length(), sourceHash);
+  }
+
+  // Compilation is deferred to link time if the program may instead be
+  // loaded from the binary cache
+  if (context.getProgramCachePath().isEmpty() ||
+      !context.isProgramBinarySupported())
+  {
+    return compile();
+  }
+
+  return true;
+}
+
+bool Shader::compile()
+{
+  if (shaderID)
+    return true;
 
   GLsizei lengths[1];
   const GLchar* strings[1];
 
-  lengths[0] = shader.length();
-  strings[0] = (const GLchar*) shader.c_str();
+  lengths[0] = source.length();
+  strings[0] = (const GLchar*) source.c_str();
 
   shaderID = glCreateShader(convertToGL(type));
   glShaderSource(shaderID, 1, strings, lengths);
@@ -347,7 +408,7 @@ bool Shader::init(const String& text)
       {
         logWarning("Warning(s) compiling shader \'%s\':\n%s%s",
                    getName().c_str(),
-                   spp.getNameList().c_str(),
+                   nameList.c_str(),
                    infoLog.c_str());
       }
     }
@@ -359,7 +420,7 @@ bool Shader::init(const String& text)
       {
         logError("Failed to compile shader \'%s\':\n%s%s",
                  getName().c_str(),
-                 spp.getNameList().c_str(),
+                 nameList.c_str(),
                  infoLog.c_str());
       }
 
@@ -420,14 +481,28 @@ uint Attribute::getElementCount() const
   panic("Invalid GLSL attribute type %u", type);
 }
 
-void Attribute::bind(size_t stride, size_t offset)
+void Attribute::bind(const VertexComponent& component, size_t stride)
 {
+  const VertexComponent::Type componentType = component.getType();
+
+  // Packed components always hold four elements
+  GLint count = component.getElementCount();
+  if (componentType == VertexComponent::INT_2_10_10_10_REV)
+    count = 4;
+
+  GLboolean normalized = GL_TRUE;
+  if (componentType == VertexComponent::FLOAT32 ||
+      componentType == VertexComponent::FLOAT16)
+  {
+    normalized = GL_FALSE;
+  }
+
   glVertexAttribPointer(location,
-                        getElementCount(),
-                        getElementType(type),
-                        GL_FALSE,
+                        count,
+                        convertToGL(componentType),
+                        normalized,
                         stride,
-                        (const void*) offset);
+                        (const void*) component.getOffset());
 
 #if WENDY_DEBUG
   checkGL("Failed to set attribute \'%s\'", name.c_str());
@@ -453,9 +528,23 @@ const char* Attribute::getTypeName(AttributeType type)
 
 ///////////////////////////////////////////////////////////////////////
 
-void Sampler::bind(uint unit)
+void Sampler::bind(uint newUnit)
 {
-  glUniform1i(location, unit);
+  Stats* stats = context->getStats();
+
+  if (unit == (int) newUnit)
+  {
+    if (stats)
+      stats->addSkippedUniformUpload();
+
+    return;
+  }
+
+  glUniform1i(location, newUnit);
+  unit = newUnit;
+
+  if (stats)
+    stats->addUniformUpload();
 
 #if WENDY_DEBUG
   checkGL("Failed to set sampler \'%s\'", name.c_str());
@@ -510,6 +599,24 @@ const char* Sampler::getTypeName(SamplerType type)
 
 void Uniform::copyFrom(const void* data)
 {
+  Stats* stats = context->getStats();
+
+  const size_t size = getElementCount() * sizeof(float);
+
+  if (cached && std::memcmp(cache, data, size) == 0)
+  {
+    if (stats)
+      stats->addSkippedUniformUpload();
+
+    return;
+  }
+
+  std::memcpy(cache, data, size);
+  cached = true;
+
+  if (stats)
+    stats->addUniformUpload();
+
   switch (type)
   {
     case UNIFORM_FLOAT:
@@ -634,8 +741,32 @@ const char* Uniform::getTypeName(UniformType type)
 
 ///////////////////////////////////////////////////////////////////////
 
+void UniformBlock::copyFrom(const void* data)
+{
+  context->updateSharedUniformBlock(sharedID, data);
+}
+
+bool UniformBlock::operator == (const char* string) const
+{
+  return name == string;
+}
+
+const String& UniformBlock::getName() const
+{
+  return name;
+}
+
+int UniformBlock::getSharedID() const
+{
+  return sharedID;
+}
+
+///////////////////////////////////////////////////////////////////////
+
 Program::~Program()
 {
+  context.deleteVertexArrays(this);
+
   if (programID)
     glDeleteProgram(programID);
 
@@ -697,6 +828,24 @@ const Uniform* Program::findUniform(const char* name) const
   return &(*u);
 }
 
+UniformBlock* Program::findUniformBlock(const char* name)
+{
+  auto b = std::find(blocks.begin(), blocks.end(), name);
+  if (b == blocks.end())
+    return NULL;
+
+  return &(*b);
+}
+
+const UniformBlock* Program::findUniformBlock(const char* name) const
+{
+  auto b = std::find(blocks.begin(), blocks.end(), name);
+  if (b == blocks.end())
+    return NULL;
+
+  return &(*b);
+}
+
 uint Program::getAttributeCount() const
 {
   return attributes.size();
@@ -742,6 +891,26 @@ const Uniform& Program::getUniform(uint index) const
   return uniforms[index];
 }
 
+uint Program::getUniformBlockCount() const
+{
+  return blocks.size();
+}
+
+UniformBlock& Program::getUniformBlock(uint index)
+{
+  return blocks[index];
+}
+
+const UniformBlock& Program::getUniformBlock(uint index) const
+{
+  return blocks[index];
+}
+
+bool Program::hasInstanceAttribute() const
+{
+  return instanceLocation != -1;
+}
+
 Context& Program::getContext() const
 {
   return context;
@@ -795,7 +964,8 @@ Ref<Program> Program::read(Context& context,
 Program::Program(const ResourceInfo& info, Context& initContext):
   Resource(info),
   context(initContext),
-  programID(0)
+  programID(0),
+  instanceLocation(-1)
 {
   if (Stats* stats = context.getStats())
     stats->addProgram();
@@ -837,9 +1007,56 @@ bool Program::init(Shader& initVertexShader, Shader& initFragmentShader)
     return false;
   }
 
+  const Path& cachePath = context.getProgramCachePath();
+
+  if (!cachePath.isEmpty() && context.isProgramBinarySupported())
+  {
+    uint64 key = hashDriver();
+    key = hashBytes(&vertexShader->sourceHash, sizeof(uint64), key);
+    key = hashBytes(&fragmentShader->sourceHash, sizeof(uint64), key);
+
+    const Path path = cachePath + format("%016llx.bin", (unsigned long long) key);
+
+    if (!loadBinary(path, key))
+    {
+      if (!link())
+        return false;
+
+      saveBinary(path, key);
+    }
+  }
+  else
+  {
+    if (!link())
+      return false;
+  }
+
+  if (!checkGL("Failed to create object for program \'%s\'", getName().c_str()))
+    return false;
+
+  if (!retrieveUniforms())
+    return false;
+
+  if (!retrieveUniformBlocks())
+    return false;
+
+  if (!retrieveAttributes())
+    return false;
+
+  return true;
+}
+
+bool Program::link()
+{
+  if (!vertexShader->compile() || !fragmentShader->compile())
+    return false;
+
   glAttachShader(programID, vertexShader->shaderID);
   glAttachShader(programID, fragmentShader->shaderID);
 
+  if (context.isProgramBinarySupported())
+    glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
   glLinkProgram(programID);
 
   const String infoLog = getInfoLog();
@@ -862,18 +1079,95 @@ bool Program::init(Shader& initVertexShader, Shader& initFragmentShader)
                infoLog.c_str());
   }
 
-  if (!checkGL("Failed to create object for program \'%s\'", getName().c_str()))
+  return true;
+}
+
+bool Program::loadBinary(const Path& path, uint64 key)
+{
+  std::ifstream stream(path.asString().c_str(), std::ios::in | std::ios::binary);
+  if (stream.fail())
     return false;
 
-  if (!retrieveUniforms())
+  ProgramBinaryHeader header;
+
+  if (!stream.read((char*) &header, sizeof(header)))
     return false;
 
-  if (!retrieveAttributes())
+  if (header.magic != PROGRAM_BINARY_MAGIC || header.key != key)
     return false;
 
+  // Reject corrupt sizes before allocating anything for them
+  const std::streamoff offset = stream.tellg();
+  stream.seekg(0, std::ios::end);
+  const std::streamoff remaining = stream.tellg() - offset;
+  stream.seekg(offset, std::ios::beg);
+
+  if (header.size == 0 || remaining < 0 || header.size > uint64(remaining))
+  {
+    logWarning("Cached binary for program \'%s\' is corrupt",
+               getName().c_str());
+    return false;
+  }
+
+  std::vector<char> binary(header.size);
+
+  if (!stream.read(&binary[0], binary.size()))
+    return false;
+
+  glProgramBinary(programID, header.format, &binary[0], binary.size());
+
+  int status;
+  glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+  if (!status)
+  {
+    // The driver rejected the binary, most likely after an update it didn't
+    // tell us about, so fall back to compiling from source
+    log("Cached binary for program \'%s\' was rejected",
+        getName().c_str());
+
+    // Clear any error from the failed load
+    glGetError();
+    return false;
+  }
+
   return true;
 }
 
+void Program::saveBinary(const Path& path, uint64 key)
+{
+  GLint size;
+  glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return;
+
+  std::vector<char> binary(size);
+
+  ProgramBinaryHeader header;
+  header.magic = PROGRAM_BINARY_MAGIC;
+  header.key = key;
+  header.size = size;
+
+  glGetProgramBinary(programID, size, NULL, &header.format, &binary[0]);
+
+  if (!checkGL("Failed to retrieve binary for program \'%s\'",
+               getName().c_str()))
+  {
+    return;
+  }
+
+  std::ofstream stream(path.asString().c_str(), std::ios::out | std::ios::binary);
+  if (stream.fail())
+  {
+    logWarning("Failed to create program binary cache file \'%s\'",
+               path.asString().c_str());
+    return;
+  }
+
+  stream.write((const char*) &header, sizeof(header));
+  stream.write(&binary[0], binary.size());
+}
+
 bool Program::retrieveUniforms()
 {
   GLint uniformCount;
@@ -908,22 +1202,31 @@ bool Program::retrieveUniforms()
       continue;
     }
 
+    // Members of uniform blocks have no location of their own
+    const int location = glGetUniformLocation(programID, uniformName);
+    if (location == -1)
+      continue;
+
     if (isSupportedUniformType(uniformType))
     {
       uniforms.push_back(Uniform());
       Uniform& uniform = uniforms.back();
+      uniform.context = &context;
+      uniform.cached = false;
       uniform.name = uniformName;
       uniform.type = convertUniformType(uniformType);
-      uniform.location = glGetUniformLocation(programID, uniformName);
+      uniform.location = location;
       uniform.sharedID = context.getSharedUniformID(uniform.name.c_str(), uniform.type);
     }
     else if (isSupportedSamplerType(uniformType))
     {
       samplers.push_back(Sampler());
       Sampler& sampler = samplers.back();
+      sampler.context = &context;
+      sampler.unit = -1;
       sampler.name = uniformName;
       sampler.type = convertSamplerType(uniformType);
-      sampler.location = glGetUniformLocation(programID, uniformName);
+      sampler.location = location;
       sampler.sharedID = context.getSharedSamplerID(sampler.name.c_str(), sampler.type);
     }
     else
@@ -941,6 +1244,56 @@ bool Program::retrieveUniforms()
   return true;
 }
 
+bool Program::retrieveUniformBlocks()
+{
+  if (!context.isUniformBufferSupported())
+    return true;
+
+  GLint blockCount;
+  glGetProgramiv(programID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+
+  blocks.reserve(blockCount);
+
+  GLint maxNameLength;
+  glGetProgramiv(programID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
+
+  char* blockName = new char [maxNameLength + 1];
+
+  for (int i = 0;  i < blockCount;  i++)
+  {
+    glGetActiveUniformBlockName(programID, i, maxNameLength + 1, NULL, blockName);
+
+    const int sharedID = context.getSharedUniformBlockID(blockName);
+    if (sharedID == INVALID_SHARED_STATE_ID)
+    {
+      logError("Program \'%s\' uses non-shared uniform block \'%s\'",
+               getName().c_str(),
+               blockName);
+      delete [] blockName;
+      return false;
+    }
+
+    // The shared ID of a uniform block is also its buffer binding point
+    glUniformBlockBinding(programID, i, sharedID);
+
+    blocks.push_back(UniformBlock());
+    UniformBlock& block = blocks.back();
+    block.context = &context;
+    block.name = blockName;
+    block.sharedID = sharedID;
+  }
+
+  delete [] blockName;
+
+  if (!checkGL("Failed to retrieve uniform blocks for program \'%s\'",
+               getName().c_str()))
+  {
+    return false;
+  }
+
+  return true;
+}
+
 bool Program::retrieveAttributes()
 {
   GLint attributeCount;
@@ -967,6 +1320,13 @@ bool Program::retrieveAttributes()
                       &attributeType,
                       attributeName);
 
+    if (attributeType == GL_FLOAT_MAT4 &&
+        std::strcmp(attributeName, INSTANCE_MATRIX_ATTRIBUTE) == 0)
+    {
+      instanceLocation = glGetAttribLocation(programID, attributeName);
+      continue;
+    }
+
     if (!isSupportedAttributeType(attributeType))
     {
       logWarning("Skipping attribute \'%s\' of unsupported type", attributeName);
@@ -1202,9 +1562,6 @@ bool ProgramInterface::matches(const VertexFormat& format, bool verbose) const
     if (!component)
       return false;
 
-    if (component->getType() != VertexComponent::FLOAT32)
-      return false;
-
     if ((component->getElementCount() == 1 && a->second != ATTRIBUTE_FLOAT) ||
         (component->getElementCount() == 2 && a->second != ATTRIBUTE_VEC2) ||
         (component->getElementCount() == 3 && a->second != ATTRIBUTE_VEC3) ||
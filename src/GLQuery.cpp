@@ -156,6 +156,64 @@ bool OcclusionQuery::init()
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////
+
+Fence::~Fence()
+{
+  if (syncObject)
+    glDeleteSync((GLsync) syncObject);
+}
+
+bool Fence::isSignaled() const
+{
+  const GLenum result = glClientWaitSync((GLsync) syncObject, 0, 0);
+  return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+bool Fence::wait() const
+{
+  for (;;)
+  {
+    const GLenum result = glClientWaitSync((GLsync) syncObject,
+                                           GL_SYNC_FLUSH_COMMANDS_BIT,
+                                           1000000000);
+
+    if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+      return true;
+
+    if (result == GL_WAIT_FAILED)
+    {
+      checkGL("OpenGL error during fence wait");
+      return false;
+    }
+  }
+}
+
+Fence* Fence::create(Context& context)
+{
+  Ptr<Fence> fence(new Fence(context));
+  if (!fence->init())
+    return NULL;
+
+  return fence.detachObject();
+}
+
+Fence::Fence(Context& initContext):
+  context(initContext),
+  syncObject(NULL)
+{
+}
+
+bool Fence::init()
+{
+  syncObject = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  if (!checkGL("OpenGL error during creation of fence object"))
+    return false;
+
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////
 
   } /*namespace GL*/
@@ -131,7 +131,7 @@ void writeWarningPNG(png_structp context, png_const_charp warning)
 
 void readStreamPNG(png_structp context, png_bytep data, png_size_t length)
 {
-  std::ifstream* stream = reinterpret_cast<std::ifstream*>(png_get_io_ptr(context));
+  std::istream* stream = reinterpret_cast<std::istream*>(png_get_io_ptr(context));
   stream->read((char*) data, length);
 }
 
@@ -449,7 +449,7 @@ ImageReader::ImageReader(ResourceCache& cache):
 
 Ref<Image> ImageReader::read(const String& name, const Path& path)
 {
-  std::ifstream stream(path.asString().c_str(), std::ios::in | std::ios::binary);
+  ResourceStream stream(cache, path);
   if (stream.fail())
   {
     logError("Failed to open image file \'%s\'", path.asString().c_str());
@@ -490,7 +490,7 @@ Ref<Image> ImageReader::read(const String& name, const Path& path)
       return NULL;
     }
 
-    png_set_read_fn(context, &stream, readStreamPNG);
+    png_set_read_fn(context, static_cast<std::istream*>(&stream), readStreamPNG);
 
     pngInfo = png_create_info_struct(context);
     if (!pngInfo)
@@ -0,0 +1,329 @@
+///////////////////////////////////////////////////////////////////////
+// Wendy core library
+// Copyright (c) 2013 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any
+// damages arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any
+// purpose, including commercial applications, and to alter it and
+// redistribute it freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you
+//     must not claim that you wrote the original software. If you use
+//     this software in a product, an acknowledgment in the product
+//     documentation would be appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and
+//     must not be misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source
+//     distribution.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <wendy/Config.h>
+
+#include <wendy/Core.h>
+#include <wendy/Timer.h>
+#include <wendy/Profile.h>
+#include <wendy/Job.h>
+
+#include <algorithm>
+#include <chrono>
+
+///////////////////////////////////////////////////////////////////////
+
+namespace wendy
+{
+
+///////////////////////////////////////////////////////////////////////
+
+/*! @internal
+ */
+class JobSystem::Worker
+{
+public:
+  std::deque<JobRef> jobs;
+  std::mutex mutex;
+  std::thread::id thread;
+};
+
+///////////////////////////////////////////////////////////////////////
+
+bool Job::isFinished() const
+{
+  return pending == 0;
+}
+
+Job::Job(const JobFunction& initFunction, const JobRef& initParent):
+  function(initFunction),
+  parent(initParent),
+  pending(1)
+{
+}
+
+Job::Job(const Job& source)
+{
+  panic("Jobs may not be copied");
+}
+
+Job& Job::operator = (const Job& source)
+{
+  panic("Jobs may not be assigned");
+}
+
+///////////////////////////////////////////////////////////////////////
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  condition.notify_all();
+
+  for (auto t = threads.begin();  t != threads.end();  t++)
+    t->join();
+
+  for (auto w = workers.begin();  w != workers.end();  w++)
+    delete *w;
+}
+
+JobRef JobSystem::createJob(const JobFunction& function)
+{
+  return JobRef(new Job(function, JobRef()));
+}
+
+JobRef JobSystem::createJob(const JobRef& parent, const JobFunction& function)
+{
+  assert(!parent->isFinished());
+
+  parent->pending++;
+  return JobRef(new Job(function, parent));
+}
+
+void JobSystem::run(const JobRef& job)
+{
+  Worker& worker = *workers[getCurrentWorker()];
+
+  // The count may briefly be too high, but never too low
+  queuedCount++;
+
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(job);
+  }
+
+  // Sleeping workers announce themselves before checking the queued count, so
+  // either they see this job or it sees them
+  if (sleepingCount)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    condition.notify_one();
+  }
+}
+
+void JobSystem::wait(const Job& job)
+{
+  const uint worker = getCurrentWorker();
+
+  while (!job.isFinished())
+  {
+    if (!execute(worker))
+      std::this_thread::yield();
+  }
+}
+
+void JobSystem::parallelFor(size_t count,
+                            size_t grainSize,
+                            const RangeFunction& function)
+{
+  if (!count)
+    return;
+
+  if (!grainSize)
+  {
+    // Several ranges per worker lets stealing even out uneven ranges
+    grainSize = std::max(count / (workers.size() * 4), size_t(1));
+  }
+
+  if (count <= grainSize)
+  {
+    function(0, count);
+    return;
+  }
+
+  JobRef root = createJob(JobFunction());
+
+  for (size_t first = 0;  first < count;  first += grainSize)
+  {
+    const size_t last = std::min(first + grainSize, count);
+    run(createJob(root, [&function, first, last]() { function(first, last); }));
+  }
+
+  run(root);
+  wait(*root);
+}
+
+uint JobSystem::getWorkerCount() const
+{
+  return uint(workers.size());
+}
+
+uint JobSystem::getCurrentWorker() const
+{
+  const std::thread::id thread = std::this_thread::get_id();
+
+  for (size_t i = 1;  i < workers.size();  i++)
+  {
+    if (workers[i]->thread == thread)
+      return uint(i);
+  }
+
+  return 0;
+}
+
+Ref<JobSystem> JobSystem::create(uint threadCount)
+{
+  Ref<JobSystem> system(new JobSystem());
+  if (!system->init(threadCount))
+    return NULL;
+
+  return system;
+}
+
+JobSystem::JobSystem():
+  queuedCount(0),
+  sleepingCount(0),
+  stopping(false)
+{
+}
+
+JobSystem::JobSystem(const JobSystem& source)
+{
+  panic("Job systems may not be copied");
+}
+
+JobSystem& JobSystem::operator = (const JobSystem& source)
+{
+  panic("Job systems may not be assigned");
+}
+
+bool JobSystem::init(uint threadCount)
+{
+  if (!threadCount)
+  {
+    const uint hardwareCount = std::thread::hardware_concurrency();
+    if (hardwareCount > 1)
+      threadCount = hardwareCount - 1;
+    else
+      threadCount = 1;
+  }
+
+  // The first worker is shared by all threads that aren't worker threads
+  for (uint i = 0;  i <= threadCount;  i++)
+    workers.push_back(new Worker());
+
+  // Worker threads must not look up their index before all are registered
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (uint i = 1;  i <= threadCount;  i++)
+  {
+    threads.push_back(std::thread(&JobSystem::work, this, i));
+    workers[i]->thread = threads.back().get_id();
+  }
+
+  return true;
+}
+
+bool JobSystem::execute(uint index)
+{
+  JobRef job;
+
+  {
+    Worker& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+
+    if (!worker.jobs.empty())
+    {
+      job = worker.jobs.back();
+      worker.jobs.pop_back();
+    }
+  }
+
+  for (size_t i = 1;  !job && i < workers.size();  i++)
+  {
+    Worker& victim = *workers[(index + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.jobs.empty())
+    {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+    }
+  }
+
+  if (!job)
+    return false;
+
+  queuedCount--;
+
+  // The monotonic clock is cheap and safe to read from any thread, unlike
+  // Timer::getCurrentTime
+  const auto start = std::chrono::steady_clock::now();
+
+  if (job->function)
+  {
+    job->function();
+    job->function = JobFunction();
+  }
+
+  const std::chrono::duration<Time> elapsed = std::chrono::steady_clock::now() - start;
+  Profile::addWorkerTime(index, elapsed.count());
+
+  finish(*job);
+  return true;
+}
+
+void JobSystem::finish(Job& job)
+{
+  if (--job.pending)
+    return;
+
+  if (JobRef parent = job.parent)
+  {
+    job.parent.reset();
+    finish(*parent);
+  }
+}
+
+void JobSystem::work(uint index)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+  }
+
+  while (!stopping)
+  {
+    if (execute(index))
+      continue;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    sleepingCount++;
+
+    while (!queuedCount && !stopping)
+      condition.wait(lock);
+
+    sleepingCount--;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+} /*namespace wendy*/
+
+///////////////////////////////////////////////////////////////////////
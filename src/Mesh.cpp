@@ -33,7 +33,10 @@
 #include <wendy/Mesh.h>
 
 #include <limits>
+#include <algorithm>
 #include <cstdlib>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <cctype>
 
@@ -50,6 +53,287 @@ namespace wendy
 namespace
 {
 
+const uint32 BINARY_MESH_MAGIC = 0x48534d57;
+const uint32 BINARY_MESH_VERSION = 2;
+
+// Header of a binary mesh file.  It is followed by the vertex array and then
+// by each section, which is a BinaryMeshSection header, the material name,
+// the index count of each detail level, the indices and then the indices of
+// each detail level, with the name and each index array padded to four bytes.
+struct BinaryMeshHeader
+{
+  uint32 magic;
+  uint32 version;
+  uint32 vertexCount;
+  uint32 sectionCount;
+  uint32 indexSize;
+  uint32 reserved;
+  float minimum[3];
+  float maximum[3];
+  float center[3];
+  float radius;
+};
+
+struct BinaryMeshSection
+{
+  uint32 nameLength;
+  uint32 indexCount;
+  uint32 levelCount;
+  uint32 reserved;
+};
+
+size_t padToWord(size_t size)
+{
+  return (size + 3) & ~size_t(3);
+}
+
+template <typename T>
+void writeIndices(std::ostream& stream, const std::vector<MeshTriangle>& triangles)
+{
+  for (auto t = triangles.begin();  t != triangles.end();  t++)
+  {
+    for (size_t i = 0;  i < 3;  i++)
+    {
+      const T index = T(t->indices[i]);
+      stream.write((const char*) &index, sizeof(T));
+    }
+  }
+}
+
+void readIndices(std::vector<MeshTriangle>& triangles,
+                 const void* indices,
+                 size_t count,
+                 size_t indexSize)
+{
+  triangles.resize(count / 3);
+
+  for (size_t i = 0;  i < triangles.size() * 3;  i++)
+  {
+    uint32 index;
+
+    if (indexSize == 1)
+      index = ((const uint8*) indices)[i];
+    else if (indexSize == 2)
+      index = ((const uint16*) indices)[i];
+    else
+      index = ((const uint32*) indices)[i];
+
+    triangles[i / 3].indices[i % 3] = index;
+  }
+}
+
+template <typename T>
+bool checkIndices(const void* indices, size_t count, size_t vertexCount)
+{
+  const T* values = (const T*) indices;
+
+  for (size_t i = 0;  i < count;  i++)
+  {
+    if (values[i] >= vertexCount)
+      return false;
+  }
+
+  return true;
+}
+
+// Returns whether all the specified indices refer to existing vertices
+bool checkIndices(const void* indices,
+                  size_t count,
+                  size_t indexSize,
+                  size_t vertexCount)
+{
+  if (indexSize == 1)
+    return checkIndices<uint8>(indices, count, vertexCount);
+  else if (indexSize == 2)
+    return checkIndices<uint16>(indices, count, vertexCount);
+  else
+    return checkIndices<uint32>(indices, count, vertexCount);
+}
+
+// Attribute values closer than this in every component are considered equal
+const float WELD_EPSILON = 0.001f;
+
+// Hashes points into cells much larger than the weld epsilon, so that only
+// points lying within the epsilon of a cell boundary need to probe the
+// neighbouring cells.  The odd size and the half cell offset keep common
+// values like 0, 0.5 and 1 away from cell boundaries.
+const float WELD_CELL_SIZE = 17.3f * WELD_EPSILON;
+
+template <size_t N>
+class ProximityMap
+{
+public:
+  ProximityMap();
+  void insert(uint32 group, const float* values, uint32 item);
+  void findCandidates(uint32 group,
+                      const float* values,
+                      std::vector<uint32>& result) const;
+private:
+  struct Key
+  {
+    bool operator == (const Key& other) const;
+    size_t hash() const;
+    uint32 group;
+    int32 cells[N];
+  };
+  struct Entry
+  {
+    Key key;
+    uint32 item;
+  };
+  static int32 quantize(float value);
+  void grow();
+  static const uint32 NO_ITEM = 0xffffffff;
+  std::vector<Entry> entries;
+  size_t count;
+};
+
+template <size_t N>
+ProximityMap<N>::ProximityMap():
+  count(0)
+{
+}
+
+template <size_t N>
+void ProximityMap<N>::insert(uint32 group, const float* values, uint32 item)
+{
+  if ((count + 1) * 2 > entries.size())
+    grow();
+
+  Entry entry;
+  entry.key.group = group;
+  entry.item = item;
+
+  for (size_t i = 0;  i < N;  i++)
+    entry.key.cells[i] = quantize(values[i]);
+
+  const size_t mask = entries.size() - 1;
+  size_t slot = entry.key.hash() & mask;
+
+  while (entries[slot].item != NO_ITEM)
+    slot = (slot + 1) & mask;
+
+  entries[slot] = entry;
+  count++;
+}
+
+template <size_t N>
+void ProximityMap<N>::findCandidates(uint32 group,
+                                     const float* values,
+                                     std::vector<uint32>& result) const
+{
+  result.clear();
+
+  if (!count)
+    return;
+
+  Key base;
+  base.group = group;
+
+  int32 offsets[N];
+  uint32 mask = 0;
+
+  for (size_t i = 0;  i < N;  i++)
+  {
+    base.cells[i] = quantize(values[i]);
+    offsets[i] = 0;
+
+    const float low = (base.cells[i] - 0.5f) * WELD_CELL_SIZE;
+
+    if (values[i] - low <= WELD_EPSILON)
+      offsets[i] = -1;
+    else if (low + WELD_CELL_SIZE - values[i] <= WELD_EPSILON)
+      offsets[i] = 1;
+
+    if (offsets[i])
+      mask |= 1 << i;
+  }
+
+  const size_t slotMask = entries.size() - 1;
+
+  for (uint32 probe = 0;  probe < (1u << N);  probe++)
+  {
+    if (probe & ~mask)
+      continue;
+
+    Key key = base;
+
+    for (size_t i = 0;  i < N;  i++)
+    {
+      if (probe & (1 << i))
+        key.cells[i] += offsets[i];
+    }
+
+    for (size_t slot = key.hash() & slotMask;
+         entries[slot].item != NO_ITEM;
+         slot = (slot + 1) & slotMask)
+    {
+      if (entries[slot].key == key)
+        result.push_back(entries[slot].item);
+    }
+  }
+}
+
+template <size_t N>
+int32 ProximityMap<N>::quantize(float value)
+{
+  const float cell = std::floor(value / WELD_CELL_SIZE + 0.5f);
+
+  // Non-finite and huge values all share a cell and rely on the exact test
+  if (!(std::abs(cell) < 1e9f))
+    return 0;
+
+  return int32(cell);
+}
+
+template <size_t N>
+void ProximityMap<N>::grow()
+{
+  std::vector<Entry> old;
+  old.swap(entries);
+
+  Entry empty;
+  empty.item = NO_ITEM;
+  entries.resize(std::max(size_t(64), old.size() * 2), empty);
+
+  const size_t mask = entries.size() - 1;
+
+  for (auto e = old.begin();  e != old.end();  e++)
+  {
+    if (e->item == NO_ITEM)
+      continue;
+
+    size_t slot = e->key.hash() & mask;
+
+    while (entries[slot].item != NO_ITEM)
+      slot = (slot + 1) & mask;
+
+    entries[slot] = *e;
+  }
+}
+
+template <size_t N>
+bool ProximityMap<N>::Key::operator == (const Key& other) const
+{
+  return group == other.group &&
+         std::memcmp(cells, other.cells, sizeof(cells)) == 0;
+}
+
+template <size_t N>
+size_t ProximityMap<N>::Key::hash() const
+{
+  uint64 hash = group;
+
+  for (size_t i = 0;  i < N;  i++)
+    hash = (hash ^ uint32(cells[i])) * 0x100000001b3ull;
+
+  return size_t(hash ^ (hash >> 29));
+}
+
+// Vertices with at most this many attribute layers have them scanned
+// directly, while the layers of busier vertices are found through hashing
+const uint32 MAX_SCANNED_LAYERS = 8;
+
 class VertexTool
 {
 public:
@@ -71,15 +355,24 @@ private:
   {
     vec3 normal;
     vec2 texcoord;
+    uint32 vertex;
     uint32 index;
+    uint32 next;
   };
   struct Vertex
   {
     vec3 position;
-    std::vector<VertexLayer> layers;
+    uint32 firstLayer;
+    uint32 layerCount;
   };
-  typedef std::vector<Vertex> VertexList;
-  VertexList vertices;
+  void findCandidates(uint32 vertexIndex, const float* attributes, bool texcoords);
+  void indexLayer(uint32 layerIndex);
+  static const uint32 NO_LAYER = 0xffffffff;
+  std::vector<Vertex> vertices;
+  std::vector<VertexLayer> layers;
+  ProximityMap<5> attributeMap;
+  ProximityMap<2> texcoordMap;
+  std::vector<uint32> candidates;
   uint32 targetCount;
   NormalMode mode;
 };
@@ -100,93 +393,116 @@ VertexTool::VertexTool(const Mesh::VertexList& initVertices):
 void VertexTool::importPositions(const Mesh::VertexList& initVertices)
 {
   vertices.resize(initVertices.size());
+
   for (size_t i = 0;  i < vertices.size();  i++)
+  {
     vertices[i].position = initVertices[i].position;
+    vertices[i].firstLayer = NO_LAYER;
+    vertices[i].layerCount = 0;
+  }
 }
 
 uint32 VertexTool::addAttributeLayer(uint32 vertexIndex,
                                      const vec3& normal,
                                      const vec2& texcoord)
 {
-  Vertex& vertex = vertices[vertexIndex];
+  const float attributes[] = { normal.x, normal.y, normal.z, texcoord.x, texcoord.y };
 
-  if (mode == PRESERVE_NORMALS)
+  // Layers are numbered in creation order, so picking the lowest or highest
+  // matching number reproduces a front-to-back scan of the vertex's layers
+  uint32 match = NO_LAYER;
+
+  findCandidates(vertexIndex, attributes, false);
+
+  for (auto c = candidates.begin();  c != candidates.end();  c++)
   {
-    for (auto l = vertex.layers.begin();  l != vertex.layers.end();  l++)
+    const VertexLayer& layer = layers[*c];
+
+    if (*c < match &&
+        all(equalEpsilon(layer.normal, normal, WELD_EPSILON)) &&
+        all(equalEpsilon(layer.texcoord, texcoord, WELD_EPSILON)))
     {
-      if (all(equalEpsilon(l->normal, normal, 0.001f)) &&
-          all(equalEpsilon(l->texcoord, texcoord, 0.001f)))
-      {
-        return l->index;
-      }
+      match = *c;
     }
+  }
 
-    vertex.layers.push_back(VertexLayer());
-    VertexLayer& layer = vertex.layers.back();
+  if (match != NO_LAYER)
+    return layers[match].index;
 
-    layer.normal = normal;
-    layer.texcoord = texcoord;
-    layer.index = targetCount++;
+  Vertex& vertex = vertices[vertexIndex];
 
-    return layer.index;
-  }
+  VertexLayer layer;
+  layer.normal = normal;
+  layer.texcoord = texcoord;
+  layer.vertex = vertexIndex;
+  layer.next = vertex.firstLayer;
+
+  if (mode == PRESERVE_NORMALS)
+    layer.index = targetCount++;
   else
   {
-    size_t index;
-    bool discontinuous = true;
+    // Layers sharing a texture coordinate share a vertex and have their
+    // normals merged, so only texture coordinate seams split vertices
+    findCandidates(vertexIndex, attributes, true);
 
-    for (auto l = vertex.layers.begin();  l != vertex.layers.end();  l++)
+    for (auto c = candidates.begin();  c != candidates.end();  c++)
     {
-      if (all(equalEpsilon(l->texcoord, texcoord, 0.001f)))
+      if ((match == NO_LAYER || *c > match) &&
+          all(equalEpsilon(layers[*c].texcoord, texcoord, WELD_EPSILON)))
       {
-        if (all(equalEpsilon(l->normal, normal, 0.001f)))
-          return l->index;
-
-        discontinuous = false;
-        index = l->index;
+        match = *c;
       }
     }
 
-    if (discontinuous)
-      index = targetCount++;
+    if (match == NO_LAYER)
+      layer.index = targetCount++;
+    else
+      layer.index = layers[match].index;
+  }
 
-    vertex.layers.push_back(VertexLayer());
-    VertexLayer& layer = vertex.layers.back();
+  const uint32 layerIndex = uint32(layers.size());
+  layers.push_back(layer);
 
-    layer.normal = normal;
-    layer.texcoord = texcoord;
-    layer.index = index;
+  vertex.firstLayer = layerIndex;
+  vertex.layerCount++;
 
-    return index;
+  if (vertex.layerCount == MAX_SCANNED_LAYERS + 1)
+  {
+    for (uint32 l = layerIndex;  l != NO_LAYER;  l = layers[l].next)
+      indexLayer(l);
   }
+  else if (vertex.layerCount > MAX_SCANNED_LAYERS + 1)
+    indexLayer(layerIndex);
+
+  return layer.index;
 }
 
 void VertexTool::realizeVertices(Mesh::VertexList& result) const
 {
-  result.resize(targetCount);
+  std::vector<vec3> normals;
 
-  for (auto v = vertices.begin();  v != vertices.end();  v++)
+  if (mode == MERGE_NORMALS)
   {
-    vec3 normal;
+    normals.resize(vertices.size());
 
-    if (mode == MERGE_NORMALS)
-    {
-      for (auto l = v->layers.begin();  l != v->layers.end();  l++)
-        normal += l->normal;
+    for (auto l = layers.begin();  l != layers.end();  l++)
+      normals[l->vertex] += l->normal;
 
-      normal = normalize(normal);
-    }
+    for (auto n = normals.begin();  n != normals.end();  n++)
+      *n = normalize(*n);
+  }
 
-    for (auto l = v->layers.begin();  l != v->layers.end();  l++)
-    {
-      result[l->index].position = v->position;
-      result[l->index].texcoord = l->texcoord;
+  result.resize(targetCount);
 
-      if (mode == MERGE_NORMALS)
-        result[l->index].normal = normal;
-      else
-        result[l->index].normal = l->normal;
-    }
+  for (auto l = layers.begin();  l != layers.end();  l++)
+  {
+    result[l->index].position = vertices[l->vertex].position;
+    result[l->index].texcoord = l->texcoord;
+
+    if (mode == MERGE_NORMALS)
+      result[l->index].normal = normals[l->vertex];
+    else
+      result[l->index].normal = l->normal;
   }
 }
 
@@ -195,6 +511,44 @@ void VertexTool::setNormalMode(NormalMode newMode)
   mode = newMode;
 }
 
+void VertexTool::findCandidates(uint32 vertexIndex,
+                                const float* attributes,
+                                bool texcoords)
+{
+  const Vertex& vertex = vertices[vertexIndex];
+
+  if (vertex.layerCount > MAX_SCANNED_LAYERS)
+  {
+    if (texcoords)
+      texcoordMap.findCandidates(vertexIndex, attributes + 3, candidates);
+    else
+      attributeMap.findCandidates(vertexIndex, attributes, candidates);
+  }
+  else
+  {
+    candidates.clear();
+
+    for (uint32 l = vertex.firstLayer;  l != NO_LAYER;  l = layers[l].next)
+      candidates.push_back(l);
+  }
+}
+
+void VertexTool::indexLayer(uint32 layerIndex)
+{
+  const VertexLayer& layer = layers[layerIndex];
+
+  const float attributes[] =
+  {
+    layer.normal.x, layer.normal.y, layer.normal.z,
+    layer.texcoord.x, layer.texcoord.y
+  };
+
+  attributeMap.insert(layer.vertex, attributes, layerIndex);
+
+  if (mode == MERGE_NORMALS)
+    texcoordMap.insert(layer.vertex, attributes + 3, layerIndex);
+}
+
 struct Triplet
 {
   uint32 vertex;
@@ -215,36 +569,1253 @@ struct FaceGroup
   String name;
 };
 
-} /*namespace*/
+// Files are split into chunks of at least this size for parallel parsing
+const size_t OBJ_CHUNK_SIZE = 4 << 20;
 
-///////////////////////////////////////////////////////////////////////
+const size_t NO_GROUP = size_t(-1);
 
-void MeshTriangle::setIndices(uint32 a, uint32 b, uint32 c)
+const double POWERS_OF_TEN[] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+struct ObjSwitch
+{
+  size_t first;
+  String materialName;
+};
+
+struct ObjWarning
+{
+  String command;
+  uint line;
+};
+
+// The parsed contents of a range of whole lines of an OBJ file.  Since face
+// indices are absolute, chunks can be parsed independently and concatenated.
+// Faces before the first material switch belong to whatever material was
+// active at the end of the previous chunk.
+struct ObjChunk
+{
+  ObjChunk();
+  const char* start;
+  const char* end;
+  std::vector<vec3> positions;
+  std::vector<vec3> normals;
+  std::vector<vec2> texcoords;
+  FaceList faces;
+  std::vector<ObjSwitch> switches;
+  std::vector<ObjWarning> warnings;
+  uint lineCount;
+  uint orphanLine;
+  uint errorLine;
+  String error;
+};
+
+ObjChunk::ObjChunk():
+  start(NULL),
+  end(NULL),
+  lineCount(0),
+  orphanLine(0),
+  errorLine(0)
 {
-  indices[0] = a;
-  indices[1] = b;
-  indices[2] = c;
 }
 
-///////////////////////////////////////////////////////////////////////
+bool readContents(ResourceStream& stream,
+                  std::vector<char>& buffer,
+                  const char*& data,
+                  size_t& size)
+{
+  // Packed files are already mapped, so only loose files need to be read
+  data = stream.getData();
+  size = stream.getSize();
+  if (data)
+    return true;
+
+  stream.seekg(0, std::ios::end);
+  size = (size_t) stream.tellg();
+  stream.seekg(0, std::ios::beg);
+  if (stream.fail())
+    return false;
 
-Mesh::Mesh(const ResourceInfo& info):
-  Resource(info)
+  buffer.resize(size);
+  if (size && !stream.read(&buffer[0], size))
+    return false;
+
+  data = buffer.empty() ? "" : &buffer[0];
+  return true;
+}
+
+inline bool isBlank(char c)
 {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 }
 
-void Mesh::mergeSections(const char* materialName)
+inline bool isDigit(char c)
 {
-  sections[0].materialName = materialName;
+  return c >= '0' && c <= '9';
+}
+
+inline bool isNameChar(char c)
+{
+  return std::isalnum((unsigned char) c) || c == '_';
+}
+
+inline void skipBlanks(const char** text, const char* end)
+{
+  while (*text != end && isBlank(**text))
+    (*text)++;
+}
+
+bool matches(const char* start, const char* stop, const char* command)
+{
+  for (;  start != stop;  start++, command++)
+  {
+    if (*start != *command)
+      return false;
+  }
+
+  return *command == '\0';
+}
+
+const char* parseName(const char** text, const char* end)
+{
+  skipBlanks(text, end);
+
+  const char* start = *text;
+
+  while (*text != end && isNameChar(**text))
+    (*text)++;
+
+  if (*text == start)
+    throw Exception("Expected but missing name");
+
+  return start;
+}
+
+uint32 parseIndex(const char** text, const char* end)
+{
+  const char* c = *text;
+
+  if (c != end && *c == '-')
+    throw Exception("Relative indices are not supported");
+
+  uint32 result = 0;
+
+  while (c != end && isDigit(*c))
+    result = result * 10 + uint32(*c++ - '0');
+
+  if (c == *text)
+    throw Exception("Expected but missing integer value");
+
+  if (!result)
+    throw Exception("Invalid index zero");
+
+  *text = c;
+  return result;
+}
+
+// Handles the rare values the fast path doesn't, such as inf and nan
+float parseSpecialFloat(const char** text, const char* end)
+{
+  char token[64];
+  size_t length = 0;
+
+  for (const char* c = *text;  c != end && !isBlank(*c) && *c != '\n';  c++)
+  {
+    if (length == sizeof(token) - 1)
+      break;
+
+    token[length++] = *c;
+  }
+
+  token[length] = '\0';
+
+  char* stop;
+
+  const float result = float(std::strtod(token, &stop));
+  if (stop == token)
+    throw Exception("Expected but missing float value");
+
+  *text += stop - token;
+  return result;
+}
+
+float parseFloat(const char** text, const char* end)
+{
+  skipBlanks(text, end);
+
+  const char* c = *text;
+  bool negative = false;
+
+  if (c != end && (*c == '-' || *c == '+'))
+    negative = (*c++ == '-');
+
+  uint64 mantissa = 0;
+  int exponent = 0, digits = 0;
+  bool found = false;
+
+  for (;  c != end && isDigit(*c);  c++)
+  {
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + uint64(*c - '0');
+      if (mantissa)
+        digits++;
+    }
+    else
+      exponent++;
+
+    found = true;
+  }
+
+  if (c != end && *c == '.')
+  {
+    for (c++;  c != end && isDigit(*c);  c++)
+    {
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + uint64(*c - '0');
+        if (mantissa)
+          digits++;
+
+        exponent--;
+      }
+
+      found = true;
+    }
+  }
+
+  if (!found)
+    return parseSpecialFloat(text, end);
+
+  if (c != end && (*c == 'e' || *c == 'E'))
+  {
+    const char* e = c + 1;
+    bool negativeExponent = false;
+
+    if (e != end && (*e == '-' || *e == '+'))
+      negativeExponent = (*e++ == '-');
+
+    if (e != end && isDigit(*e))
+    {
+      int value = 0;
+
+      for (;  e != end && isDigit(*e);  e++)
+      {
+        if (value < 10000)
+          value = value * 10 + (*e - '0');
+      }
+
+      exponent += negativeExponent ? -value : value;
+      c = e;
+    }
+  }
+
+  *text = c;
+
+  double result = double(mantissa);
+
+  if (exponent < -22 || exponent > 22)
+    result *= std::pow(10.0, exponent);
+  else if (exponent < 0)
+    result /= POWERS_OF_TEN[-exponent];
+  else
+    result *= POWERS_OF_TEN[exponent];
+
+  return float(negative ? -result : result);
+}
+
+void parseObjLine(ObjChunk& chunk,
+                  const char* text,
+                  const char* end,
+                  std::vector<Triplet>& triplets)
+{
+  if (text == end || isBlank(*text) || *text == '#')
+    return;
+
+  const char* command = text;
+
+  while (text != end && isNameChar(*text))
+    text++;
+
+  if (text == command)
+    throw Exception("Expected but missing name");
+
+  if (matches(command, text, "v"))
+  {
+    vec3 vertex;
+
+    vertex.x = parseFloat(&text, end);
+    vertex.y = parseFloat(&text, end);
+    vertex.z = parseFloat(&text, end);
+    chunk.positions.push_back(vertex);
+  }
+  else if (matches(command, text, "vt"))
+  {
+    vec2 texcoord;
+
+    texcoord.x = parseFloat(&text, end);
+    texcoord.y = parseFloat(&text, end);
+    chunk.texcoords.push_back(texcoord);
+  }
+  else if (matches(command, text, "vn"))
+  {
+    vec3 normal;
+
+    normal.x = parseFloat(&text, end);
+    normal.y = parseFloat(&text, end);
+    normal.z = parseFloat(&text, end);
+    chunk.normals.push_back(normalize(normal));
+  }
+  else if (matches(command, text, "f"))
+  {
+    if (chunk.switches.empty() && !chunk.orphanLine)
+      chunk.orphanLine = chunk.lineCount;
+
+    triplets.clear();
+    skipBlanks(&text, end);
+
+    while (text != end)
+    {
+      Triplet triplet;
+
+      triplet.vertex = parseIndex(&text, end);
+      triplet.texcoord = 0;
+      triplet.normal = 0;
+
+      if (text != end && *text == '/')
+      {
+        if (++text != end && isDigit(*text))
+          triplet.texcoord = parseIndex(&text, end);
+
+        if (text != end && *text == '/')
+        {
+          if (++text != end && isDigit(*text))
+            triplet.normal = parseIndex(&text, end);
+        }
+      }
+
+      triplets.push_back(triplet);
+      skipBlanks(&text, end);
+    }
+
+    for (size_t i = 2;  i < triplets.size();  i++)
+    {
+      chunk.faces.push_back(Face());
+      Face& face = chunk.faces.back();
+
+      face.p[0] = triplets[0];
+      face.p[1] = triplets[i - 1];
+      face.p[2] = triplets[i];
+    }
+  }
+  else if (matches(command, text, "usemtl"))
+  {
+    const char* name = parseName(&text, end);
+
+    chunk.switches.push_back(ObjSwitch());
+    chunk.switches.back().first = chunk.faces.size();
+    chunk.switches.back().materialName.assign(name, text);
+  }
+  else if (matches(command, text, "g") ||
+           matches(command, text, "o") ||
+           matches(command, text, "s") ||
+           matches(command, text, "mtllib"))
+  {
+    // Silently ignore group and object names, smoothing and .mtl files
+  }
+  else
+  {
+    chunk.warnings.push_back(ObjWarning());
+    chunk.warnings.back().command.assign(command, text);
+    chunk.warnings.back().line = chunk.lineCount;
+  }
+}
+
+void parseObjChunk(ObjChunk& chunk)
+{
+  std::vector<Triplet> triplets;
+
+  const char* text = chunk.start;
+
+  while (text != chunk.end)
+  {
+    const char* stop = (const char*) std::memchr(text, '\n', chunk.end - text);
+    if (!stop)
+      stop = chunk.end;
+
+    chunk.lineCount++;
+
+    try
+    {
+      parseObjLine(chunk, text, stop, triplets);
+    }
+    catch (Exception& e)
+    {
+      chunk.error = e.what();
+      chunk.errorLine = chunk.lineCount;
+      return;
+    }
+
+    text = (stop == chunk.end) ? stop : stop + 1;
+  }
+}
+
+// Size of the modelled post-transform vertex cache
+const size_t VERTEX_CACHE_SIZE = 32;
+
+const uint32 NO_INDEX = 0xffffffff;
+
+// Vertex scoring from Tom Forsyth's linear-speed vertex cache optimisation
+float calculateVertexScore(int cachePosition, uint32 activeCount)
+{
+  if (!activeCount)
+    return -1.f;
+
+  float score = 0.f;
+
+  if (cachePosition >= 0)
+  {
+    // The three most recent vertices were used by the last triangle, so
+    // they get a fixed score to avoid rewarding immediate reuse too much
+    if (cachePosition < 3)
+      score = 0.75f;
+    else
+    {
+      const float scale = 1.f / (VERTEX_CACHE_SIZE - 3);
+      score = std::pow(1.f - (cachePosition - 3) * scale, 1.5f);
+    }
+  }
+
+  // Boost vertices with few remaining triangles to finish them off
+  return score + 2.f / std::sqrt(float(activeCount));
+}
+
+// Reorders the triangles of a section for post-transform vertex cache
+// locality, using Tom Forsyth's algorithm with an LRU cache model
+void optimizeTriangleOrder(std::vector<MeshTriangle>& triangles, size_t vertexCount)
+{
+  const size_t triangleCount = triangles.size();
+
+  std::vector<uint32> activeCounts(vertexCount, 0);
+  std::vector<uint32> offsets(vertexCount + 1, 0);
+
+  for (auto t = triangles.begin();  t != triangles.end();  t++)
+  {
+    for (size_t k = 0;  k < 3;  k++)
+      activeCounts[t->indices[k]]++;
+  }
+
+  for (size_t i = 0;  i < vertexCount;  i++)
+    offsets[i + 1] = offsets[i] + activeCounts[i];
+
+  std::vector<uint32> adjacency(triangleCount * 3);
+  std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+
+  for (size_t i = 0;  i < triangleCount;  i++)
+  {
+    for (size_t k = 0;  k < 3;  k++)
+      adjacency[fill[triangles[i].indices[k]]++] = uint32(i);
+  }
+
+  std::vector<int> cachePositions(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+
+  for (size_t i = 0;  i < vertexCount;  i++)
+    vertexScores[i] = calculateVertexScore(-1, activeCounts[i]);
+
+  std::vector<float> triangleScores(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+
+  for (size_t i = 0;  i < triangleCount;  i++)
+  {
+    const uint32* indices = triangles[i].indices;
+
+    triangleScores[i] = vertexScores[indices[0]] +
+                        vertexScores[indices[1]] +
+                        vertexScores[indices[2]];
+  }
+
+  std::vector<MeshTriangle> result;
+  result.reserve(triangleCount);
+
+  std::vector<uint32> cache, nextCache;
+  cache.reserve(VERTEX_CACHE_SIZE + 3);
+  nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+  uint32 best = NO_INDEX;
+  size_t cursor = 0;
+
+  while (result.size() < triangleCount)
+  {
+    // When the cache yields no candidate, continue with the next triangle
+    // in input order rather than searching for the best one
+    if (best == NO_INDEX)
+    {
+      while (emitted[cursor])
+        cursor++;
+
+      best = uint32(cursor);
+    }
+
+    const MeshTriangle& triangle = triangles[best];
+    result.push_back(triangle);
+    emitted[best] = true;
+
+    for (size_t k = 0;  k < 3;  k++)
+    {
+      const uint32 vertex = triangle.indices[k];
+      const uint32 start = offsets[vertex];
+      const uint32 end = start + activeCounts[vertex];
+
+      for (uint32 i = start;  i < end;  i++)
+      {
+        if (adjacency[i] == best)
+        {
+          adjacency[i] = adjacency[end - 1];
+          break;
+        }
+      }
+
+      activeCounts[vertex]--;
+    }
+
+    nextCache.assign(triangle.indices, triangle.indices + 3);
+
+    for (auto c = cache.begin();  c != cache.end();  c++)
+    {
+      if (*c != triangle.indices[0] &&
+          *c != triangle.indices[1] &&
+          *c != triangle.indices[2])
+      {
+        nextCache.push_back(*c);
+      }
+    }
+
+    cache.swap(nextCache);
+
+    for (size_t i = 0;  i < cache.size();  i++)
+    {
+      const uint32 vertex = cache[i];
+
+      if (i < VERTEX_CACHE_SIZE)
+        cachePositions[vertex] = int(i);
+      else
+        cachePositions[vertex] = -1;
+
+      vertexScores[vertex] = calculateVertexScore(cachePositions[vertex],
+                                                  activeCounts[vertex]);
+    }
+
+    best = NO_INDEX;
+    float bestScore = -1.f;
+
+    for (auto c = cache.begin();  c != cache.end();  c++)
+    {
+      const uint32 start = offsets[*c];
+      const uint32 end = start + activeCounts[*c];
+
+      for (uint32 i = start;  i < end;  i++)
+      {
+        const uint32 index = adjacency[i];
+        const uint32* indices = triangles[index].indices;
+
+        triangleScores[index] = vertexScores[indices[0]] +
+                                vertexScores[indices[1]] +
+                                vertexScores[indices[2]];
+
+        if (triangleScores[index] > bestScore)
+        {
+          best = index;
+          bestScore = triangleScores[index];
+        }
+      }
+    }
+
+    if (cache.size() > VERTEX_CACHE_SIZE)
+      cache.resize(VERTEX_CACHE_SIZE);
+  }
+
+  triangles.swap(result);
+}
+
+struct TriangleCluster
+{
+  TriangleCluster();
+  size_t start;
+  size_t count;
+  vec3 centroid;
+  vec3 normal;
+  float area;
+};
+
+TriangleCluster::TriangleCluster():
+  start(0),
+  count(0),
+  area(0.f)
+{
+}
+
+// Reorders clusters of triangles, split where the FIFO cache model misses
+// on all three vertices, so that outward facing clusters are drawn first
+// (after Sander et al, Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw)
+void optimizeClusterOrder(std::vector<MeshTriangle>& triangles,
+                          const Mesh::VertexList& vertices)
+{
+  if (triangles.empty())
+    return;
+
+  std::vector<TriangleCluster> clusters;
+  std::vector<size_t> timestamps(vertices.size(), 0);
+  size_t time = VERTEX_CACHE_SIZE + 1;
+
+  vec3 meshCentroid;
+
+  for (size_t i = 0;  i < triangles.size();  i++)
+  {
+    const uint32* indices = triangles[i].indices;
+    uint32 misses = 0;
+
+    for (size_t k = 0;  k < 3;  k++)
+    {
+      if (time - timestamps[indices[k]] > VERTEX_CACHE_SIZE)
+      {
+        timestamps[indices[k]] = time++;
+        misses++;
+      }
+    }
+
+    if (misses == 3 || clusters.empty())
+    {
+      clusters.push_back(TriangleCluster());
+      clusters.back().start = i;
+    }
+
+    const vec3& a = vertices[indices[0]].position;
+    const vec3& b = vertices[indices[1]].position;
+    const vec3& c = vertices[indices[2]].position;
+
+    const vec3 normal = cross(b - a, c - a);
+    const float area = length(normal);
+    const vec3 centroid = (a + b + c) / 3.f;
+
+    TriangleCluster& cluster = clusters.back();
+    cluster.count++;
+    cluster.centroid += centroid * area;
+    cluster.normal += normal;
+    cluster.area += area;
+
+    meshCentroid += centroid;
+  }
+
+  if (clusters.size() < 2)
+    return;
+
+  meshCentroid /= float(triangles.size());
+
+  std::vector<std::pair<float, size_t>> order;
+  order.reserve(clusters.size());
+
+  for (size_t i = 0;  i < clusters.size();  i++)
+  {
+    const TriangleCluster& cluster = clusters[i];
+    const float length = glm::length(cluster.normal);
+
+    float key = 0.f;
+
+    if (length > 0.f)
+    {
+      const vec3 centroid = cluster.centroid / cluster.area;
+      key = dot(centroid - meshCentroid, cluster.normal / length);
+    }
+
+    order.push_back(std::make_pair(-key, i));
+  }
+
+  std::stable_sort(order.begin(), order.end());
+
+  std::vector<MeshTriangle> result;
+  result.reserve(triangles.size());
+
+  for (auto o = order.begin();  o != order.end();  o++)
+  {
+    const TriangleCluster& cluster = clusters[o->second];
+
+    result.insert(result.end(),
+                  triangles.begin() + cluster.start,
+                  triangles.begin() + cluster.start + cluster.count);
+  }
+
+  triangles.swap(result);
+}
+
+// Symmetric 4x4 matrix accumulating squared distances to a set of planes
+struct Quadric
+{
+  Quadric();
+  void addPlane(const vec3& normal, float distance, float weight);
+  void add(const Quadric& other);
+  double evaluate(const vec3& point) const;
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+};
+
+Quadric::Quadric():
+  a2(0.0), ab(0.0), ac(0.0), ad(0.0),
+  b2(0.0), bc(0.0), bd(0.0),
+  c2(0.0), cd(0.0),
+  d2(0.0)
+{
+}
+
+void Quadric::addPlane(const vec3& normal, float distance, float weight)
+{
+  const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+
+  a2 += a * a * weight;
+  ab += a * b * weight;
+  ac += a * c * weight;
+  ad += a * d * weight;
+  b2 += b * b * weight;
+  bc += b * c * weight;
+  bd += b * d * weight;
+  c2 += c * c * weight;
+  cd += c * d * weight;
+  d2 += d * d * weight;
+}
+
+void Quadric::add(const Quadric& other)
+{
+  a2 += other.a2;
+  ab += other.ab;
+  ac += other.ac;
+  ad += other.ad;
+  b2 += other.b2;
+  bc += other.bc;
+  bd += other.bd;
+  c2 += other.c2;
+  cd += other.cd;
+  d2 += other.d2;
+}
+
+double Quadric::evaluate(const vec3& point) const
+{
+  const double x = point.x, y = point.y, z = point.z;
+
+  return a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+         b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+         c2 * z * z + 2.0 * cd * z +
+         d2;
+}
+
+struct Collapse
+{
+  bool operator < (const Collapse& other) const;
+  double cost;
+  uint32 source;
+  uint32 target;
+};
+
+bool Collapse::operator < (const Collapse& other) const
+{
+  return cost < other.cost;
+}
+
+// Returns true if moving the source vertex onto the target would flip any
+// of the remaining triangles around the source
+bool flipsTriangles(const std::vector<MeshTriangle>& triangles,
+                    const Mesh::VertexList& vertices,
+                    const uint32* adjacency,
+                    size_t adjacencyCount,
+                    uint32 source,
+                    uint32 target)
+{
+  for (size_t i = 0;  i < adjacencyCount;  i++)
+  {
+    const uint32* indices = triangles[adjacency[i]].indices;
+
+    if (indices[0] == target || indices[1] == target || indices[2] == target)
+      continue;
+
+    vec3 before[3], after[3];
+
+    for (size_t k = 0;  k < 3;  k++)
+    {
+      before[k] = vertices[indices[k]].position;
+
+      if (indices[k] == source)
+        after[k] = vertices[target].position;
+      else
+        after[k] = before[k];
+    }
+
+    const vec3 normalBefore = cross(before[1] - before[0], before[2] - before[0]);
+    const vec3 normalAfter = cross(after[1] - after[0], after[2] - after[0]);
+
+    if (dot(normalBefore, normalAfter) <= 0.f)
+      return true;
+  }
+
+  return false;
+}
+
+// Simplifies a set of triangles towards the target count by repeatedly
+// collapsing unlocked vertices into neighbouring vertices, cheapest
+// collapses first as measured by the quadric error metric.  Each pass only
+// collapses non-overlapping neighbourhoods.
+void simplifyTriangles(const Mesh::VertexList& vertices,
+                       const std::vector<bool>& locked,
+                       std::vector<Quadric>& quadrics,
+                       std::vector<MeshTriangle>& triangles,
+                       size_t targetCount)
+{
+  const size_t vertexCount = vertices.size();
+
+  std::vector<uint32> remap(vertexCount);
+  std::vector<bool> touched(vertexCount, false);
+  std::vector<uint32> counts(vertexCount), offsets(vertexCount + 1);
+  std::vector<uint32> adjacency;
+  std::vector<Collapse> collapses;
+
+  for (size_t i = 0;  i < vertexCount;  i++)
+    remap[i] = uint32(i);
+
+  while (triangles.size() > targetCount)
+  {
+    collapses.clear();
+
+    for (auto t = triangles.begin();  t != triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        const uint32 source = t->indices[k];
+        if (locked[source])
+          continue;
+
+        for (size_t j = 1;  j < 3;  j++)
+        {
+          Collapse collapse;
+          collapse.source = source;
+          collapse.target = t->indices[(k + j) % 3];
+          collapse.cost = quadrics[source].evaluate(vertices[collapse.target].position);
+          collapses.push_back(collapse);
+        }
+      }
+    }
+
+    if (collapses.empty())
+      break;
+
+    std::sort(collapses.begin(), collapses.end());
+
+    std::fill(counts.begin(), counts.end(), 0);
+
+    for (auto t = triangles.begin();  t != triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+        counts[t->indices[k]]++;
+    }
+
+    offsets[0] = 0;
+    for (size_t i = 0;  i < vertexCount;  i++)
+      offsets[i + 1] = offsets[i] + counts[i];
+
+    adjacency.resize(triangles.size() * 3);
+    std::fill(counts.begin(), counts.end(), 0);
+
+    for (size_t i = 0;  i < triangles.size();  i++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        const uint32 vertex = triangles[i].indices[k];
+        adjacency[offsets[vertex] + counts[vertex]++] = uint32(i);
+      }
+    }
+
+    std::fill(touched.begin(), touched.end(), false);
+
+    size_t remaining = triangles.size();
+    size_t collapsed = 0;
+
+    for (auto c = collapses.begin();  c != collapses.end();  c++)
+    {
+      if (touched[c->source] || touched[c->target])
+        continue;
+
+      const uint32* around = &adjacency[offsets[c->source]];
+      const size_t aroundCount = counts[c->source];
+
+      if (flipsTriangles(triangles, vertices, around, aroundCount, c->source, c->target))
+        continue;
+
+      // Lock the whole neighbourhood so that the flip test stays valid for
+      // the other collapses of this pass
+      for (size_t i = 0;  i < aroundCount;  i++)
+      {
+        const uint32* indices = triangles[around[i]].indices;
+
+        if (indices[0] == c->target ||
+            indices[1] == c->target ||
+            indices[2] == c->target)
+        {
+          remaining--;
+        }
+
+        touched[indices[0]] = touched[indices[1]] = touched[indices[2]] = true;
+      }
+
+      remap[c->source] = c->target;
+      quadrics[c->target].add(quadrics[c->source]);
+      collapsed++;
+
+      if (remaining <= targetCount)
+        break;
+    }
+
+    if (!collapsed)
+      break;
+
+    size_t count = 0;
+
+    for (size_t i = 0;  i < triangles.size();  i++)
+    {
+      MeshTriangle triangle = triangles[i];
+
+      for (size_t k = 0;  k < 3;  k++)
+        triangle.indices[k] = remap[triangle.indices[k]];
+
+      if (triangle.indices[0] == triangle.indices[1] ||
+          triangle.indices[1] == triangle.indices[2] ||
+          triangle.indices[2] == triangle.indices[0])
+      {
+        continue;
+      }
+
+      triangles[count++] = triangle;
+    }
+
+    triangles.resize(count);
+
+    for (auto c = collapses.begin();  c != collapses.end();  c++)
+      remap[c->source] = c->source;
+  }
+}
+
+// Simulates a FIFO post-transform vertex cache over all sections
+size_t countCacheMisses(const Mesh& mesh)
+{
+  std::vector<size_t> timestamps(mesh.vertices.size(), 0);
+  size_t time = VERTEX_CACHE_SIZE + 1, misses = 0;
+
+  for (auto s = mesh.sections.begin();  s != mesh.sections.end();  s++)
+  {
+    for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        if (time - timestamps[t->indices[k]] > VERTEX_CACHE_SIZE)
+        {
+          timestamps[t->indices[k]] = time++;
+          misses++;
+        }
+      }
+    }
+  }
+
+  return misses;
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
+void MeshTriangle::setIndices(uint32 a, uint32 b, uint32 c)
+{
+  indices[0] = a;
+  indices[1] = b;
+  indices[2] = c;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+Mesh::Mesh(const ResourceInfo& info):
+  Resource(info)
+{
+}
+
+void Mesh::mergeSections(const char* materialName)
+{
+  sections[0].materialName = materialName;
+
+  for (size_t i = 1;  i < sections.size();  i++)
+  {
+    sections[0].triangles.insert(sections[0].triangles.end(),
+                                 sections[i].triangles.begin(),
+                                 sections[i].triangles.end());
+  }
+
+  sections.resize(1);
+  sections[0].levels.clear();
+}
+
+void Mesh::weld()
+{
+  ProximityMap<3> positionMap;
+  std::vector<uint32> candidates;
+
+  Mesh::VertexList positions;
+  std::vector<uint32> remap(vertices.size());
+
+  for (size_t i = 0;  i < vertices.size();  i++)
+  {
+    const vec3& position = vertices[i].position;
+    uint32 match = 0xffffffff;
+
+    positionMap.findCandidates(0, &position.x, candidates);
+
+    for (auto c = candidates.begin();  c != candidates.end();  c++)
+    {
+      if (*c < match &&
+          all(equalEpsilon(positions[*c].position, position, WELD_EPSILON)))
+      {
+        match = *c;
+      }
+    }
+
+    if (match == 0xffffffff)
+    {
+      match = uint32(positions.size());
+      positionMap.insert(0, &position.x, match);
+      positions.push_back(vertices[i]);
+    }
+
+    remap[i] = match;
+  }
+
+  VertexTool tool(positions);
+
+  for (auto s = sections.begin();  s != sections.end();  s++)
+  {
+    s->levels.clear();
+
+    for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        const MeshVertex& vertex = vertices[t->indices[k]];
+
+        t->indices[k] = tool.addAttributeLayer(remap[t->indices[k]],
+                                               vertex.normal,
+                                               vertex.texcoord);
+      }
+    }
+  }
+
+  tool.realizeVertices(vertices);
+}
+
+void Mesh::optimize(bool reduceOverdraw)
+{
+  for (auto s = sections.begin();  s != sections.end();  s++)
+  {
+    optimizeTriangleOrder(s->triangles, vertices.size());
+
+    if (reduceOverdraw)
+      optimizeClusterOrder(s->triangles, vertices);
+
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+      optimizeTriangleOrder(*l, vertices.size());
+  }
+
+  // Reorder vertices by first use, dropping any unreferenced ones
+  std::vector<uint32> remap(vertices.size(), NO_INDEX);
+  VertexList result;
+  result.reserve(vertices.size());
+
+  for (auto s = sections.begin();  s != sections.end();  s++)
+  {
+    for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        uint32& index = remap[t->indices[k]];
+
+        if (index == NO_INDEX)
+        {
+          index = uint32(result.size());
+          result.push_back(vertices[t->indices[k]]);
+        }
+
+        t->indices[k] = index;
+      }
+    }
+
+    // Detail levels only use vertices of the full detail triangles
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+    {
+      for (auto t = l->begin();  t != l->end();  t++)
+      {
+        for (size_t k = 0;  k < 3;  k++)
+          t->indices[k] = remap[t->indices[k]];
+      }
+    }
+  }
+
+  vertices.swap(result);
+}
+
+void Mesh::generateLevels(uint count, float ratio)
+{
+  const size_t vertexCount = vertices.size();
+
+  // Find the vertices sharing each position and, among those, the vertices
+  // also sharing texture coordinates, which differ only by normals
+  ProximityMap<3> positionMap;
+  std::vector<uint32> candidates;
+  std::vector<uint32> canonical(vertexCount);
+  std::vector<uint32> wedges(vertexCount);
+  std::vector<uint32> wedgeCounts(vertexCount, 0);
+
+  for (size_t i = 0;  i < vertexCount;  i++)
+  {
+    const vec3& position = vertices[i].position;
+    uint32 match = uint32(i);
+    uint32 wedge = uint32(i);
+
+    positionMap.findCandidates(0, &position.x, candidates);
+
+    for (auto c = candidates.begin();  c != candidates.end();  c++)
+    {
+      if (vertices[*c].position == position)
+      {
+        match = std::min(match, canonical[*c]);
+
+        if (vertices[*c].texcoord == vertices[i].texcoord)
+          wedge = *c;
+      }
+    }
+
+    if (wedge == i)
+    {
+      positionMap.insert(0, &position.x, wedge);
+      wedgeCounts[match]++;
+    }
+
+    canonical[i] = match;
+    wedges[i] = wedge;
+  }
+
+  // Find positions shared between sections or on open or non-manifold edges
+  std::vector<bool> fixed(vertexCount, false);
+  std::vector<uint32> owners(vertexCount, NO_INDEX);
+  std::unordered_map<uint64, uint32> edges;
+
+  for (size_t i = 0;  i < sections.size();  i++)
+  {
+    const std::vector<MeshTriangle>& triangles = sections[i].triangles;
+
+    for (auto t = triangles.begin();  t != triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        const uint32 a = canonical[t->indices[k]];
+        const uint32 b = canonical[t->indices[(k + 1) % 3]];
+
+        if (owners[a] == NO_INDEX)
+          owners[a] = uint32(i);
+        else if (owners[a] != i)
+          fixed[a] = true;
+
+        edges[(uint64(std::min(a, b)) << 32) | std::max(a, b)]++;
+      }
+    }
+  }
+
+  for (auto e = edges.begin();  e != edges.end();  e++)
+  {
+    if (e->second != 2)
+    {
+      fixed[uint32(e->first >> 32)] = true;
+      fixed[uint32(e->first & 0xffffffff)] = true;
+    }
+  }
+
+  // Only texture coordinate seams are locked, as vertices split only by
+  // normals are simplified as one through their first copy
+  std::vector<bool> locked(vertexCount);
+
+  for (size_t i = 0;  i < vertexCount;  i++)
+    locked[i] = fixed[canonical[i]] || wedgeCounts[canonical[i]] > 1;
+
+  // Sections are simplified independently, so a single set of quadrics is
+  // reused, resetting only the vertices each section references
+  std::vector<Quadric> quadrics(vertexCount);
+
+  for (auto s = sections.begin();  s != sections.end();  s++)
+  {
+    std::vector<MeshTriangle> triangles = s->triangles;
+    s->levels.clear();
+
+    // Copies differing only by normals are merged into the first of them
+    // this section uses, so that levels never use vertices of other sections
+    std::unordered_map<uint32, uint32> firstCopies;
+
+    for (auto t = triangles.begin();  t != triangles.end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        const uint32 index = t->indices[k];
+        auto copy = firstCopies.insert(std::make_pair(wedges[index], index));
+        t->indices[k] = copy.first->second;
+        quadrics[t->indices[k]] = Quadric();
+      }
+    }
+
+    for (auto t = triangles.begin();  t != triangles.end();  t++)
+    {
+      const vec3& a = vertices[t->indices[0]].position;
+      const vec3& b = vertices[t->indices[1]].position;
+      const vec3& c = vertices[t->indices[2]].position;
+
+      const vec3 normal = cross(b - a, c - a);
+      const float area = length(normal);
+      if (area == 0.f)
+        continue;
+
+      const vec3 unit = normal / area;
+      const float distance = -dot(unit, a);
+
+      for (size_t k = 0;  k < 3;  k++)
+        quadrics[t->indices[k]].addPlane(unit, distance, area);
+    }
+
+    for (uint i = 0;  i < count;  i++)
+    {
+      const size_t previous = triangles.size();
+
+      simplifyTriangles(vertices, locked, quadrics, triangles,
+                        size_t(previous * ratio));
 
-  for (size_t i = 1;  i < sections.size();  i++)
-  {
-    sections[0].triangles.insert(sections[0].triangles.end(),
-                                 sections[i].triangles.begin(),
-                                 sections[i].triangles.end());
-  }
+      if (triangles.size() == previous || triangles.empty())
+        break;
 
-  sections.resize(1);
+      for (auto t = triangles.begin();  t != triangles.end();  t++)
+      {
+        const vec3 one = vertices[t->indices[1]].position -
+                         vertices[t->indices[0]].position;
+        const vec3 two = vertices[t->indices[2]].position -
+                         vertices[t->indices[0]].position;
+
+        const vec3 normal = cross(one, two);
+        if (length(normal) > 0.f)
+          t->normal = normalize(normal);
+      }
+
+      s->levels.push_back(triangles);
+    }
+  }
 }
 
 MeshSection* Mesh::findSection(const char* materialName)
@@ -269,6 +1840,8 @@ void Mesh::generateNormals(NormalType type)
 
   for (auto s = sections.begin();  s != sections.end();  s++)
   {
+    s->levels.clear();
+
     for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
     {
       for (size_t k = 0;  k < 3;  k++)
@@ -368,11 +1941,33 @@ bool Mesh::isValid() const
         return false;
       }
     }
+
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+    {
+      for (auto t = l->begin();  t != l->end();  t++)
+      {
+        if (t->indices[0] >= vertices.size() ||
+            t->indices[1] >= vertices.size() ||
+            t->indices[2] >= vertices.size())
+        {
+          return false;
+        }
+      }
+    }
   }
 
   return true;
 }
 
+float Mesh::calculateACMR() const
+{
+  const size_t count = getTriangleCount();
+  if (!count)
+    return 0.f;
+
+  return float(countCacheMisses(*this)) / count;
+}
+
 size_t Mesh::getTriangleCount() const
 {
   size_t count = 0;
@@ -383,6 +1978,21 @@ size_t Mesh::getTriangleCount() const
   return count;
 }
 
+size_t Mesh::getIndexCount() const
+{
+  size_t count = 0;
+
+  for (auto s = sections.begin();  s != sections.end();  s++)
+  {
+    count += s->triangles.size() * 3;
+
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+      count += l->size() * 3;
+  }
+
+  return count;
+}
+
 Ref<Mesh> Mesh::read(ResourceCache& cache, const String& name)
 {
   MeshReader reader(cache);
@@ -398,158 +2008,199 @@ MeshReader::MeshReader(ResourceCache& index):
 
 Ref<Mesh> MeshReader::read(const String& name, const Path& path)
 {
-  std::ifstream stream(path.asString().c_str(), std::ios::in | std::ios::binary);
+  ResourceStream stream(cache, path);
   if (stream.fail())
   {
     logError("Failed to open mesh \'%s\'", name.c_str());
     return NULL;
   }
 
-  String line;
-  uint lineNumber = 0;
+  if (BinaryMesh::isBinaryMesh(stream))
+  {
+    BinaryMesh data;
+    if (!data.read(stream))
+    {
+      logError("Failed to read binary mesh \'%s\'", name.c_str());
+      return NULL;
+    }
+
+    Ref<Mesh> mesh = new Mesh(ResourceInfo(cache, name, path));
+
+    mesh->vertices.assign(data.getVertices(),
+                          data.getVertices() + data.getVertexCount());
+
+    const std::vector<BinaryMesh::Section>& sections = data.getSections();
+
+    for (auto s = sections.begin();  s != sections.end();  s++)
+    {
+      mesh->sections.push_back(MeshSection());
+      MeshSection& section = mesh->sections.back();
+
+      section.materialName = s->materialName;
+      readIndices(section.triangles, s->indices, s->indexCount, data.getIndexSize());
+
+      section.levels.resize(s->levels.size());
+
+      for (size_t i = 0;  i < s->levels.size();  i++)
+      {
+        readIndices(section.levels[i],
+                    s->levels[i].indices,
+                    s->levels[i].indexCount,
+                    data.getIndexSize());
+      }
+    }
+
+    return mesh;
+  }
+
+  size_t size;
+  std::vector<char> buffer;
+
+  const char* data;
+  if (!readContents(stream, buffer, data, size))
+  {
+    logError("Failed to read mesh \'%s\'", name.c_str());
+    return NULL;
+  }
+
+  // Large files are split at line boundaries and the chunks parsed in
+  // parallel, each into its own arrays, which are then merged in order.
+  // Loader workers already read files in parallel, so they parse on their
+  // own thread only.
+  uint chunkCount = 1;
+
+  if (!ResourceLoader::isWorkerThread())
+  {
+    chunkCount = uint(size / OBJ_CHUNK_SIZE);
+    chunkCount = std::max(1u, std::min(chunkCount, std::thread::hardware_concurrency()));
+  }
+
+  std::vector<ObjChunk> chunks(chunkCount);
+
+  const char* start = data;
+  const char* end = data + size;
+
+  for (uint i = 0;  i < chunkCount;  i++)
+  {
+    const char* stop = end;
+
+    if (i + 1 < chunkCount)
+    {
+      stop = start + (end - start) / (chunkCount - i);
+      stop = std::find(stop, end, '\n');
+      if (stop != end)
+        stop++;
+    }
+
+    chunks[i].start = start;
+    chunks[i].end = stop;
+    start = stop;
+  }
+
+  std::vector<std::thread> threads;
+
+  for (uint i = 1;  i < chunkCount;  i++)
+    threads.push_back(std::thread(parseObjChunk, std::ref(chunks[i])));
+
+  parseObjChunk(chunks[0]);
+
+  for (auto t = threads.begin();  t != threads.end();  t++)
+    t->join();
 
   std::vector<vec3> positions;
   std::vector<vec3> normals;
   std::vector<vec2> texcoords;
-  std::vector<Triplet> triplets;
 
-  std::vector<FaceGroup> groups;
-  FaceGroup* group = NULL;
+  size_t positionCount = 0, normalCount = 0, texcoordCount = 0;
 
-  while (std::getline(stream, line))
+  for (auto c = chunks.begin();  c != chunks.end();  c++)
   {
-    const char* text = line.c_str();
-    ++lineNumber;
+    positionCount += c->positions.size();
+    normalCount += c->normals.size();
+    texcoordCount += c->texcoords.size();
+  }
 
-    if (!interesting(&text))
-      continue;
+  positions.reserve(positionCount);
+  normals.reserve(normalCount);
+  texcoords.reserve(texcoordCount);
 
-    try
+  std::vector<FaceGroup> groups;
+  std::unordered_map<String, size_t> groupIndices;
+  size_t group = NO_GROUP;
+  uint lineBase = 0;
+
+  for (auto c = chunks.begin();  c != chunks.end();  c++)
+  {
+    for (auto w = c->warnings.begin();  w != c->warnings.end();  w++)
     {
-      String command = parseName(&text);
+      logWarning("Unknown command \'%s\' in mesh \'%s\' line %d",
+                 w->command.c_str(),
+                 name.c_str(),
+                 lineBase + w->line);
+    }
 
-      if (command == "g")
-      {
-        // Silently ignore group names
-      }
-      else if (command == "o")
-      {
-        // Silently ignore object names
-      }
-      else if (command == "s")
-      {
-        // Silently ignore smoothing
-      }
-      else if (command == "v")
-      {
-        vec3 vertex;
+    if (!c->error.empty())
+    {
+      logError("%s in mesh \'%s\' line %d",
+               c->error.c_str(),
+               name.c_str(),
+               lineBase + c->errorLine);
 
-        vertex.x = parseFloat(&text);
-        vertex.y = parseFloat(&text);
-        vertex.z = parseFloat(&text);
-        positions.push_back(vertex);
-      }
-      else if (command == "vt")
-      {
-        vec2 texcoord;
+      return NULL;
+    }
 
-        texcoord.x = parseFloat(&text);
-        texcoord.y = parseFloat(&text);
-        texcoords.push_back(texcoord);
-      }
-      else if (command == "vn")
-      {
-        vec3 normal;
+    if (group == NO_GROUP && c->orphanLine)
+    {
+      logError("Expected \'usemtl\' before \'f\' in mesh \'%s\' line %d",
+               name.c_str(),
+               lineBase + c->orphanLine);
 
-        normal.x = parseFloat(&text);
-        normal.y = parseFloat(&text);
-        normal.z = parseFloat(&text);
-        normals.push_back(normalize(normal));
-      }
-      else if (command == "usemtl")
-      {
-        String materialName = parseName(&text);
+      return NULL;
+    }
 
-        group = NULL;
+    positions.insert(positions.end(), c->positions.begin(), c->positions.end());
+    normals.insert(normals.end(), c->normals.begin(), c->normals.end());
+    texcoords.insert(texcoords.end(), c->texcoords.begin(), c->texcoords.end());
 
-        for (auto g = groups.begin();  g != groups.end();  g++)
-        {
-          if (g->name == materialName)
-            group = &(*g);
-        }
+    size_t first = 0;
 
-        if (!group)
-        {
-          groups.push_back(FaceGroup());
-          groups.back().name = materialName;
-          group = &(groups.back());
-        }
-      }
-      else if (command == "mtllib")
+    for (size_t i = 0;  i <= c->switches.size();  i++)
+    {
+      size_t last = c->faces.size();
+      if (i < c->switches.size())
+        last = c->switches[i].first;
+
+      if (group != NO_GROUP)
       {
-        // Silently ignore .mtl material files
+        groups[group].faces.insert(groups[group].faces.end(),
+                                   c->faces.begin() + first,
+                                   c->faces.begin() + last);
       }
-      else if (command == "f")
-      {
-        if (!group)
-          throw Exception("Expected \'usemtl\' before \'f\'");
-
-        triplets.clear();
 
-        while (*text != '\0')
-        {
-          triplets.push_back(Triplet());
-          Triplet& triplet = triplets.back();
-
-          triplet.vertex = parseInteger(&text);
-          triplet.texcoord = 0;
-          triplet.normal = 0;
-
-          if (*text == '/')
-          {
-            if (std::isdigit(*(++text)))
-              triplet.texcoord = parseInteger(&text);
-
-            if (*text == '/')
-            {
-              if (std::isdigit(*(++text)))
-                triplet.normal = parseInteger(&text);
-            }
-          }
-
-          while (std::isspace(*text))
-            text++;
-        }
+      if (i < c->switches.size())
+      {
+        const String& materialName = c->switches[i].materialName;
 
-        for (size_t i = 2;  i < triplets.size();  i++)
+        auto entry = groupIndices.find(materialName);
+        if (entry == groupIndices.end())
         {
-          group->faces.push_back(Face());
-          Face& face = group->faces.back();
-
-          face.p[0] = triplets[0];
-          face.p[1] = triplets[i - 1];
-          face.p[2] = triplets[i];
+          group = groups.size();
+          groupIndices[materialName] = group;
+          groups.push_back(FaceGroup());
+          groups.back().name = materialName;
         }
+        else
+          group = entry->second;
       }
-      else
-      {
-        logWarning("Unknown command \'%s\' in mesh \'%s\' line %d",
-                   command.c_str(),
-                   name.c_str(),
-                   lineNumber);
-      }
-    }
-    catch (Exception& e)
-    {
-      logError("%s in mesh \'%s\' line %d",
-               e.what(),
-               name.c_str(),
-               lineNumber);
 
-      return NULL;
+      first = last;
     }
+
+    lineBase += c->lineCount;
   }
 
+  chunks.clear();
+
   Ref<Mesh> mesh = new Mesh(ResourceInfo(cache, name, path));
 
   mesh->vertices.resize(positions.size());
@@ -578,6 +2229,14 @@ Ref<Mesh> MeshReader::read(const String& name, const Path& path)
       {
         const Triplet& point = face.p[j];
 
+        if (point.vertex > positions.size() ||
+            point.normal > normals.size() ||
+            point.texcoord > texcoords.size())
+        {
+          logError("Index out of range in mesh \'%s\'", name.c_str());
+          return NULL;
+        }
+
         vec3 normal;
         if (point.normal)
           normal = normals[point.normal - 1];
@@ -595,55 +2254,173 @@ Ref<Mesh> MeshReader::read(const String& name, const Path& path)
   return mesh;
 }
 
-String MeshReader::parseName(const char** text)
+///////////////////////////////////////////////////////////////////////
+
+BinaryMesh::BinaryMesh():
+  vertices(NULL),
+  vertexCount(0),
+  indexSize(0),
+  indexCount(0),
+  radius(0.f)
+{
+}
+
+bool BinaryMesh::read(ResourceStream& stream)
 {
-  while (std::isspace(**text))
-    (*text)++;
+  const char* data;
+  size_t size;
+
+  if (!readContents(stream, buffer, data, size))
+    return false;
+
+  BinaryMeshHeader header;
+
+  if (size < sizeof(header))
+    return false;
+
+  std::memcpy(&header, data, sizeof(header));
+
+  if (header.magic != BINARY_MESH_MAGIC || header.version != BINARY_MESH_VERSION)
+    return false;
+
+  if (header.indexSize != 1 && header.indexSize != 2 && header.indexSize != 4)
+    return false;
+
+  size_t offset = sizeof(header);
+
+  if (offset + header.vertexCount * sizeof(MeshVertex) > size)
+    return false;
+
+  vertices = (const MeshVertex*) (data + offset);
+  vertexCount = header.vertexCount;
+  indexSize = header.indexSize;
+  offset += vertexCount * sizeof(MeshVertex);
+
+  // Every section takes at least its header, so a count not fitting in the
+  // rest of the file is rejected before anything is allocated for it
+  if (header.sectionCount > (size - offset) / sizeof(BinaryMeshSection))
+    return false;
 
-  String result;
+  sections.resize(header.sectionCount);
 
-  while (std::isalnum(**text) || **text == '_')
+  for (size_t i = 0;  i < sections.size();  i++)
   {
-    result.append(1, **text);
-    (*text)++;
+    BinaryMeshSection section;
+
+    if (offset + sizeof(section) > size)
+      return false;
+
+    std::memcpy(&section, data + offset, sizeof(section));
+    offset += sizeof(section);
+
+    if (offset + padToWord(section.nameLength) > size)
+      return false;
+
+    sections[i].materialName.assign(data + offset, section.nameLength);
+    offset += padToWord(section.nameLength);
+
+    if (offset + section.levelCount * sizeof(uint32) > size)
+      return false;
+
+    sections[i].levels.resize(section.levelCount);
+
+    for (size_t j = 0;  j < section.levelCount;  j++)
+    {
+      uint32 count;
+      std::memcpy(&count, data + offset, sizeof(count));
+      sections[i].levels[j].indexCount = count;
+      offset += sizeof(count);
+    }
+
+    if (offset + padToWord(section.indexCount * indexSize) > size)
+      return false;
+
+    if (!checkIndices(data + offset, section.indexCount, indexSize, vertexCount))
+      return false;
+
+    sections[i].indices = data + offset;
+    sections[i].indexCount = section.indexCount;
+    offset += padToWord(section.indexCount * indexSize);
+
+    indexCount += section.indexCount;
+
+    for (auto l = sections[i].levels.begin();  l != sections[i].levels.end();  l++)
+    {
+      if (offset + padToWord(l->indexCount * indexSize) > size)
+        return false;
+
+      if (!checkIndices(data + offset, l->indexCount, indexSize, vertexCount))
+        return false;
+
+      l->indices = data + offset;
+      offset += padToWord(l->indexCount * indexSize);
+
+      indexCount += l->indexCount;
+    }
   }
 
-  if (!result.size())
-    throw Exception("Expected but missing name");
+  minimum = vec3(header.minimum[0], header.minimum[1], header.minimum[2]);
+  maximum = vec3(header.maximum[0], header.maximum[1], header.maximum[2]);
+  center = vec3(header.center[0], header.center[1], header.center[2]);
+  radius = header.radius;
 
-  return result;
+  return true;
 }
 
-int MeshReader::parseInteger(const char** text)
+const MeshVertex* BinaryMesh::getVertices() const
 {
-  char* end;
+  return vertices;
+}
 
-  const int result = std::strtol(*text, &end, 0);
-  if (end == *text)
-    throw Exception("Expected but missing integer value");
+size_t BinaryMesh::getVertexCount() const
+{
+  return vertexCount;
+}
 
-  *text = end;
-  return result;
+size_t BinaryMesh::getIndexSize() const
+{
+  return indexSize;
 }
 
-float MeshReader::parseFloat(const char** text)
+size_t BinaryMesh::getIndexCount() const
 {
-  char* end;
+  return indexCount;
+}
 
-  const float result = float(std::strtod(*text, &end));
-  if (end == *text)
-    throw Exception("Expected but missing float value");
+const std::vector<BinaryMesh::Section>& BinaryMesh::getSections() const
+{
+  return sections;
+}
 
-  *text = end;
-  return result;
+const vec3& BinaryMesh::getMinimum() const
+{
+  return minimum;
 }
 
-bool MeshReader::interesting(const char** text)
+const vec3& BinaryMesh::getMaximum() const
 {
-  if (std::isspace(**text) || **text == '#' || **text == '\0' || **text == '\r')
-    return false;
+  return maximum;
+}
 
-  return true;
+const vec3& BinaryMesh::getCenter() const
+{
+  return center;
+}
+
+float BinaryMesh::getRadius() const
+{
+  return radius;
+}
+
+bool BinaryMesh::isBinaryMesh(std::istream& stream)
+{
+  uint32 magic = 0;
+  stream.read((char*) &magic, sizeof(magic));
+
+  stream.clear();
+  stream.seekg(0, std::ios::beg);
+
+  return magic == BINARY_MESH_MAGIC;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -689,6 +2466,102 @@ bool MeshWriter::write(const Path& path, const Mesh& mesh)
   return true;
 }
 
+bool MeshWriter::writeBinary(const Path& path, const Mesh& mesh)
+{
+  if (!mesh.isValid())
+  {
+    logError("Cannot write invalid mesh \'%s\'", mesh.getName().c_str());
+    return false;
+  }
+
+  std::ofstream stream(path.asString().c_str(), std::ios::out | std::ios::binary);
+  if (!stream.is_open())
+  {
+    logError("Failed to open \'%s\' for writing",
+             path.asString().c_str());
+    return false;
+  }
+
+  const AABB box = mesh.generateBoundingAABB();
+  const Sphere sphere = mesh.generateBoundingSphere();
+
+  vec3 minimum, maximum;
+  box.getBounds(minimum.x, minimum.y, minimum.z,
+                maximum.x, maximum.y, maximum.z);
+
+  BinaryMeshHeader header;
+  header.magic = BINARY_MESH_MAGIC;
+  header.version = BINARY_MESH_VERSION;
+  header.vertexCount = mesh.vertices.size();
+  header.sectionCount = mesh.sections.size();
+  header.reserved = 0;
+
+  // The index size only needs to fit the highest vertex index
+  if (mesh.vertices.size() <= (1 << 8))
+    header.indexSize = 1;
+  else if (mesh.vertices.size() <= (1 << 16))
+    header.indexSize = 2;
+  else
+    header.indexSize = 4;
+
+  for (size_t i = 0;  i < 3;  i++)
+  {
+    header.minimum[i] = minimum[i];
+    header.maximum[i] = maximum[i];
+    header.center[i] = sphere.center[i];
+  }
+
+  header.radius = sphere.radius;
+
+  stream.write((const char*) &header, sizeof(header));
+  stream.write((const char*) &mesh.vertices[0],
+               mesh.vertices.size() * sizeof(MeshVertex));
+
+  const char padding[4] = { 0, 0, 0, 0 };
+
+  for (auto s = mesh.sections.begin();  s != mesh.sections.end();  s++)
+  {
+    BinaryMeshSection section;
+    section.nameLength = s->materialName.length();
+    section.indexCount = s->triangles.size() * 3;
+    section.levelCount = s->levels.size();
+    section.reserved = 0;
+
+    stream.write((const char*) &section, sizeof(section));
+    stream.write(s->materialName.c_str(), section.nameLength);
+    stream.write(padding, padToWord(section.nameLength) - section.nameLength);
+
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+    {
+      const uint32 count = l->size() * 3;
+      stream.write((const char*) &count, sizeof(count));
+    }
+
+    for (size_t i = 0;  i <= s->levels.size();  i++)
+    {
+      const std::vector<MeshTriangle>& triangles = i ? s->levels[i - 1] : s->triangles;
+
+      if (header.indexSize == 1)
+        writeIndices<uint8>(stream, triangles);
+      else if (header.indexSize == 2)
+        writeIndices<uint16>(stream, triangles);
+      else
+        writeIndices<uint32>(stream, triangles);
+
+      const size_t indexBytes = triangles.size() * 3 * header.indexSize;
+      stream.write(padding, padToWord(indexBytes) - indexBytes);
+    }
+  }
+
+  if (stream.fail())
+  {
+    logError("Failed to write binary mesh \'%s\'", path.asString().c_str());
+    return false;
+  }
+
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 } /*namespace wendy*/
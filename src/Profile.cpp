@@ -30,6 +30,8 @@
 #include <wendy/Profile.h>
 
 #include <algorithm>
+#include <thread>
+#include <atomic>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -38,6 +40,42 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+std::thread::id currentThread;
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// Job time accumulated by a worker since it was last collected, aligned so
+// that no two workers ever write to the same cache line
+struct alignas(CACHE_LINE_SIZE) WorkerClock
+{
+  std::atomic<uint64> nanoseconds;
+};
+
+const uint MAX_WORKER_CLOCKS = 64;
+
+WorkerClock workerClocks[MAX_WORKER_CLOCKS];
+
+// One past the highest worker index that has reported time
+std::atomic<uint> workerClockCount(0);
+
+// Takes the time accumulated by each worker so far, resetting the clocks
+void collectWorkerTimes(std::vector<Time>& times)
+{
+  const uint count = workerClockCount.load();
+
+  times.resize(count);
+
+  for (uint i = 0;  i < count;  i++)
+    times[i] = workerClocks[i].nanoseconds.exchange(0) / 1e9;
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
 bool ProfileNode::operator == (const char* string) const
 {
   return name == string;
@@ -81,8 +119,19 @@ ProfileNode* ProfileNode::findChild(const char* name)
 
 ///////////////////////////////////////////////////////////////////////
 
+Profile::Profile():
+  root("Frame")
+{
+}
+
 void Profile::beginFrame()
 {
+  // Discard job time from between frames
+  if (current == this)
+    collectWorkerTimes(workerTimes);
+
+  std::fill(workerTimes.begin(), workerTimes.end(), 0.0);
+
   resetNode(root);
   beginNode(root);
   timer.start();
@@ -92,6 +141,9 @@ void Profile::endFrame()
 {
   endNode();
   timer.stop();
+
+  if (current == this)
+    collectWorkerTimes(workerTimes);
 }
 
 void Profile::beginNode(const char* name)
@@ -121,14 +173,49 @@ const ProfileNode& Profile::getRootNode() const
   return root;
 }
 
+Time Profile::getWorkerTime(uint worker) const
+{
+  if (worker >= workerTimes.size())
+    return 0.0;
+
+  return workerTimes[worker];
+}
+
+uint Profile::getWorkerCount() const
+{
+  return uint(workerTimes.size());
+}
+
 Profile* Profile::getCurrent()
 {
+  // The profile is not thread safe, so only the thread that made it current
+  // may record nodes in it
+  if (std::this_thread::get_id() != currentThread)
+    return NULL;
+
   return current;
 }
 
 void Profile::setCurrent(Profile* newProfile)
 {
   current = newProfile;
+  currentThread = std::this_thread::get_id();
+}
+
+void Profile::addWorkerTime(uint worker, Time duration)
+{
+  if (worker >= MAX_WORKER_CLOCKS)
+    return;
+
+  workerClocks[worker].nanoseconds += uint64(duration * 1e9);
+
+  uint count = workerClockCount.load();
+
+  while (count <= worker)
+  {
+    if (workerClockCount.compare_exchange_weak(count, worker + 1))
+      break;
+  }
 }
 
 void Profile::beginNode(ProfileNode& node)
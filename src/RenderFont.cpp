@@ -102,6 +102,12 @@ uint findEndY(const Image& image)
 
 const uint FONT_XML_VERSION = 1;
 
+class FontSource : public RefObject
+{
+public:
+  FontData data;
+};
+
 } /*namespace*/
 
 ///////////////////////////////////////////////////////////////////////
@@ -148,7 +154,7 @@ void Font::drawText(const vec2& penPosition, const vec4& color, const char* text
     roundedPen.x = floor(penPosition.x + 0.5f);
     roundedPen.y = floor(penPosition.y + 0.5f);
 
-    vertices.resize(length * 6);
+    GL::VertexRangeLock<Vertex2ft2fv> vertices(vertexRange, GL::LOCK_WRITE_UNSYNCHRONIZED);
 
     Layout layout;
 
@@ -163,23 +169,27 @@ void Font::drawText(const vec2& penPosition, const vec4& color, const char* text
         const Rect& pa = layout.area;
         const Rect& ta = glyph->area;
 
-        vertices[count + 0].texCoord = ta.position;
-        vertices[count + 0].position = pa.position;
-        vertices[count + 1].texCoord = ta.position + vec2(ta.size.x, 0.f);
-        vertices[count + 1].position = pa.position + vec2(pa.size.x, 0.f);
-        vertices[count + 2].texCoord = ta.position + ta.size;
-        vertices[count + 2].position = pa.position + pa.size;
-
-        vertices[count + 3] = vertices[count + 2];
-        vertices[count + 4].texCoord = ta.position + vec2(0.f, ta.size.y);
-        vertices[count + 4].position = pa.position + vec2(0.f, pa.size.y);
-        vertices[count + 5] = vertices[count + 0];
+        // The locked range is write-only, so no vertex is read back
+        Vertex2ft2fv corners[4];
+        corners[0].texCoord = ta.position;
+        corners[0].position = pa.position;
+        corners[1].texCoord = ta.position + vec2(ta.size.x, 0.f);
+        corners[1].position = pa.position + vec2(pa.size.x, 0.f);
+        corners[2].texCoord = ta.position + ta.size;
+        corners[2].position = pa.position + pa.size;
+        corners[3].texCoord = ta.position + vec2(0.f, ta.size.y);
+        corners[3].position = pa.position + vec2(0.f, pa.size.y);
+
+        vertices[count + 0] = corners[0];
+        vertices[count + 1] = corners[1];
+        vertices[count + 2] = corners[2];
+        vertices[count + 3] = corners[2];
+        vertices[count + 4] = corners[3];
+        vertices[count + 5] = corners[0];
 
         count += 6;
       }
     }
-
-    vertexRange.copyFrom(&vertices[0]);
   }
 
   if (!count)
@@ -476,57 +486,41 @@ void Font::getGlyphLayout(Layout& layout, const Glyph& glyph, uint8 character) c
 ///////////////////////////////////////////////////////////////////////
 
 FontReader::FontReader(GeometryPool& initPool):
-  ResourceReader<Font>(initPool.getContext().getCache()),
+  DocumentReader<Font>(initPool.getContext().getCache()),
   pool(&initPool)
 {
 }
 
-Ref<Font> FontReader::read(const String& name, const Path& path)
+bool FontReader::decode(const String& name,
+                        const ResourceDocument& document,
+                        Ref<RefObject>& data)
 {
-  std::ifstream stream(path.asString().c_str());
-  if (stream.fail())
-  {
-    logError("Failed to open font \'%s\'", name.c_str());
-    return NULL;
-  }
-
-  pugi::xml_document document;
-
-  const pugi::xml_parse_result result = document.load(stream);
-  if (!result)
-  {
-    logError("Failed to load font \'%s\': %s",
-             name.c_str(),
-             result.description());
-    return NULL;
-  }
-
-  pugi::xml_node root = document.child("font");
+  pugi::xml_node root = document.getDocument().child("font");
   if (!root || root.attribute("version").as_uint() != FONT_XML_VERSION)
   {
     logError("Font file format mismatch in \'%s\'", name.c_str());
-    return NULL;
+    return false;
   }
 
   const String characters(root.attribute("characters").value());
   if (characters.empty())
   {
     logError("No characters specified for font \'%s\'", name.c_str());
-    return NULL;
+    return false;
   }
 
   const String imageName(root.attribute("image").value());
   if (imageName.empty())
   {
     logError("Glyph image path missing for font \'%s\'", name.c_str());
-    return NULL;
+    return false;
   }
 
   Ref<Image> image = Image::read(cache, imageName);
   if (!image)
   {
     logError("Failed to load glyph image for font \'%s\'", name.c_str());
-    return NULL;
+    return false;
   }
 
   bool fixedWidth = false;
@@ -534,12 +528,29 @@ Ref<Font> FontReader::read(const String& name, const Path& path)
   if (pugi::xml_attribute a = root.attribute("fixed"))
     fixedWidth = a.as_bool();
 
-  FontData data;
+  Ref<FontSource> source(new FontSource());
 
-  if (!extractGlyphs(data, name, *image, characters, fixedWidth))
+  if (!extractGlyphs(source->data, name, *image, characters, fixedWidth))
+    return false;
+
+  data = source;
+  return true;
+}
+
+Ref<Font> FontReader::create(const String& name,
+                             const ResourceDocument& document,
+                             RefObject* data)
+{
+  FontSource* source = dynamic_cast<FontSource*>(data);
+  if (!source)
+  {
+    logError("No glyph data decoded for font \'%s\'", name.c_str());
     return NULL;
+  }
 
-  return Font::create(ResourceInfo(cache, name, path), *pool, data);
+  return Font::create(ResourceInfo(cache, name, document.getPath()),
+                      *pool,
+                      source->data);
 }
 
 bool FontReader::extractGlyphs(FontData& data,
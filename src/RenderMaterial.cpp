@@ -66,6 +66,12 @@ Bimap<GL::SamplerType, GL::TextureType> textureTypeMap;
 
 const uint MATERIAL_XML_VERSION = 9;
 
+class MaterialSource : public RefObject
+{
+public:
+  std::vector<Ref<Image>> images;
+};
+
 void initializeMaps()
 {
   if (cullModeMap.isEmpty())
@@ -510,33 +516,75 @@ Material::Material(const ResourceInfo& info):
 ///////////////////////////////////////////////////////////////////////
 
 MaterialReader::MaterialReader(System& initSystem):
-  ResourceReader<Material>(initSystem.getCache()),
+  DocumentReader<Material>(initSystem.getCache()),
   system(initSystem)
 {
   initializeMaps();
 }
 
-Ref<Material> MaterialReader::read(const String& name, const Path& path)
+bool MaterialReader::decode(const String& name,
+                            const ResourceDocument& document,
+                            Ref<RefObject>& data)
 {
-  std::ifstream stream(path.asString().c_str());
-  if (stream.fail())
+  pugi::xml_node root = document.getDocument().child("material");
+  if (!root || root.attribute("version").as_uint() != MATERIAL_XML_VERSION)
   {
-    logError("Failed to open material \'%s\'", name.c_str());
-    return NULL;
+    logError("Material file format mismatch in '%s'", name.c_str());
+    return false;
   }
 
-  pugi::xml_document document;
+  // Decode the images of the techniques create will use, so that only the
+  // textures themselves are left for the owning thread
+
+  Ref<MaterialSource> source(new MaterialSource());
 
-  const pugi::xml_parse_result result = document.load(stream);
-  if (!result)
+  std::vector<bool> phases(2, false);
+
+  for (pugi::xml_node t = root.child("technique");  t;  t = t.next_sibling("technique"))
   {
-    logError("Failed to load material \'%s\': %s",
-             name.c_str(),
-             result.description());
-    return NULL;
+    const String phaseName(t.attribute("phase").value());
+    if (!phaseMap.hasKey(phaseName))
+      continue;
+
+    const Phase phase = phaseMap[phaseName];
+    if (phases[phase])
+      continue;
+
+    const String typeName(t.attribute("type").value());
+    if (!systemTypeMap.hasKey(typeName))
+      continue;
+
+    if (system.getType() != systemTypeMap[typeName])
+      continue;
+
+    for (pugi::xml_node p = t.child("pass");  p;  p = p.next_sibling("pass"))
+    {
+      pugi::xml_node program = p.child("program");
+
+      for (pugi::xml_node s = program.child("sampler");  s;  s = s.next_sibling("sampler"))
+      {
+        if (pugi::xml_attribute a = s.attribute("image"))
+        {
+          if (Ref<Image> image = Image::read(cache, a.value()))
+            source->images.push_back(image);
+        }
+      }
+
+      phases[phase] = true;
+    }
   }
 
-  pugi::xml_node root = document.child("material");
+  data = source;
+  return true;
+}
+
+Ref<Material> MaterialReader::create(const String& name,
+                                     const ResourceDocument& document,
+                                     RefObject* data)
+{
+  const Path& path = document.getPath();
+
+  pugi::xml_node root = document.getDocument().child("material");
   if (!root || root.attribute("version").as_uint() != MATERIAL_XML_VERSION)
   {
     logError("Material file format mismatch in \'%s\'", name.c_str());
@@ -61,14 +61,158 @@ namespace
 
 const uint MODEL_XML_VERSION = 3;
 
+// Projected bounding sphere radius, as a fraction of half the viewport
+// height, below which the first simplified detail level is used.  Each
+// further level is used below half the size of the previous one.
+const float LOD_SCREEN_SIZE = 0.25f;
+
+// Vertex layout of quantised models, with normals packed into 10-bit signed
+// integers and texture coordinates stored as half floats
+struct PackedVertex
+{
+  vec3 position;
+  uint32 normal;
+  uint32 texcoord;
+};
+
+uint32 packSnorm10(float value)
+{
+  return uint32(int32(std::floor(clamp(value, -1.f, 1.f) * 511.f + 0.5f))) & 0x3ff;
+}
+
+template <typename T>
+bool writeTriangles(GL::IndexRange& range,
+                    const std::vector<MeshTriangle>& triangles)
+{
+  GL::IndexRangeLock<T> indices(range);
+  if (!indices)
+    return false;
+
+  size_t index = 0;
+
+  for (auto t = triangles.begin();  t != triangles.end();  t++)
+  {
+    indices[index++] = t->indices[0];
+    indices[index++] = t->indices[1];
+    indices[index++] = t->indices[2];
+  }
+
+  return true;
+}
+
+bool writeTriangles(GL::IndexRange& range,
+                    GL::IndexBuffer::Type type,
+                    const std::vector<MeshTriangle>& triangles)
+{
+  if (type == GL::IndexBuffer::UINT8)
+    return writeTriangles<uint8>(range, triangles);
+  else if (type == GL::IndexBuffer::UINT16)
+    return writeTriangles<uint16>(range, triangles);
+  else
+    return writeTriangles<uint32>(range, triangles);
+}
+
+// Accumulates the bounds of the vertices referenced by a model section
+class SectionBounds
+{
+public:
+  SectionBounds(const MeshVertex* vertices);
+  void add(uint32 index);
+  void add(const std::vector<MeshTriangle>& triangles);
+  template <typename T>
+  void add(const T* indices, size_t count);
+  AABB getAABB() const;
+  Sphere getSphere() const;
+private:
+  const MeshVertex* vertices;
+  vec3 minimum;
+  vec3 maximum;
+  Sphere sphere;
+  bool empty;
+};
+
+SectionBounds::SectionBounds(const MeshVertex* initVertices):
+  vertices(initVertices),
+  empty(true)
+{
+}
+
+void SectionBounds::add(uint32 index)
+{
+  const vec3& position = vertices[index].position;
+
+  if (empty)
+  {
+    minimum = maximum = position;
+    sphere.set(position, 0.f);
+    empty = false;
+  }
+  else
+  {
+    minimum = min(minimum, position);
+    maximum = max(maximum, position);
+    sphere.envelop(position);
+  }
+}
+
+void SectionBounds::add(const std::vector<MeshTriangle>& triangles)
+{
+  for (auto t = triangles.begin();  t != triangles.end();  t++)
+  {
+    add(t->indices[0]);
+    add(t->indices[1]);
+    add(t->indices[2]);
+  }
+}
+
+template <typename T>
+void SectionBounds::add(const T* indices, size_t count)
+{
+  for (size_t i = 0;  i < count;  i++)
+    add(uint32(indices[i]));
+}
+
+AABB SectionBounds::getAABB() const
+{
+  AABB result;
+  result.setBounds(minimum.x, minimum.y, minimum.z,
+                   maximum.x, maximum.y, maximum.z);
+  return result;
+}
+
+Sphere SectionBounds::getSphere() const
+{
+  return sphere;
+}
+
+class ModelSource : public RefObject
+{
+public:
+  class MaterialSource
+  {
+  public:
+    String alias;
+    String name;
+    Ref<ResourceDocument> document;
+    Ref<RefObject> data;
+  };
+  Ref<Mesh> mesh;
+  BinaryMesh binaryMesh;
+  std::vector<MaterialSource> materials;
+};
+
 } /*namespace*/
 
 ///////////////////////////////////////////////////////////////////////
 
 ModelSection::ModelSection(const GL::IndexRange& initRange,
-                           Material* initMaterial):
+                           Material* initMaterial,
+                           const AABB& initBoundingAABB,
+                           const Sphere& initBoundingSphere):
   range(initRange),
-  material(initMaterial)
+  material(initMaterial),
+  boundingAABB(initBoundingAABB),
+  boundingSphere(initBoundingSphere)
 {
 }
 
@@ -77,6 +221,24 @@ const GL::IndexRange& ModelSection::getIndexRange() const
   return range;
 }
 
+const GL::IndexRange& ModelSection::getIndexRange(uint level) const
+{
+  if (!level || levels.empty())
+    return range;
+
+  return levels[std::min(level, uint(levels.size())) - 1];
+}
+
+uint ModelSection::getLevelCount() const
+{
+  return uint(levels.size()) + 1;
+}
+
+void ModelSection::addLevel(const GL::IndexRange& range)
+{
+  levels.push_back(range);
+}
+
 Material* ModelSection::getMaterial() const
 {
   return material;
@@ -87,24 +249,75 @@ void ModelSection::setMaterial(Material* newMaterial)
   material = newMaterial;
 }
 
+const AABB& ModelSection::getBoundingAABB() const
+{
+  return boundingAABB;
+}
+
+const Sphere& ModelSection::getBoundingSphere() const
+{
+  return boundingSphere;
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 void Model::enqueue(Scene& scene, const Camera& camera, const Transform3& transform) const
 {
+  const uint level = selectLevel(camera, transform);
+  const Frustum& frustum = camera.getFrustum();
+
   for (auto s = sections.begin();  s != sections.end();  s++)
   {
     Material* material = s->getMaterial();
     if (!material)
       continue;
 
-    GL::PrimitiveRange range(GL::TRIANGLE_LIST, *vertexBuffer, s->getIndexRange());
+    // Sphere::transformBy ignores rotation, which matters for off-center
+    // section bounds
+    Sphere bounds = s->getBoundingSphere();
+    transform.transformVector(bounds.center);
+    bounds.radius *= transform.scale;
+
+    // The node has already been culled against the bounds of the whole model,
+    // so only models with several sections benefit from testing each one
+    if (sections.size() > 1 && !frustum.intersects(bounds))
+      continue;
+
+    GL::PrimitiveRange range(GL::TRIANGLE_LIST, *vertexBuffer, s->getIndexRange(level));
 
-    float depth = camera.getNormalizedDepth(transform.position + boundingSphere.center);
+    float depth = camera.getNormalizedDepth(bounds.center);
 
     scene.createOperations(transform, range, *material, depth);
   }
 }
 
+uint Model::selectLevel(const Camera& camera, const Transform3& transform) const
+{
+  if (levelCount < 2 || !camera.isPerspective())
+    return 0;
+
+  vec3 center = boundingSphere.center;
+  transform.transformVector(center);
+
+  const float radius = boundingSphere.radius * transform.scale;
+  const float distance = length(center - camera.getTransform().position);
+  if (distance <= radius)
+    return 0;
+
+  const float size = radius / (distance * tan(radians(camera.getFOV()) / 2.f));
+
+  uint level = 0;
+  float threshold = LOD_SCREEN_SIZE;
+
+  while (size < threshold && level + 1 < levelCount)
+  {
+    level++;
+    threshold /= 2.f;
+  }
+
+  return level;
+}
+
 const AABB& Model::getBoundingAABB() const
 {
   return boundingAABB;
@@ -143,17 +356,32 @@ const GL::IndexBuffer& Model::getIndexBuffer() const
 Ref<Model> Model::create(const ResourceInfo& info,
                          System& system,
                          const Mesh& data,
-                         const MaterialMap& materials)
+                         const MaterialMap& materials,
+                         bool quantize)
 {
   Ref<Model> model(new Model(info));
-  if (!model->init(system, data, materials))
+  if (!model->init(system, data, materials, quantize))
+    return NULL;
+
+  return model;
+}
+
+Ref<Model> Model::create(const ResourceInfo& info,
+                         System& system,
+                         const BinaryMesh& data,
+                         const MaterialMap& materials,
+                         bool quantize)
+{
+  Ref<Model> model(new Model(info));
+  if (!model->init(system, data, materials, quantize))
     return NULL;
 
   return model;
 }
 
 Model::Model(const ResourceInfo& info):
-  Resource(info)
+  Resource(info),
+  levelCount(1)
 {
 }
 
@@ -168,7 +396,10 @@ Model& Model::operator = (const Model& source)
   panic("Models may not be assigned");
 }
 
-bool Model::init(System& system, const Mesh& data, const MaterialMap& materials)
+bool Model::init(System& system,
+                 const Mesh& data,
+                 const MaterialMap& materials,
+                 bool quantize)
 {
   if (!data.isValid())
   {
@@ -191,20 +422,10 @@ bool Model::init(System& system, const Mesh& data, const MaterialMap& materials)
 
   GL::Context& context = system.getContext();
 
-  VertexFormat format;
-  if (!format.createComponents("3f:vPosition 3f:vNormal 2f:vTexCoord"))
+  if (!initVertices(context, &data.vertices[0], data.vertices.size(), quantize))
     return false;
 
-  vertexBuffer = GL::VertexBuffer::create(context,
-                                          data.vertices.size(),
-                                          format,
-                                          GL::VertexBuffer::STATIC);
-  if (!vertexBuffer)
-    return false;
-
-  vertexBuffer->copyFrom(&data.vertices[0], data.vertices.size());
-
-  const size_t indexCount = data.getTriangleCount() * 3;
+  const size_t indexCount = data.getIndexCount();
 
   GL::IndexBuffer::Type indexType;
   if (indexCount <= (1 << 8))
@@ -228,59 +449,175 @@ bool Model::init(System& system, const Mesh& data, const MaterialMap& materials)
     const size_t count = s->triangles.size() * 3;
     GL::IndexRange range(*indexBuffer, start, count);
 
-    sections.push_back(ModelSection(range, materials.find(s->materialName)->second));
+    if (!writeTriangles(range, indexType, s->triangles))
+      return false;
 
-    if (indexType == GL::IndexBuffer::UINT8)
-    {
-      GL::IndexRangeLock<uint8> indices(range);
-      if (!indices)
-        return false;
+    start += count;
 
-      size_t index = 0;
+    SectionBounds bounds(&data.vertices[0]);
+    bounds.add(s->triangles);
 
-      for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
-      {
-        indices[index++] = t->indices[0];
-        indices[index++] = t->indices[1];
-        indices[index++] = t->indices[2];
-      }
-    }
-    else if (indexType == GL::IndexBuffer::UINT16)
+    ModelSection section(range,
+                         materials.find(s->materialName)->second,
+                         bounds.getAABB(),
+                         bounds.getSphere());
+
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
     {
-      GL::IndexRangeLock<uint16> indices(range);
-      if (!indices)
+      GL::IndexRange levelRange(*indexBuffer, start, l->size() * 3);
+
+      if (!writeTriangles(levelRange, indexType, *l))
         return false;
 
-      size_t index = 0;
+      section.addLevel(levelRange);
+      start += l->size() * 3;
+    }
 
-      for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
-      {
-        indices[index++] = t->indices[0];
-        indices[index++] = t->indices[1];
-        indices[index++] = t->indices[2];
-      }
+    levelCount = std::max(levelCount, section.getLevelCount());
+    sections.push_back(section);
+  }
+
+  boundingAABB = data.generateBoundingAABB();
+  boundingSphere = data.generateBoundingSphere();
+  return true;
+}
+
+bool Model::init(System& system,
+                 const BinaryMesh& data,
+                 const MaterialMap& materials,
+                 bool quantize)
+{
+  const std::vector<BinaryMesh::Section>& meshSections = data.getSections();
+
+  if (!data.getVertexCount() || meshSections.empty())
+  {
+    logError("Binary mesh for model \'%s\' is empty", getName().c_str());
+    return false;
+  }
+
+  for (auto s = meshSections.begin();  s != meshSections.end();  s++)
+  {
+    if (materials.find(s->materialName) == materials.end())
+    {
+      logError("Missing material \'%s\' for model \'%s\'",
+               s->materialName.c_str(),
+               getName().c_str());
+      return false;
     }
+  }
+
+  GL::Context& context = system.getContext();
+
+  if (!initVertices(context, data.getVertices(), data.getVertexCount(), quantize))
+    return false;
+
+  GL::IndexBuffer::Type indexType;
+  if (data.getIndexSize() == 1)
+    indexType = GL::IndexBuffer::UINT8;
+  else if (data.getIndexSize() == 2)
+    indexType = GL::IndexBuffer::UINT16;
+  else
+    indexType = GL::IndexBuffer::UINT32;
+
+  indexBuffer = GL::IndexBuffer::create(context,
+                                        data.getIndexCount(),
+                                        indexType,
+                                        GL::IndexBuffer::STATIC);
+  if (!indexBuffer)
+    return false;
+
+  size_t start = 0;
+
+  for (auto s = meshSections.begin();  s != meshSections.end();  s++)
+  {
+    GL::IndexRange range(*indexBuffer, start, s->indexCount);
+
+    // The indices are stored in their final type, so no conversion is needed
+    indexBuffer->copyFrom(s->indices, s->indexCount, start);
+
+    start += s->indexCount;
+
+    SectionBounds bounds(data.getVertices());
+
+    if (indexType == GL::IndexBuffer::UINT8)
+      bounds.add((const uint8*) s->indices, s->indexCount);
+    else if (indexType == GL::IndexBuffer::UINT16)
+      bounds.add((const uint16*) s->indices, s->indexCount);
     else
-    {
-      GL::IndexRangeLock<uint32> indices(range);
-      if (!indices)
-        return false;
+      bounds.add((const uint32*) s->indices, s->indexCount);
 
-      size_t index = 0;
+    ModelSection section(range,
+                         materials.find(s->materialName)->second,
+                         bounds.getAABB(),
+                         bounds.getSphere());
 
-      for (auto t = s->triangles.begin();  t != s->triangles.end();  t++)
-      {
-        indices[index++] = t->indices[0];
-        indices[index++] = t->indices[1];
-        indices[index++] = t->indices[2];
-      }
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+    {
+      section.addLevel(GL::IndexRange(*indexBuffer, start, l->indexCount));
+      indexBuffer->copyFrom(l->indices, l->indexCount, start);
+      start += l->indexCount;
     }
 
-    start += count;
+    levelCount = std::max(levelCount, section.getLevelCount());
+    sections.push_back(section);
   }
 
-  boundingAABB = data.generateBoundingAABB();
-  boundingSphere = data.generateBoundingSphere();
+  const vec3& minimum = data.getMinimum();
+  const vec3& maximum = data.getMaximum();
+
+  boundingAABB.setBounds(minimum.x, minimum.y, minimum.z,
+                         maximum.x, maximum.y, maximum.z);
+  boundingSphere = Sphere(data.getCenter(), data.getRadius());
+  return true;
+}
+
+bool Model::initVertices(GL::Context& context,
+                         const MeshVertex* vertices,
+                         size_t count,
+                         bool quantize)
+{
+  const bool packed = quantize && context.isPackedVertexSupported();
+
+  VertexFormat format;
+
+  if (packed)
+  {
+    if (!format.createComponents("3f:vPosition 3p:vNormal 2h:vTexCoord"))
+      return false;
+  }
+  else
+  {
+    if (!format.createComponents("3f:vPosition 3f:vNormal 2f:vTexCoord"))
+      return false;
+  }
+
+  vertexBuffer = GL::VertexBuffer::create(context,
+                                          count,
+                                          format,
+                                          GL::VertexBuffer::STATIC);
+  if (!vertexBuffer)
+    return false;
+
+  if (!packed)
+  {
+    vertexBuffer->copyFrom(vertices, count);
+    return true;
+  }
+
+  std::vector<PackedVertex> packedVertices(count);
+
+  for (size_t i = 0;  i < count;  i++)
+  {
+    const vec3& normal = vertices[i].normal;
+
+    packedVertices[i].position = vertices[i].position;
+    packedVertices[i].normal = packSnorm10(normal.x) |
+                               (packSnorm10(normal.y) << 10) |
+                               (packSnorm10(normal.z) << 20);
+    packedVertices[i].texcoord = packHalf2x16(vertices[i].texcoord);
+  }
+
+  vertexBuffer->copyFrom(&packedVertices[0], count);
   return true;
 }
 
@@ -293,84 +630,195 @@ Ref<Model> Model::read(System& system, const String& name)
 ///////////////////////////////////////////////////////////////////////
 
 ModelReader::ModelReader(System& initSystem):
-  ResourceReader<Model>(initSystem.getCache()),
-  system(initSystem)
+  DocumentReader<Model>(initSystem.getCache()),
+  system(initSystem),
+  materialReader(initSystem)
 {
 }
 
-Ref<Model> ModelReader::read(const String& name, const Path& path)
+bool ModelReader::decode(const String& name,
+                         const ResourceDocument& document,
+                         Ref<RefObject>& data)
 {
-  std::ifstream stream(path.asString().c_str());
-  if (stream.fail())
-  {
-    logError("Failed to open model \'%s\'", name.c_str());
-    return NULL;
-  }
-
-  pugi::xml_document document;
-
-  const pugi::xml_parse_result result = document.load(stream);
-  if (!result)
-  {
-    logError("Failed to load model \'%s\': %s",
-             name.c_str(),
-             result.description());
-    return NULL;
-  }
-
-  pugi::xml_node root = document.child("model");
+  pugi::xml_node root = document.getDocument().child("model");
   if (!root || root.attribute("version").as_uint() != MODEL_XML_VERSION)
   {
     logError("Model file format mismatch in \'%s\'", name.c_str());
-    return NULL;
+    return false;
   }
 
   const String meshName(root.attribute("mesh").value());
   if (meshName.empty())
   {
     logError("No mesh for model \'%s\'", name.c_str());
-    return NULL;
+    return false;
   }
 
-  Ref<Mesh> mesh = Mesh::read(cache, meshName);
+  Ref<ModelSource> source(new ModelSource());
+
+  // Binary meshes are loaded straight into the model buffers, unless the
+  // mesh is already in the cache
+  Ref<Mesh> mesh = cache.find<Mesh>(meshName);
+
   if (!mesh)
   {
-    logError("Failed to load mesh for model \'%s\'", name.c_str());
-    return NULL;
+    const Path meshPath = cache.findFile(meshName);
+    if (meshPath.isEmpty())
+    {
+      logError("Failed to find mesh \'%s\' for model \'%s\'",
+               meshName.c_str(),
+               name.c_str());
+      return false;
+    }
+
+    ResourceStream meshStream(cache, meshPath);
+
+    if (BinaryMesh::isBinaryMesh(meshStream))
+    {
+      if (!source->binaryMesh.read(meshStream))
+      {
+        logError("Failed to read binary mesh for model \'%s\'", name.c_str());
+        return false;
+      }
+    }
+    else
+    {
+      mesh = Mesh::read(cache, meshName);
+      if (!mesh)
+      {
+        logError("Failed to load mesh for model \'%s\'", name.c_str());
+        return false;
+      }
+    }
   }
 
-  Model::MaterialMap materials;
+  const uint levels = root.attribute("levels").as_uint();
+  const bool optimize = root.attribute("optimize").as_bool();
+
+  // Processing works on a private copy, so that the cached mesh and any
+  // other models sharing it are left untouched
+  if (mesh && (levels || optimize))
+    mesh = new Mesh(*mesh);
+
+  if (mesh && levels)
+  {
+    mesh->generateLevels(levels);
+
+    size_t levelCount = 0;
+
+    for (auto s = mesh->sections.begin();  s != mesh->sections.end();  s++)
+      levelCount = std::max(levelCount, s->levels.size());
+
+    log("Generated %u detail levels for mesh \'%s\' of model \'%s\'",
+        (uint) levelCount,
+        meshName.c_str(),
+        name.c_str());
+  }
+
+  if (mesh && optimize)
+  {
+    const float before = mesh->calculateACMR();
+    mesh->optimize(root.attribute("overdraw").as_bool());
+    const float after = mesh->calculateACMR();
+
+    log("Optimized mesh \'%s\' for model \'%s\' from ACMR %.3f to %.3f",
+        meshName.c_str(),
+        name.c_str(),
+        before,
+        after);
+  }
+
+  source->mesh = mesh;
 
+  // Materials not already in the cache are parsed and have their images
+  // decoded here, leaving only their GL objects to be created
   for (pugi::xml_node m = root.child("material");  m;  m = m.next_sibling("material"))
   {
-    const String materialAlias(m.attribute("alias").value());
-    if (materialAlias.empty())
+    source->materials.push_back(ModelSource::MaterialSource());
+    ModelSource::MaterialSource& material = source->materials.back();
+
+    material.alias = m.attribute("alias").value();
+    if (material.alias.empty())
     {
       logError("Empty material alias found in model \'%s\'", name.c_str());
-      return NULL;
+      return false;
     }
 
-    const String materialName(m.attribute("name").value());
-    if (materialName.empty())
+    material.name = m.attribute("name").value();
+    if (material.name.empty())
     {
       logError("Empty material name for alias \'%s\' in model \'%s\'",
-               materialAlias.c_str(),
+               material.alias.c_str(),
                name.c_str());
-      return NULL;
+      return false;
+    }
+
+    if (cache.find<Material>(material.name))
+      continue;
+
+    const Path materialPath = cache.findFile(material.name);
+    if (materialPath.isEmpty())
+      continue;
+
+    material.document = ResourceDocument::read(cache, material.name, materialPath);
+    if (!material.document)
+      continue;
+
+    if (!materialReader.decode(material.name, *material.document, material.data))
+      material.document = NULL;
+  }
+
+  data = source;
+  return true;
+}
+
+Ref<Model> ModelReader::create(const String& name,
+                               const ResourceDocument& document,
+                               RefObject* data)
+{
+  ModelSource* source = dynamic_cast<ModelSource*>(data);
+  if (!source)
+  {
+    logError("No mesh decoded for model \'%s\'", name.c_str());
+    return NULL;
+  }
+
+  Model::MaterialMap materials;
+
+  for (auto m = source->materials.begin();  m != source->materials.end();  m++)
+  {
+    Ref<Material> material = cache.find<Material>(m->name);
+
+    if (!material)
+    {
+      if (m->document)
+        material = materialReader.create(m->name, *m->document, m->data);
+      else
+        material = Material::read(system, m->name);
     }
 
-    Ref<Material> material = Material::read(system, materialName);
     if (!material)
     {
       logError("Failed to load material for alias \'%s\' of model \'%s\'",
-               materialAlias.c_str(),
-               materialName.c_str());
+               m->alias.c_str(),
+               m->name.c_str());
     }
 
-    materials[materialAlias] = material;
+    materials[m->alias] = material;
+  }
+
+  pugi::xml_node root = document.getDocument().child("model");
+
+  const bool quantize = root.attribute("quantize").as_bool();
+
+  if (source->mesh)
+  {
+    return Model::create(ResourceInfo(cache, name, document.getPath()),
+                         system, *source->mesh, materials, quantize);
   }
 
-  return Model::create(ResourceInfo(cache, name, path), system, *mesh, materials);
+  return Model::create(ResourceInfo(cache, name, document.getPath()),
+                       system, source->binaryMesh, materials, quantize);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -29,6 +29,7 @@
 #include <wendy/GLBuffer.h>
 #include <wendy/GLProgram.h>
 #include <wendy/GLContext.h>
+#include <wendy/GLQuery.h>
 
 #include <wendy/RenderPool.h>
 
@@ -41,6 +42,25 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+// Number of frames a ring is sized to hold before allocations wait on fences
+const size_t RING_FRAME_COUNT = 3;
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
+GeometryPool::~GeometryPool()
+{
+  for (auto i = indexBufferPool.begin();  i != indexBufferPool.end();  i++)
+    i->ring.reset(0);
+
+  for (auto i = vertexBufferPool.begin();  i != vertexBufferPool.end();  i++)
+    i->ring.reset(0);
+}
+
 bool GeometryPool::allocateIndices(GL::IndexRange& range,
                                    uint count,
                                    GL::IndexBuffer::Type type)
@@ -51,44 +71,48 @@ bool GeometryPool::allocateIndices(GL::IndexRange& range,
     return true;
   }
 
+  assert(context.isCurrent());
+
   IndexBufferSlot* slot = NULL;
 
   for (auto i = indexBufferPool.begin();  i != indexBufferPool.end();  i++)
   {
-    if (i->indexBuffer->getType() == type && i->available >= count)
+    if (i->indexBuffer->getType() == type)
     {
       slot = &(*i);
       break;
     }
   }
 
-  if (!slot)
+  size_t start;
+
+  if (!slot || !slot->ring.allocate(start, count))
   {
-    indexBufferPool.push_back(IndexBufferSlot());
-    slot = &(indexBufferPool.back());
+    const size_t capacity = getRingCapacity(slot ? slot->ring.capacity : 0, count);
 
-    const uint actualCount = granularity * ((count + granularity - 1) / granularity);
+    Ref<GL::IndexBuffer> indexBuffer = GL::IndexBuffer::create(context,
+                                                               capacity,
+                                                               type,
+                                                               GL::IndexBuffer::DYNAMIC);
+    if (!indexBuffer)
+      return false;
+
+    log("Allocated index pool of size %u", (uint) capacity);
 
-    slot->indexBuffer = GL::IndexBuffer::create(context,
-                                                actualCount,
-                                                type,
-                                                GL::IndexBuffer::DYNAMIC);
-    if (!slot->indexBuffer)
+    if (slot)
+      retiredIndexBuffers.push_back(slot->indexBuffer);
+    else
     {
-      indexBufferPool.pop_back();
-      return false;
+      indexBufferPool.push_back(IndexBufferSlot());
+      slot = &(indexBufferPool.back());
     }
 
-    log("Allocated index pool of size %u", actualCount);
-
-    slot->available = slot->indexBuffer->getCount();
+    slot->indexBuffer = indexBuffer;
+    slot->ring.reset(capacity);
+    slot->ring.allocate(start, count);
   }
 
-  range = GL::IndexRange(*(slot->indexBuffer),
-                         slot->indexBuffer->getCount() - slot->available,
-                         count);
-
-  slot->available -= count;
+  range = GL::IndexRange(*(slot->indexBuffer), start, count);
   return true;
 }
 
@@ -102,49 +126,88 @@ bool GeometryPool::allocateVertices(GL::VertexRange& range,
     return true;
   }
 
+  assert(context.isCurrent());
+
   VertexBufferSlot* slot = NULL;
 
   for (auto i = vertexBufferPool.begin();  i != vertexBufferPool.end();  i++)
   {
-    if (i->vertexBuffer->getFormat() == format && i->available >= count)
+    if (i->vertexBuffer->getFormat() == format)
     {
       slot = &(*i);
       break;
     }
   }
 
-  if (!slot)
-  {
-    vertexBufferPool.push_back(VertexBufferSlot());
-    slot = &(vertexBufferPool.back());
+  size_t start;
 
-    const uint actualCount = granularity * ((count + granularity - 1) / granularity);
+  if (!slot || !slot->ring.allocate(start, count))
+  {
+    const size_t capacity = getRingCapacity(slot ? slot->ring.capacity : 0, count);
 
-    slot->vertexBuffer = GL::VertexBuffer::create(context,
-                                                  actualCount,
-                                                  format,
-                                                  GL::VertexBuffer::DYNAMIC);
-    if (!slot->vertexBuffer)
-    {
-      vertexBufferPool.pop_back();
+    Ref<GL::VertexBuffer> vertexBuffer = GL::VertexBuffer::create(context,
+                                                                  capacity,
+                                                                  format,
+                                                                  GL::VertexBuffer::DYNAMIC);
+    if (!vertexBuffer)
       return false;
-    }
 
     log("Allocated vertex pool of size %u format \'%s\'",
-        actualCount,
+        (uint) capacity,
         format.asString().c_str());
 
-    slot->available = slot->vertexBuffer->getCount();
-  }
+    if (slot)
+      retiredVertexBuffers.push_back(slot->vertexBuffer);
+    else
+    {
+      vertexBufferPool.push_back(VertexBufferSlot());
+      slot = &(vertexBufferPool.back());
+    }
 
-  range = GL::VertexRange(*(slot->vertexBuffer),
-                          slot->vertexBuffer->getCount() - slot->available,
-                          count);
+    slot->vertexBuffer = vertexBuffer;
+    slot->ring.reset(capacity);
+    slot->ring.allocate(start, count);
+  }
 
-  slot->available -= count;
+  range = GL::VertexRange(*(slot->vertexBuffer), start, count);
   return true;
 }
 
+bool GeometryPool::isTransient(const GL::PrimitiveRange& range) const
+{
+  if (const GL::VertexBuffer* vertexBuffer = range.getVertexBuffer())
+  {
+    for (auto i = vertexBufferPool.begin();  i != vertexBufferPool.end();  i++)
+    {
+      if (i->vertexBuffer == vertexBuffer)
+        return true;
+    }
+
+    for (auto i = retiredVertexBuffers.begin();  i != retiredVertexBuffers.end();  i++)
+    {
+      if (*i == vertexBuffer)
+        return true;
+    }
+  }
+
+  if (const GL::IndexBuffer* indexBuffer = range.getIndexBuffer())
+  {
+    for (auto i = indexBufferPool.begin();  i != indexBufferPool.end();  i++)
+    {
+      if (i->indexBuffer == indexBuffer)
+        return true;
+    }
+
+    for (auto i = retiredIndexBuffers.begin();  i != retiredIndexBuffers.end();  i++)
+    {
+      if (*i == indexBuffer)
+        return true;
+    }
+  }
+
+  return false;
+}
+
 GL::Context& GeometryPool::getContext() const
 {
   return context;
@@ -172,13 +235,97 @@ bool GeometryPool::init(size_t initGranularity)
   return true;
 }
 
+size_t GeometryPool::getRingCapacity(size_t previous, size_t count) const
+{
+  const size_t minimum = max(previous * 2, count * RING_FRAME_COUNT);
+  return granularity * ((minimum + granularity - 1) / granularity);
+}
+
 void GeometryPool::onContextFinish()
 {
   for (auto i = indexBufferPool.begin();  i != indexBufferPool.end();  i++)
-    i->available = i->indexBuffer->getCount();
+    i->ring.finish(context);
 
   for (auto i = vertexBufferPool.begin();  i != vertexBufferPool.end();  i++)
-    i->available = i->vertexBuffer->getCount();
+    i->ring.finish(context);
+
+  retiredIndexBuffers.clear();
+  retiredVertexBuffers.clear();
+}
+
+///////////////////////////////////////////////////////////////////////
+
+GeometryPool::Ring::Ring():
+  capacity(0),
+  head(0),
+  tail(0)
+{
+}
+
+bool GeometryPool::Ring::allocate(size_t& start, size_t count)
+{
+  if (count > capacity)
+    return false;
+
+  // Positions grow monotonically and are wrapped only when used, so that the
+  // space still in use is always the span from tail to head
+
+  size_t position = head;
+
+  // Ranges may not wrap around the end of the buffer
+  if (position % capacity + count > capacity)
+    position += capacity - position % capacity;
+
+  while (position + count - tail > capacity)
+  {
+    // Waiting on the previous frame would stall the pipeline, so signal that
+    // this ring needs to grow instead
+    if (frames.empty())
+      return false;
+
+    Frame& frame = frames.front();
+
+    if (frames.size() == 1 && !frame.fence->isSignaled())
+      return false;
+
+    if (!frame.fence->wait())
+      return false;
+
+    tail = frame.end;
+    frames.pop_front();
+  }
+
+  start = position % capacity;
+  head = position + count;
+  return true;
+}
+
+void GeometryPool::Ring::finish(GL::Context& context)
+{
+  while (!frames.empty() && frames.front().fence->isSignaled())
+  {
+    tail = frames.front().end;
+    frames.pop_front();
+  }
+
+  if (head == (frames.empty() ? tail : frames.back().end))
+    return;
+
+  // If no fence can be created, the space is claimed by the next one instead
+  Frame frame;
+  frame.fence = GL::Fence::create(context);
+  frame.end = head;
+
+  if (frame.fence)
+    frames.push_back(std::move(frame));
+}
+
+void GeometryPool::Ring::reset(size_t newCapacity)
+{
+  frames.clear();
+
+  capacity = newCapacity;
+  head = tail = 0;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -41,6 +41,7 @@
 #include <wendy/RenderScene.h>
 
 #include <algorithm>
+#include <cstring>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -51,6 +52,77 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+// Sorts the keys and their operation indices with an LSD radix sort, twelve
+// bits per pass.  The lowest sixteen bits hold the (unused) index member and
+// are skipped, as are passes where all keys share the same digit
+void radixSort(SortKeyList& keys,
+               OperationIndexList& indices,
+               SortKeyList& tempKeys,
+               OperationIndexList& tempIndices)
+{
+  enum
+  {
+    PASS_COUNT = 4,
+    DIGIT_BITS = 12,
+    DIGIT_COUNT = 1 << DIGIT_BITS,
+    DIGIT_MASK = DIGIT_COUNT - 1,
+    FIRST_BIT = 16
+  };
+
+  const size_t count = keys.size();
+  if (count < 2)
+    return;
+
+  uint32 counts[PASS_COUNT][DIGIT_COUNT];
+  std::memset(counts, 0, sizeof(counts));
+
+  for (auto k = keys.begin();  k != keys.end();  k++)
+  {
+    const uint64 key = *k;
+
+    for (uint pass = 0;  pass < PASS_COUNT;  pass++)
+      counts[pass][(key >> (FIRST_BIT + pass * DIGIT_BITS)) & DIGIT_MASK]++;
+  }
+
+  tempKeys.resize(count);
+  tempIndices.resize(count);
+
+  for (uint pass = 0;  pass < PASS_COUNT;  pass++)
+  {
+    const uint shift = FIRST_BIT + pass * DIGIT_BITS;
+    uint32* buckets = counts[pass];
+
+    if (buckets[(keys.front() >> shift) & DIGIT_MASK] == count)
+      continue;
+
+    uint32 offset = 0;
+
+    for (uint digit = 0;  digit < DIGIT_COUNT;  digit++)
+    {
+      const uint32 size = buckets[digit];
+      buckets[digit] = offset;
+      offset += size;
+    }
+
+    for (size_t i = 0;  i < count;  i++)
+    {
+      const uint32 target = buckets[(keys[i] >> shift) & DIGIT_MASK]++;
+      tempKeys[target] = keys[i];
+      tempIndices[target] = indices[i];
+    }
+
+    keys.swap(tempKeys);
+    indices.swap(tempIndices);
+  }
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
 SortKey SortKey::makeOpaqueKey(uint8 layer, uint16 state, float depth)
 {
   SortKey key;
@@ -79,14 +151,25 @@ Operation::Operation():
 
 ///////////////////////////////////////////////////////////////////////
 
-Queue::Queue():
+Queue::Queue(SortMode initMode):
+  mode(initMode),
   sorted(true)
 {
 }
 
 void Queue::addOperation(const Operation& operation, SortKey key)
 {
-  key.index = (uint16) operations.size();
+  if (mode == RADIX_SORT)
+  {
+    key.index = 0;
+    indices.push_back((uint32) operations.size());
+  }
+  else
+  {
+    assert(operations.size() <= 0xffff);
+    key.index = (uint16) operations.size();
+  }
+
   keys.push_back(key);
 
   operations.push_back(operation);
@@ -98,9 +181,50 @@ void Queue::removeOperations()
 {
   operations.clear();
   keys.clear();
+  indices.clear();
   sorted = true;
 }
 
+void Queue::append(const Queue& other)
+{
+  assert(mode == other.mode);
+
+  const size_t offset = operations.size();
+
+  if (mode == RADIX_SORT)
+  {
+    // Keys are kept paired with their indices by the radix sort, so a sorted
+    // queue can be appended as is
+    keys.insert(keys.end(), other.keys.begin(), other.keys.end());
+
+    for (auto i = other.indices.begin();  i != other.indices.end();  i++)
+      indices.push_back(uint32(offset + *i));
+  }
+  else
+  {
+    assert(offset + other.operations.size() <= 0x10000);
+
+    for (auto k = other.keys.begin();  k != other.keys.end();  k++)
+    {
+      SortKey key(*k);
+      key.index = unsigned(offset + key.index);
+      keys.push_back(key);
+    }
+  }
+
+  operations.insert(operations.end(),
+                    other.operations.begin(),
+                    other.operations.end());
+
+  if (!other.operations.empty())
+    sorted = false;
+}
+
+OperationList& Queue::getOperations()
+{
+  return operations;
+}
+
 const OperationList& Queue::getOperations() const
 {
   return operations;
@@ -109,12 +233,56 @@ const OperationList& Queue::getOperations() const
 const SortKeyList& Queue::getSortKeys() const
 {
   if (!sorted)
+    sort();
+
+  return keys;
+}
+
+const OperationIndexList& Queue::getSortedIndices() const
+{
+  if (!sorted)
+    sort();
+
+  return indices;
+}
+
+Queue::SortMode Queue::getSortMode() const
+{
+  return mode;
+}
+
+void Queue::setSortMode(SortMode newMode)
+{
+  assert(operations.empty());
+  mode = newMode;
+}
+
+void Queue::swap(Queue& other)
+{
+  operations.swap(other.operations);
+  keys.swap(other.keys);
+  tempKeys.swap(other.tempKeys);
+  indices.swap(other.indices);
+  tempIndices.swap(other.tempIndices);
+  std::swap(mode, other.mode);
+  std::swap(sorted, other.sorted);
+}
+
+void Queue::sort() const
+{
+  if (mode == RADIX_SORT)
+    radixSort(keys, indices, tempKeys, tempIndices);
+  else
   {
     std::sort(keys.begin(), keys.end());
-    sorted = true;
+
+    indices.resize(keys.size());
+
+    for (size_t i = 0;  i < keys.size();  i++)
+      indices[i] = SortKey(keys[i]).index;
   }
 
-  return keys;
+  sorted = true;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -164,6 +332,15 @@ void Scene::removeOperations()
   blendedQueue.removeOperations();
 }
 
+void Scene::append(const Scene& other)
+{
+  opaqueQueue.append(other.opaqueQueue);
+  blendedQueue.append(other.blendedQueue);
+
+  for (auto l = other.lights.begin();  l != other.lights.end();  l++)
+    attachLight(**l);
+}
+
 void Scene::attachLight(Light& light)
 {
   if (std::find(lights.begin(), lights.end(), &light) != lights.end())
@@ -227,6 +404,145 @@ void Scene::setPhase(Phase newPhase)
   phase = newPhase;
 }
 
+void Scene::swap(Scene& other)
+{
+  opaqueQueue.swap(other.opaqueQueue);
+  blendedQueue.swap(other.blendedQueue);
+  lights.swap(other.lights);
+  std::swap(ambient, other.ambient);
+  std::swap(phase, other.phase);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+Command::Command():
+  state(NULL),
+  instanceStart(0),
+  instanceCount(0)
+{
+}
+
+///////////////////////////////////////////////////////////////////////
+
+const VertexFormat CommandBuffer::instanceFormat("4f:wyInstanceM0 4f:wyInstanceM1 "
+                                                 "4f:wyInstanceM2 4f:wyInstanceM3");
+
+void CommandBuffer::begin(uint newRevision)
+{
+  commands.clear();
+  transforms.clear();
+  revision = newRevision;
+  valid = false;
+}
+
+void CommandBuffer::addCommand(const Pass& state,
+                               const GL::PrimitiveRange& range,
+                               const mat4& transform)
+{
+  commands.push_back(Command());
+
+  Command& command = commands.back();
+  command.range = range;
+  command.state = &state;
+  command.transform = transform;
+}
+
+void CommandBuffer::addInstancedCommand(const Pass& state,
+                                        const GL::PrimitiveRange& range,
+                                        const mat4* source,
+                                        size_t count)
+{
+  commands.push_back(Command());
+
+  Command& command = commands.back();
+  command.range = range;
+  command.state = &state;
+  command.instanceStart = transforms.size();
+  command.instanceCount = count;
+
+  transforms.insert(transforms.end(), source, source + count);
+}
+
+bool CommandBuffer::end()
+{
+  if (!transforms.empty())
+  {
+    if (!instances || instances->getCount() < transforms.size())
+    {
+      instances = GL::VertexBuffer::create(context,
+                                           transforms.size(),
+                                           instanceFormat,
+                                           GL::VertexBuffer::STATIC);
+      if (!instances)
+      {
+        logError("Failed to create vertex buffer for command buffer instances");
+        return false;
+      }
+    }
+
+    instances->copyFrom(&transforms[0], transforms.size());
+  }
+
+  valid = true;
+  return true;
+}
+
+void CommandBuffer::invalidate()
+{
+  valid = false;
+}
+
+bool CommandBuffer::isValid() const
+{
+  return valid;
+}
+
+bool CommandBuffer::isCurrent(uint currentRevision) const
+{
+  return valid && revision == currentRevision;
+}
+
+uint CommandBuffer::getRevision() const
+{
+  return revision;
+}
+
+const CommandList& CommandBuffer::getCommands() const
+{
+  return commands;
+}
+
+GL::VertexRange CommandBuffer::getInstances(const Command& command) const
+{
+  if (!command.instanceCount)
+    return GL::VertexRange();
+
+  return GL::VertexRange(*instances, command.instanceStart, command.instanceCount);
+}
+
+Ref<CommandBuffer> CommandBuffer::create(GL::Context& context)
+{
+  return new CommandBuffer(context);
+}
+
+CommandBuffer::CommandBuffer(GL::Context& initContext):
+  context(initContext),
+  revision(0),
+  valid(false)
+{
+}
+
+CommandBuffer::CommandBuffer(const CommandBuffer& source):
+  context(source.context)
+{
+  panic("Command buffers may not be copied");
+}
+
+CommandBuffer& CommandBuffer::operator = (const CommandBuffer& source)
+{
+  panic("Command buffers may not be assigned");
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 Renderable::~Renderable()
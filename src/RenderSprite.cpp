@@ -43,6 +43,8 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/norm.hpp>
 
+#include <algorithm>
+
 ///////////////////////////////////////////////////////////////////////
 
 namespace wendy
@@ -130,14 +132,19 @@ Sprite2::Sprite2():
 
 void Sprite2::render(GeometryPool& pool) const
 {
-  Vertex2ft2fv vertices[4];
-  realizeVertices(vertices);
-
   GL::VertexRange range;
   if (!pool.allocateVertices(range, 4, Vertex2ft2fv::format))
     return;
 
-  range.copyFrom(vertices);
+  // Realization reads back the positions, which is slow for mapped memory, so
+  // the finished vertices are written to the pool in one pass
+  {
+    Vertex2ft2fv vertices[4];
+    realizeVertices(vertices);
+
+    GL::VertexRangeLock<Vertex2ft2fv> target(range, GL::LOCK_WRITE_UNSYNCHRONIZED);
+    std::copy(vertices, vertices + 4, (Vertex2ft2fv*) target);
+  }
 
   pool.getContext().render(GL::PrimitiveRange(GL::TRIANGLE_FAN, range));
 }
@@ -190,9 +197,14 @@ void Sprite3::enqueue(Scene& scene,
   const vec3 cameraPos = camera.getTransform().position;
   const vec3 spritePos = transform.position;
 
-  Vertex2ft3fv vertices[4];
-  realizeSpriteVertices(vertices, cameraPos, spritePos, size, angle, type);
-  range.copyFrom(vertices);
+  // The vertices are realized locally and written to the pool in one pass
+  {
+    Vertex2ft3fv vertices[4];
+    realizeSpriteVertices(vertices, cameraPos, spritePos, size, angle, type);
+
+    GL::VertexRangeLock<Vertex2ft3fv> target(range, GL::LOCK_WRITE_UNSYNCHRONIZED);
+    std::copy(vertices, vertices + 4, (Vertex2ft3fv*) target);
+  }
 
   scene.createOperations(Transform3::IDENTITY,
                          GL::PrimitiveRange(GL::TRIANGLE_FAN, range),
@@ -48,11 +48,38 @@ bool samplerTypeMatchesTextureType(GL::SamplerType samplerType,
   return (int) samplerType == (int) textureType;
 }
 
+// These mirror the std140 layout of the shared uniform blocks reserved by
+// SharedProgramState::reserveSupported
+
+struct FrameBlock
+{
+  mat4 V;
+  mat4 P;
+  mat4 VP;
+  vec3 cameraPos;
+  float cameraNearZ;
+  float cameraFarZ;
+  float cameraAspect;
+  float cameraFOV;
+  float viewportWidth;
+  float viewportHeight;
+  float time;
+  float padding[2];
+};
+
+struct ObjectBlock
+{
+  mat4 M;
+  mat4 MV;
+  mat4 MVP;
+};
+
 } /*namespace*/
 
 ///////////////////////////////////////////////////////////////////////
 
-SharedProgramState::SharedProgramState():
+SharedProgramState::SharedProgramState(Mode initMode):
+  mode(initMode),
   dirtyModelView(true),
   dirtyViewProj(true),
   dirtyModelViewProj(true),
@@ -68,6 +95,45 @@ SharedProgramState::SharedProgramState():
 
 bool SharedProgramState::reserveSupported(GL::Context& context) const
 {
+  if (mode == BUFFER_MODE)
+  {
+    if (!context.isUniformBufferSupported())
+    {
+      logWarning("Uniform buffers not supported; using plain shared uniforms");
+    }
+    else if (context.getSharedUniformBlockID("wyFrame") == GL::INVALID_SHARED_STATE_ID &&
+             context.getSharedUniformID("wyP", GL::UNIFORM_MAT4) != GL::INVALID_SHARED_STATE_ID)
+    {
+      logWarning("Shared uniforms already reserved outside of uniform blocks; using plain shared uniforms");
+    }
+    else
+    {
+      if (!context.createSharedUniformBlock("wyFrame", SHARED_FRAME_BLOCK))
+        return false;
+
+      context.createSharedUniform("wyV", GL::UNIFORM_MAT4, SHARED_VIEW_MATRIX, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyP", GL::UNIFORM_MAT4, SHARED_PROJECTION_MATRIX, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyVP", GL::UNIFORM_MAT4, SHARED_VIEWPROJECTION_MATRIX, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyCameraPosition", GL::UNIFORM_VEC3, SHARED_CAMERA_POSITION, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyCameraNearZ", GL::UNIFORM_FLOAT, SHARED_CAMERA_NEAR_Z, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyCameraFarZ", GL::UNIFORM_FLOAT, SHARED_CAMERA_FAR_Z, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyCameraAspectRatio", GL::UNIFORM_FLOAT, SHARED_CAMERA_ASPECT_RATIO, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyCameraFOV", GL::UNIFORM_FLOAT, SHARED_CAMERA_FOV, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyViewportWidth", GL::UNIFORM_FLOAT, SHARED_VIEWPORT_WIDTH, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyViewportHeight", GL::UNIFORM_FLOAT, SHARED_VIEWPORT_HEIGHT, SHARED_FRAME_BLOCK);
+      context.createSharedUniform("wyTime", GL::UNIFORM_FLOAT, SHARED_TIME, SHARED_FRAME_BLOCK);
+
+      if (!context.createSharedUniformBlock("wyObject", SHARED_OBJECT_BLOCK))
+        return false;
+
+      context.createSharedUniform("wyM", GL::UNIFORM_MAT4, SHARED_MODEL_MATRIX, SHARED_OBJECT_BLOCK);
+      context.createSharedUniform("wyMV", GL::UNIFORM_MAT4, SHARED_MODELVIEW_MATRIX, SHARED_OBJECT_BLOCK);
+      context.createSharedUniform("wyMVP", GL::UNIFORM_MAT4, SHARED_MODELVIEWPROJECTION_MATRIX, SHARED_OBJECT_BLOCK);
+
+      return true;
+    }
+  }
+
   context.createSharedUniform("wyM", GL::UNIFORM_MAT4, SHARED_MODEL_MATRIX);
   context.createSharedUniform("wyV", GL::UNIFORM_MAT4, SHARED_VIEW_MATRIX);
   context.createSharedUniform("wyP", GL::UNIFORM_MAT4, SHARED_PROJECTION_MATRIX);
@@ -89,6 +155,11 @@ bool SharedProgramState::reserveSupported(GL::Context& context) const
   return true;
 }
 
+SharedProgramState::Mode SharedProgramState::getMode() const
+{
+  return mode;
+}
+
 const mat4& SharedProgramState::getModelMatrix() const
 {
   return modelMatrix;
@@ -325,6 +396,74 @@ void SharedProgramState::updateTo(GL::Uniform& uniform)
            uniform.getName().c_str());
 }
 
+void SharedProgramState::updateTo(GL::UniformBlock& block)
+{
+  switch (block.getSharedID())
+  {
+    case SHARED_FRAME_BLOCK:
+    {
+      if (dirtyViewProj)
+      {
+        viewProjMatrix = projectionMatrix;
+        viewProjMatrix *= viewMatrix;
+        dirtyViewProj = false;
+      }
+
+      FrameBlock data;
+      data.V = viewMatrix;
+      data.P = projectionMatrix;
+      data.VP = viewProjMatrix;
+      data.cameraPos = cameraPos;
+      data.cameraNearZ = cameraNearZ;
+      data.cameraFarZ = cameraFarZ;
+      data.cameraAspect = cameraAspect;
+      data.cameraFOV = cameraFOV;
+      data.viewportWidth = viewportWidth;
+      data.viewportHeight = viewportHeight;
+      data.time = time;
+      data.padding[0] = data.padding[1] = 0.f;
+
+      block.copyFrom(&data);
+      return;
+    }
+
+    case SHARED_OBJECT_BLOCK:
+    {
+      if (dirtyModelView)
+      {
+        modelViewMatrix = viewMatrix;
+        modelViewMatrix *= modelMatrix;
+        dirtyModelView = false;
+      }
+
+      if (dirtyModelViewProj)
+      {
+        if (dirtyViewProj)
+        {
+          viewProjMatrix = projectionMatrix;
+          viewProjMatrix *= viewMatrix;
+          dirtyViewProj = false;
+        }
+
+        modelViewProjMatrix = viewProjMatrix;
+        modelViewProjMatrix *= modelMatrix;
+        dirtyModelViewProj = false;
+      }
+
+      ObjectBlock data;
+      data.M = modelMatrix;
+      data.MV = modelViewMatrix;
+      data.MVP = modelViewProjMatrix;
+
+      block.copyFrom(&data);
+      return;
+    }
+  }
+
+  logError("Unknown shared uniform block \'%s\' requested",
+           block.getName().c_str());
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 UniformStateIndex::UniformStateIndex():
@@ -412,6 +551,17 @@ void ProgramState::apply() const
     textureUnit++;
   }
 
+  for (uint i = 0;  i < program->getUniformBlockCount();  i++)
+  {
+    GL::UniformBlock& block = program->getUniformBlock(i);
+    if (state)
+      state->updateTo(block);
+    else
+      logError("Program \'%s\' uses shared uniform block \'%s\' without a current shared program state",
+               program->getName().c_str(),
+               block.getName().c_str());
+  }
+
   size_t offset = 0;
 
   for (uint i = 0;  i < program->getUniformCount();  i++)
@@ -26,10 +26,34 @@
 #include <wendy/Config.h>
 
 #include <wendy/Core.h>
+#include <wendy/Timer.h>
 #include <wendy/Path.h>
 #include <wendy/Resource.h>
 
+#if WENDY_HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#if WENDY_HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if WENDY_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if WENDY_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if WENDY_HAVE_WINDOWS_H
+#include <windows.h>
+#endif
+
 #include <algorithm>
+#include <cstring>
+
+#include <pugixml.hpp>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -38,6 +62,340 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+const uint32 PACK_MAGIC = 0x4b415057;
+const uint32 PACK_VERSION = 1;
+const uint64 PACK_ALIGNMENT = 16;
+
+// Header at the start of a pack file, followed by the file bodies and then
+// the table of contents.  Each table entry is the offset and size of a file
+// body followed by the length and characters of its name.
+struct PackHeader
+{
+  uint32 magic;
+  uint32 version;
+  uint32 count;
+  uint32 reserved;
+  uint64 tableOffset;
+};
+
+bool collectFiles(const Path& directory, PathList& files)
+{
+  PathList children;
+  if (!directory.getChildren(children))
+    return false;
+
+  for (auto c = children.begin();  c != children.end();  c++)
+  {
+    const String name = c->asString().substr(directory.asString().length() + 1);
+    if (name == "." || name == "..")
+      continue;
+
+    if (c->isDirectory())
+    {
+      if (!collectFiles(*c, files))
+        return false;
+    }
+    else if (c->isFile())
+      files.push_back(*c);
+  }
+
+  return true;
+}
+
+// Threads currently running as workers of any resource loader
+std::mutex workerThreadMutex;
+std::vector<std::thread::id> workerThreads;
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
+ResourcePack::~ResourcePack()
+{
+#if WENDY_SYSTEM_WIN32
+  if (data)
+    UnmapViewOfFile(data);
+  if (mapping)
+    CloseHandle((HANDLE) mapping);
+  if (file)
+    CloseHandle((HANDLE) file);
+#else
+  if (data)
+    munmap((void*) data, size);
+#endif
+}
+
+const char* ResourcePack::findFile(const String& name, size_t& fileSize) const
+{
+  auto e = entries.find(name);
+  if (e == entries.end())
+    return NULL;
+
+  fileSize = (size_t) e->second.size;
+  return data + e->second.offset;
+}
+
+const Path& ResourcePack::getPath() const
+{
+  return path;
+}
+
+bool ResourcePack::isPack(const Path& path)
+{
+  std::ifstream stream(path.asString().c_str(), std::ios::in | std::ios::binary);
+  if (stream.fail())
+    return false;
+
+  uint32 magic;
+  if (!stream.read((char*) &magic, sizeof(magic)))
+    return false;
+
+  return magic == PACK_MAGIC;
+}
+
+Ref<ResourcePack> ResourcePack::open(const Path& path)
+{
+  Ref<ResourcePack> pack(new ResourcePack(path));
+  if (!pack->init())
+    return NULL;
+
+  return pack;
+}
+
+bool ResourcePack::write(const Path& path, const Path& root)
+{
+  PathList files;
+
+  if (!collectFiles(root, files))
+  {
+    logError("Failed to list files in directory \'%s\'",
+             root.asString().c_str());
+    return false;
+  }
+
+  std::ofstream stream(path.asString().c_str(), std::ios::out | std::ios::binary);
+  if (stream.fail())
+  {
+    logError("Failed to create pack \'%s\'", path.asString().c_str());
+    return false;
+  }
+
+  PackHeader header;
+  header.magic = PACK_MAGIC;
+  header.version = PACK_VERSION;
+  header.count = files.size();
+  header.reserved = 0;
+  header.tableOffset = 0;
+
+  stream.write((const char*) &header, sizeof(header));
+
+  std::vector<Entry> written;
+  std::vector<char> body;
+
+  for (auto f = files.begin();  f != files.end();  f++)
+  {
+    std::ifstream source(f->asString().c_str(), std::ios::in | std::ios::binary);
+    if (source.fail())
+    {
+      logError("Failed to open file \'%s\'", f->asString().c_str());
+      return false;
+    }
+
+    source.seekg(0, std::ios::end);
+    body.resize((size_t) source.tellg());
+    source.seekg(0, std::ios::beg);
+
+    if (!body.empty())
+      source.read(&body[0], body.size());
+
+    // Align file bodies so that mapped data may be used in place
+    const uint64 start = (uint64) stream.tellp();
+    const uint64 padding = (PACK_ALIGNMENT - start % PACK_ALIGNMENT) % PACK_ALIGNMENT;
+
+    for (uint64 i = 0;  i < padding;  i++)
+      stream.put('\0');
+
+    Entry entry;
+    entry.offset = start + padding;
+    entry.size = body.size();
+    written.push_back(entry);
+
+    if (!body.empty())
+      stream.write(&body[0], body.size());
+  }
+
+  header.tableOffset = (uint64) stream.tellp();
+
+  for (size_t i = 0;  i < files.size();  i++)
+  {
+    const String name = files[i].asString().substr(root.asString().length() + 1);
+    const uint32 length = name.length();
+
+    stream.write((const char*) &written[i], sizeof(Entry));
+    stream.write((const char*) &length, sizeof(length));
+    stream.write(name.c_str(), length);
+  }
+
+  stream.seekp(0, std::ios::beg);
+  stream.write((const char*) &header, sizeof(header));
+
+  if (stream.fail())
+  {
+    logError("Failed to write pack \'%s\'", path.asString().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+ResourcePack::ResourcePack(const Path& initPath):
+  path(initPath),
+  data(NULL),
+  size(0),
+  file(NULL),
+  mapping(NULL)
+{
+}
+
+ResourcePack::ResourcePack(const ResourcePack& source)
+{
+  panic("Resource packs may not be copied");
+}
+
+ResourcePack& ResourcePack::operator = (const ResourcePack& source)
+{
+  panic("Resource packs may not be assigned");
+}
+
+bool ResourcePack::init()
+{
+#if WENDY_SYSTEM_WIN32
+  HANDLE handle = CreateFile(path.asString().c_str(),
+                             GENERIC_READ,
+                             FILE_SHARE_READ,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             NULL);
+  if (handle == INVALID_HANDLE_VALUE)
+  {
+    logError("Failed to open pack \'%s\'", path.asString().c_str());
+    return false;
+  }
+
+  file = handle;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(handle, &fileSize) ||
+      uint64(size_t(fileSize.QuadPart)) != uint64(fileSize.QuadPart))
+  {
+    logError("Failed to retrieve size of pack \'%s\'",
+             path.asString().c_str());
+    return false;
+  }
+
+  size = size_t(fileSize.QuadPart);
+
+  mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping)
+    data = (const char*) MapViewOfFile((HANDLE) mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+  const int descriptor = ::open(path.asString().c_str(), O_RDONLY);
+  if (descriptor == -1)
+  {
+    logError("Failed to open pack \'%s\'", path.asString().c_str());
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(descriptor, &info) == 0)
+  {
+    size = info.st_size;
+
+    void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address != MAP_FAILED)
+      data = (const char*) address;
+  }
+
+  // The mapping keeps its own reference to the file
+  close(descriptor);
+#endif
+
+  if (!data)
+  {
+    logError("Failed to map pack \'%s\'", path.asString().c_str());
+    return false;
+  }
+
+  PackHeader header;
+
+  if (size < sizeof(header))
+  {
+    logError("Pack \'%s\' is truncated", path.asString().c_str());
+    return false;
+  }
+
+  std::memcpy(&header, data, sizeof(header));
+
+  if (header.magic != PACK_MAGIC || header.version != PACK_VERSION)
+  {
+    logError("File \'%s\' is not a supported pack", path.asString().c_str());
+    return false;
+  }
+
+  // Checks are written as subtractions from the size, as the sums of
+  // untrusted offsets and sizes may overflow
+
+  if (header.tableOffset > size ||
+      header.count > (size - header.tableOffset) / (sizeof(Entry) + sizeof(uint32)))
+  {
+    logError("Table of contents of pack \'%s\' is truncated",
+             path.asString().c_str());
+    return false;
+  }
+
+  entries.reserve(header.count);
+
+  uint64 offset = header.tableOffset;
+
+  for (uint32 i = 0;  i < header.count;  i++)
+  {
+    Entry entry;
+    uint32 length;
+
+    if (sizeof(entry) + sizeof(length) > size - offset)
+    {
+      logError("Table of contents of pack \'%s\' is truncated",
+               path.asString().c_str());
+      return false;
+    }
+
+    std::memcpy(&entry, data + offset, sizeof(entry));
+    offset += sizeof(entry);
+
+    std::memcpy(&length, data + offset, sizeof(length));
+    offset += sizeof(length);
+
+    if (length > size - offset ||
+        entry.size > size || entry.offset > size - entry.size)
+    {
+      logError("Table of contents of pack \'%s\' is corrupt",
+               path.asString().c_str());
+      return false;
+    }
+
+    entries[String(data + offset, length)] = entry;
+    offset += length;
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////
+
 ResourceInfo::ResourceInfo(ResourceCache& initCache,
                            const String& initName,
                            const Path& initPath):
@@ -52,19 +410,29 @@ ResourceInfo::ResourceInfo(ResourceCache& initCache,
 Resource::Resource(const ResourceInfo& info):
   cache(info.cache),
   name(info.name),
+  hash(0),
   path(info.path)
 {
   if (!name.empty())
   {
-    if (cache.findResource(name))
+    hash = hashString(name);
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    if (cache.findEntryLocked(name, hash))
       panic("Duplicate name for resource \'%s\'", name.c_str());
 
-    cache.resources.push_back(this);
+    ResourceCache::Entry entry;
+    entry.resource = this;
+    entry.reference = this;
+
+    cache.resources.insert(std::make_pair(hash, entry));
   }
 }
 
 Resource::Resource(const Resource& source):
-  cache(source.cache)
+  cache(source.cache),
+  hash(0)
 {
 }
 
@@ -72,9 +440,18 @@ Resource::~Resource()
 {
   if (!name.empty())
   {
-    cache.resources.erase(std::find(cache.resources.begin(),
-                                    cache.resources.end(),
-                                    this));
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    auto range = cache.resources.equal_range(hash);
+
+    for (auto r = range.first;  r != range.second;  r++)
+    {
+      if (r->second.resource == this)
+      {
+        cache.resources.erase(r);
+        break;
+      }
+    }
   }
 }
 
@@ -108,6 +485,20 @@ ResourceCache::~ResourceCache()
 
 bool ResourceCache::addSearchPath(const Path& path)
 {
+  if (std::find(paths.begin(), paths.end(), path) != paths.end())
+    return true;
+
+  if (path.isFile() && ResourcePack::isPack(path))
+  {
+    Ref<ResourcePack> pack = ResourcePack::open(path);
+    if (!pack)
+      return false;
+
+    paths.push_back(path);
+    packs.push_back(pack);
+    return true;
+  }
+
   if (!path.isDirectory())
   {
     logError("Resource search path \'%s\' does not exist",
@@ -115,23 +506,56 @@ bool ResourceCache::addSearchPath(const Path& path)
     return false;
   }
 
-  if (std::find(paths.begin(), paths.end(), path) == paths.end())
-    paths.push_back(path);
-
+  paths.push_back(path);
+  packs.push_back(NULL);
   return true;
 }
 
 void ResourceCache::removeSearchPath(const Path& path)
 {
-  paths.erase(std::find(paths.begin(), paths.end(), path));
+  auto p = std::find(paths.begin(), paths.end(), path);
+  if (p == paths.end())
+    return;
+
+  packs.erase(packs.begin() + (p - paths.begin()));
+  paths.erase(p);
+}
+
+Ref<Resource> ResourceCache::findResource(const String& name) const
+{
+  return findResource(name, hashString(name));
+}
+
+Ref<Resource> ResourceCache::findResource(const String& name, StringHash hash) const
+{
+  Ref<Resource> resource;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // The reference is made while the resource is still known to be alive,
+    // and dropped, if it is the last one, only after the lock is released
+    if (const Entry* entry = findEntryLocked(name, hash))
+      resource = entry->reference.lock();
+  }
+
+  return resource;
 }
 
-Resource* ResourceCache::findResource(const String& name) const
+const ResourceCache::Entry* ResourceCache::findEntryLocked(const String& name,
+                                                           StringHash hash) const
 {
-  for (auto r = resources.begin();  r != resources.end();  r++)
+  auto range = resources.equal_range(hash);
+
+  for (auto r = range.first;  r != range.second;  r++)
   {
-    if ((*r)->getName() == name)
-      return *r;
+    // Resources whose last reference is gone are being destroyed and will
+    // remove themselves once they get the lock
+    if (r->second.reference.isExpired())
+      continue;
+
+    if (r->second.resource->getName() == name)
+      return &(r->second);
   }
 
   return NULL;
@@ -147,17 +571,48 @@ Path ResourceCache::findFile(const String& name) const
   }
   else
   {
-    for (auto p = paths.begin();  p != paths.end();  p++)
+    for (size_t i = 0;  i < paths.size();  i++)
     {
-      const Path full(*p + name);
-      if (full.isFile())
-        return full;
+      if (packs[i])
+      {
+        size_t size;
+        if (packs[i]->findFile(name, size))
+          return paths[i] + name;
+      }
+      else
+      {
+        const Path full(paths[i] + name);
+        if (full.isFile())
+          return full;
+      }
     }
   }
 
   return Path();
 }
 
+const char* ResourceCache::findPackedFile(const Path& path, size_t& size) const
+{
+  const String& full = path.asString();
+
+  for (size_t i = 0;  i < packs.size();  i++)
+  {
+    if (!packs[i])
+      continue;
+
+    const String& root = paths[i].asString();
+
+    if (full.length() > root.length() &&
+        full[root.length()] == '/' &&
+        full.compare(0, root.length(), root) == 0)
+    {
+      return packs[i]->findFile(full.substr(root.length() + 1), size);
+    }
+  }
+
+  return NULL;
+}
+
 const PathList& ResourceCache::getSearchPaths() const
 {
   return paths;
@@ -165,6 +620,295 @@ const PathList& ResourceCache::getSearchPaths() const
 
 ///////////////////////////////////////////////////////////////////////
 
+ResourceStream::ResourceStream(const ResourceCache& cache, const Path& path):
+  std::istream(NULL),
+  data(NULL),
+  size(0)
+{
+  data = cache.findPackedFile(path, size);
+  if (data)
+  {
+    memory.setData(data, size);
+    rdbuf(&memory);
+  }
+  else
+  {
+    if (file.open(path.asString().c_str(), std::ios::in | std::ios::binary))
+      rdbuf(&file);
+    else
+      setstate(std::ios::failbit);
+  }
+}
+
+void ResourceStream::close()
+{
+  if (file.is_open())
+    file.close();
+}
+
+const char* ResourceStream::getData() const
+{
+  return data;
+}
+
+size_t ResourceStream::getSize() const
+{
+  return size;
+}
+
+void ResourceStream::MemoryBuffer::setData(const char* data, size_t size)
+{
+  char* start = const_cast<char*>(data);
+  setg(start, start, start + size);
+}
+
+ResourceStream::MemoryBuffer::pos_type
+ResourceStream::MemoryBuffer::seekoff(off_type offset,
+                                      std::ios::seekdir direction,
+                                      std::ios::openmode)
+{
+  char* position;
+
+  if (direction == std::ios::beg)
+    position = eback() + offset;
+  else if (direction == std::ios::cur)
+    position = gptr() + offset;
+  else
+    position = egptr() + offset;
+
+  if (position < eback() || position > egptr())
+    return pos_type(off_type(-1));
+
+  setg(eback(), position, egptr());
+  return pos_type(position - eback());
+}
+
+ResourceStream::MemoryBuffer::pos_type
+ResourceStream::MemoryBuffer::seekpos(pos_type position, std::ios::openmode mode)
+{
+  return seekoff(off_type(position), std::ios::beg, mode);
+}
+
+///////////////////////////////////////////////////////////////////////
+
+ResourceDocument::~ResourceDocument()
+{
+}
+
+const pugi::xml_document& ResourceDocument::getDocument() const
+{
+  return *document;
+}
+
+const Path& ResourceDocument::getPath() const
+{
+  return path;
+}
+
+Ref<ResourceDocument> ResourceDocument::read(const ResourceCache& cache,
+                                             const String& name,
+                                             const Path& path)
+{
+  ResourceStream stream(cache, path);
+  if (stream.fail())
+  {
+    logError("Failed to open resource \'%s\'", name.c_str());
+    return NULL;
+  }
+
+  Ref<ResourceDocument> document(new ResourceDocument(path));
+
+  const pugi::xml_parse_result result = document->document->load(stream);
+  if (!result)
+  {
+    logError("Failed to load resource \'%s\': %s",
+             name.c_str(),
+             result.description());
+    return NULL;
+  }
+
+  return document;
+}
+
+ResourceDocument::ResourceDocument(const Path& initPath):
+  document(new pugi::xml_document()),
+  path(initPath)
+{
+}
+
+ResourceDocument::ResourceDocument(const ResourceDocument& source)
+{
+  panic("Resource documents may not be copied");
+}
+
+ResourceDocument& ResourceDocument::operator = (const ResourceDocument& source)
+{
+  panic("Resource documents may not be assigned");
+}
+
+///////////////////////////////////////////////////////////////////////
+
+ResourceLoader::~ResourceLoader()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  condition.notify_all();
+
+  for (auto t = threads.begin();  t != threads.end();  t++)
+    t->join();
+
+  for (auto j = queued.begin();  j != queued.end();  j++)
+    delete *j;
+
+  for (auto j = finished.begin();  j != finished.end();  j++)
+    delete *j;
+}
+
+void ResourceLoader::update(Time budget)
+{
+  const Time start = Timer::getCurrentTime();
+
+  for (;;)
+  {
+    Job* job;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (finished.empty())
+        break;
+
+      job = finished.front();
+      finished.pop_front();
+    }
+
+    pending.erase(job->name);
+
+    job->finish();
+    delete job;
+
+    if (Timer::getCurrentTime() - start >= budget)
+      break;
+  }
+}
+
+bool ResourceLoader::isWorkerThread()
+{
+  std::lock_guard<std::mutex> workerLock(workerThreadMutex);
+
+  return std::find(workerThreads.begin(),
+                   workerThreads.end(),
+                   std::this_thread::get_id()) != workerThreads.end();
+}
+
+size_t ResourceLoader::getPendingCount() const
+{
+  return pending.size();
+}
+
+ResourceCache& ResourceLoader::getCache() const
+{
+  return cache;
+}
+
+Ref<ResourceLoader> ResourceLoader::create(ResourceCache& cache, uint threadCount)
+{
+  Ref<ResourceLoader> loader(new ResourceLoader(cache));
+  if (!loader->init(threadCount))
+    return NULL;
+
+  return loader;
+}
+
+ResourceLoader::ResourceLoader(ResourceCache& initCache):
+  cache(initCache),
+  stopping(false)
+{
+}
+
+ResourceLoader::ResourceLoader(const ResourceLoader& source):
+  cache(source.cache)
+{
+  panic("Resource loaders may not be copied");
+}
+
+ResourceLoader& ResourceLoader::operator = (const ResourceLoader& source)
+{
+  panic("Resource loaders may not be assigned");
+}
+
+bool ResourceLoader::init(uint threadCount)
+{
+  if (!threadCount)
+  {
+    const uint hardwareCount = std::thread::hardware_concurrency();
+    if (hardwareCount > 1)
+      threadCount = hardwareCount - 1;
+    else
+      threadCount = 1;
+  }
+
+  for (uint i = 0;  i < threadCount;  i++)
+    threads.push_back(std::thread(&ResourceLoader::run, this));
+
+  return true;
+}
+
+void ResourceLoader::submit(Job* job, const String& name, RefObject* future)
+{
+  job->name = name;
+  pending[name] = future;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.push_back(job);
+  }
+
+  condition.notify_one();
+}
+
+void ResourceLoader::run()
+{
+  {
+    std::lock_guard<std::mutex> workerLock(workerThreadMutex);
+    workerThreads.push_back(std::this_thread::get_id());
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;)
+  {
+    while (queued.empty() && !stopping)
+      condition.wait(lock);
+
+    if (stopping)
+      break;
+
+    Job* job = queued.front();
+    queued.pop_front();
+
+    lock.unlock();
+    job->work();
+    lock.lock();
+
+    finished.push_back(job);
+  }
+
+  lock.unlock();
+
+  {
+    std::lock_guard<std::mutex> workerLock(workerThreadMutex);
+    workerThreads.erase(std::find(workerThreads.begin(),
+                                  workerThreads.end(),
+                                  std::this_thread::get_id()));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////
+
 } /*namespace wendy*/
 
 ///////////////////////////////////////////////////////////////////////
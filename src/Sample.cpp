@@ -60,6 +60,34 @@ const char* getErrorString(int error)
   return "Unknown vorbisfile error";
 }
 
+size_t readStreamVorbis(void* data, size_t size, size_t count, void* source)
+{
+  std::istream* stream = reinterpret_cast<std::istream*>(source);
+  stream->read((char*) data, size * count);
+  return stream->gcount() / size;
+}
+
+int seekStreamVorbis(void* source, ogg_int64_t offset, int whence)
+{
+  std::istream* stream = reinterpret_cast<std::istream*>(source);
+  stream->clear();
+
+  if (whence == SEEK_SET)
+    stream->seekg(offset, std::ios::beg);
+  else if (whence == SEEK_CUR)
+    stream->seekg(offset, std::ios::cur);
+  else
+    stream->seekg(offset, std::ios::end);
+
+  return stream->fail() ? -1 : 0;
+}
+
+long tellStreamVorbis(void* source)
+{
+  std::istream* stream = reinterpret_cast<std::istream*>(source);
+  return (long) stream->tellg();
+}
+
 } /*namespace*/
 
 ///////////////////////////////////////////////////////////////////////
@@ -91,10 +119,23 @@ SampleReader::SampleReader(ResourceCache& cache):
 
 Ref<Sample> SampleReader::read(const String& name, const Path& path)
 {
+  ResourceStream stream(cache, path);
+  if (stream.fail())
+  {
+    logError("Failed to open audio file \'%s\'", path.asString().c_str());
+    return NULL;
+  }
+
+  ov_callbacks callbacks;
+  callbacks.read_func = readStreamVorbis;
+  callbacks.seek_func = seekStreamVorbis;
+  callbacks.close_func = NULL;
+  callbacks.tell_func = tellStreamVorbis;
+
   int result;
   OggVorbis_File file;
 
-  result = ov_fopen(path.asString().c_str(), &file);
+  result = ov_open_callbacks(static_cast<std::istream*>(&stream), &file, NULL, 0, callbacks);
   if (result)
   {
     logError("Failed to open audio file \'%s\': %s",
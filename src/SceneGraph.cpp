@@ -28,6 +28,7 @@
 #include <wendy/Core.h>
 #include <wendy/Timer.h>
 #include <wendy/Profile.h>
+#include <wendy/Job.h>
 #include <wendy/Transform.h>
 #include <wendy/AABB.h>
 #include <wendy/Plane.h>
@@ -48,7 +49,10 @@
 
 #include <wendy/SceneGraph.h>
 
+#include <glm/gtx/norm.hpp>
+
 #include <algorithm>
+#include <unordered_map>
 
 ///////////////////////////////////////////////////////////////////////
 
@@ -59,11 +63,112 @@ namespace wendy
 
 ///////////////////////////////////////////////////////////////////////
 
+namespace
+{
+
+// Number of nodes whose bounds are gathered and culled together
+const size_t CULL_BATCH_SIZE = 64;
+
+// Smallest number of nodes for which updating or enqueueing is spread over
+// the job system of a graph
+const size_t PARALLEL_NODE_COUNT = 64;
+
+// Fraction of its bounding radius by which the box of each node in a node
+// tree is enlarged, to avoid moving the node for every small change
+const float TREE_MARGIN = 0.1f;
+
+// Smallest number of children for which a node keeps them in a node tree
+const size_t CHILD_TREE_SIZE = 64;
+
+enum Containment
+{
+  OUTSIDE,
+  INTERSECTING,
+  INSIDE
+};
+
+float getCost(const vec3& minimum, const vec3& maximum)
+{
+  const vec3 size = maximum - minimum;
+  return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+Containment classify(const Frustum& frustum,
+                     const vec3& minimum,
+                     const vec3& maximum)
+{
+  Containment result = INSIDE;
+
+  for (size_t i = 0;  i < 6;  i++)
+  {
+    const Plane& plane = frustum.planes[i];
+
+    const vec3 negative(plane.normal.x < 0.f ? maximum.x : minimum.x,
+                        plane.normal.y < 0.f ? maximum.y : minimum.y,
+                        plane.normal.z < 0.f ? maximum.z : minimum.z);
+
+    if (!plane.contains(negative))
+      return OUTSIDE;
+
+    const vec3 positive(plane.normal.x < 0.f ? minimum.x : maximum.x,
+                        plane.normal.y < 0.f ? minimum.y : maximum.y,
+                        plane.normal.z < 0.f ? minimum.z : maximum.z);
+
+    if (!plane.contains(positive))
+      result = INTERSECTING;
+  }
+
+  return result;
+}
+
+// Culls the world space bounds of the specified nodes against the frustum,
+// setting the corresponding element of the results to zero for each node
+// that is outside it
+void cullNodes(Node* const* nodes,
+               size_t count,
+               const Frustum& frustum,
+               uint8* results)
+{
+  float centerX[CULL_BATCH_SIZE];
+  float centerY[CULL_BATCH_SIZE];
+  float centerZ[CULL_BATCH_SIZE];
+  float radius[CULL_BATCH_SIZE];
+
+  assert(count <= CULL_BATCH_SIZE);
+
+  for (size_t i = 0;  i < count;  i++)
+  {
+    Sphere worldBounds = nodes[i]->getTotalBounds();
+    worldBounds.transformBy(nodes[i]->getWorldTransform());
+
+    centerX[i] = worldBounds.center.x;
+    centerY[i] = worldBounds.center.y;
+    centerZ[i] = worldBounds.center.z;
+    radius[i] = worldBounds.radius;
+  }
+
+  frustum.intersects(centerX, centerY, centerZ, radius, count, results);
+}
+
+bool isSameTransform(const Transform3& a, const Transform3& b)
+{
+  return a.position == b.position && a.rotation == b.rotation && a.scale == b.scale;
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
 Node::Node(bool initNeedsUpdate):
   needsUpdate(initNeedsUpdate),
   parent(NULL),
   graph(NULL),
-  dirtyWorld(false),
+  proxy(NodeTree::NONE),
+  dirtyTree(false),
+  childProxy(NodeTree::NONE),
+  dirtyChildProxy(false),
+  dirtyChildTree(true),
+  slot(TransformHierarchy::NONE),
   dirtyBounds(false)
 {
 }
@@ -84,9 +189,23 @@ bool Node::addChild(Node& child)
   children.push_back(&child);
   child.parent = this;
   child.setGraph(graph);
+
+  if (childTree)
+    child.childProxy = childTree->insert(child, child.getWorldBounds());
+  else if (children.size() >= CHILD_TREE_SIZE)
+  {
+    // The tree is filled the first time it is used
+    childTree = new NodeTree();
+    dirtyChildTree = true;
+
+    for (auto c = children.begin();  c != children.end();  c++)
+      (*c)->childProxy = childTree->insert(**c, Sphere());
+  }
+
   child.invalidateWorldTransform();
 
   invalidateBounds();
+  invalidateGraph();
   return true;
 }
 
@@ -94,11 +213,26 @@ void Node::removeFromParent()
 {
   if (parent || graph)
   {
+    invalidateGraph();
+
     if (parent)
     {
       List& siblings = parent->children;
       siblings.erase(std::find(siblings.begin(), siblings.end(), this));
 
+      if (parent->childTree)
+      {
+        parent->childTree->remove(childProxy);
+        childProxy = NodeTree::NONE;
+
+        if (dirtyChildProxy)
+        {
+          List& moved = parent->movedChildren;
+          moved.erase(std::find(moved.begin(), moved.end(), this));
+          dirtyChildProxy = false;
+        }
+      }
+
       parent->invalidateBounds();
       parent = NULL;
 
@@ -108,6 +242,16 @@ void Node::removeFromParent()
     {
       List& roots = graph->roots;
       roots.erase(std::find(roots.begin(), roots.end(), this));
+
+      graph->tree.remove(proxy);
+      proxy = NodeTree::NONE;
+
+      if (dirtyTree)
+      {
+        List& moved = graph->moved;
+        moved.erase(std::find(moved.begin(), moved.end(), this));
+        dirtyTree = false;
+      }
     }
 
     setGraph(NULL);
@@ -166,6 +310,7 @@ void Node::setLocalTransform(const Transform3& newTransform)
     parent->invalidateBounds();
 
   invalidateWorldTransform();
+  invalidateGraph();
 }
 
 void Node::setLocalPosition(const vec3& newPosition)
@@ -176,6 +321,7 @@ void Node::setLocalPosition(const vec3& newPosition)
     parent->invalidateBounds();
 
   invalidateWorldTransform();
+  invalidateGraph();
 }
 
 void Node::setLocalRotation(const quat& newRotation)
@@ -186,6 +332,7 @@ void Node::setLocalRotation(const quat& newRotation)
     parent->invalidateBounds();
 
   invalidateWorldTransform();
+  invalidateGraph();
 }
 
 void Node::setLocalScale(float newScale)
@@ -196,21 +343,21 @@ void Node::setLocalScale(float newScale)
     parent->invalidateBounds();
 
   invalidateWorldTransform();
+  invalidateGraph();
 }
 
 const Transform3& Node::getWorldTransform() const
 {
-  if (dirtyWorld)
-  {
-    if (parent)
-      world = parent->getWorldTransform() * local;
-    else
-      world = local;
+  if (graph)
+    return graph->transforms.getWorldTransform(slot);
 
-    dirtyWorld = false;
+  if (parent)
+  {
+    world = parent->getWorldTransform() * local;
+    return world;
   }
 
-  return world;
+  return local;
 }
 
 const Sphere& Node::getLocalBounds() const
@@ -222,6 +369,7 @@ void Node::setLocalBounds(const Sphere& newBounds)
 {
   localBounds = newBounds;
   invalidateBounds();
+  invalidateGraph();
 }
 
 const Sphere& Node::getTotalBounds() const
@@ -253,18 +401,22 @@ void Node::update()
 
 void Node::enqueue(render::Scene& scene, const Camera& camera) const
 {
-  const Frustum& frustum = camera.getFrustum();
-
-  const List& children = getChildren();
-
-  for (auto c = children.begin();  c != children.end();  c++)
+  if (childTree && updateChildTree())
   {
-    Sphere worldBounds = (*c)->getTotalBounds();
-    worldBounds.transformBy((*c)->getWorldTransform());
+    List visible;
+    childTree->query(camera.getFrustum(), visible);
 
-    if (frustum.intersects(worldBounds))
+    for (auto c = visible.begin();  c != visible.end();  c++)
       (*c)->enqueue(scene, camera);
   }
+  else
+    enqueueNodes(getChildren(), scene, camera);
+}
+
+void Node::invalidateGraph()
+{
+  if (graph)
+    graph->revision++;
 }
 
 Node::Node(const Node& source)
@@ -277,42 +429,693 @@ Node& Node::operator = (const Node& source)
   panic("Scene graph nodes may not be assigned");
 }
 
+void Node::enqueueNodes(const List& nodes,
+                        render::Scene& scene,
+                        const Camera& camera)
+{
+  const Frustum& frustum = camera.getFrustum();
+
+  uint8 visible[CULL_BATCH_SIZE];
+
+  for (size_t start = 0;  start < nodes.size();  start += CULL_BATCH_SIZE)
+  {
+    const size_t count = std::min(nodes.size() - start, CULL_BATCH_SIZE);
+
+    cullNodes(&nodes[start], count, frustum, visible);
+
+    for (size_t i = 0;  i < count;  i++)
+    {
+      if (visible[i])
+        nodes[start + i]->enqueue(scene, camera);
+    }
+  }
+}
+
 void Node::invalidateBounds()
 {
-  for (Node* node = this;  node;  node = node->getParent())
+  Node* node = this;
+
+  for (;;)
+  {
     node->dirtyBounds = true;
+    node->invalidateChildProxy();
+
+    if (!node->parent)
+      break;
+
+    node = node->parent;
+  }
+
+  node->invalidateTree();
 }
 
 void Node::invalidateWorldTransform()
 {
-  dirtyWorld = true;
+  if (graph)
+    graph->transforms.setLocalTransform(slot, local);
 
-  for (auto c = children.begin();  c != children.end();  c++)
-    (*c)->invalidateWorldTransform();
+  invalidateChildProxy();
+  invalidateTree();
+}
+
+void Node::invalidateTree()
+{
+  if (graph && proxy != NodeTree::NONE && !dirtyTree)
+  {
+    dirtyTree = true;
+
+    std::lock_guard<std::mutex> lock(graph->movedMutex);
+    graph->moved.push_back(this);
+  }
+}
+
+void Node::invalidateChildProxy()
+{
+  if (parent && childProxy != NodeTree::NONE && !dirtyChildProxy)
+  {
+    dirtyChildProxy = true;
+    parent->movedChildren.push_back(this);
+  }
+}
+
+bool Node::updateChildTree() const
+{
+  // The world bounds of all children change when this node moves, so
+  // children are culled one by one until it has stopped moving
+  const Transform3& transform = getWorldTransform();
+  if (!isSameTransform(transform, childTreeTransform))
+  {
+    childTreeTransform = transform;
+    dirtyChildTree = true;
+    return false;
+  }
+
+  const List& nodes = dirtyChildTree ? children : movedChildren;
+
+  for (auto c = nodes.begin();  c != nodes.end();  c++)
+  {
+    childTree->update((*c)->childProxy, (*c)->getWorldBounds());
+    (*c)->dirtyChildProxy = false;
+  }
+
+  if (dirtyChildTree)
+  {
+    for (auto c = movedChildren.begin();  c != movedChildren.end();  c++)
+      (*c)->dirtyChildProxy = false;
+
+    dirtyChildTree = false;
+  }
+
+  movedChildren.clear();
+  return true;
 }
 
 void Node::setGraph(Graph* newGraph)
 {
-  if (graph && needsUpdate)
+  if (graph)
   {
-    List& updated = graph->updated;
-    updated.erase(std::find(updated.begin(), updated.end(), this));
+    graph->dirtyGroups = true;
+
+    if (needsUpdate)
+    {
+      List& updated = graph->updated;
+      updated.erase(std::find(updated.begin(), updated.end(), this));
+    }
+
+    graph->transforms.remove(slot);
+    slot = TransformHierarchy::NONE;
   }
 
   graph = newGraph;
 
-  if (graph && needsUpdate)
+  if (graph)
   {
-    List& updated = graph->updated;
-    updated.push_back(this);
+    graph->dirtyGroups = true;
+
+    if (needsUpdate)
+    {
+      List& updated = graph->updated;
+      updated.push_back(this);
+    }
+
+    // Children are added after their parent, keeping parents first
+    if (parent)
+      slot = graph->transforms.insert(*this, parent->slot, local);
+    else
+      slot = graph->transforms.insert(*this, TransformHierarchy::NONE, local);
   }
 
   for (auto c = children.begin();  c != children.end();  c++)
     (*c)->setGraph(graph);
 }
 
+Sphere Node::getWorldBounds() const
+{
+  Sphere worldBounds = getTotalBounds();
+  worldBounds.transformBy(getWorldTransform());
+  return worldBounds;
+}
+
 ///////////////////////////////////////////////////////////////////////
 
+NodeTree::NodeTree():
+  root(NONE),
+  freeList(NONE)
+{
+}
+
+uint NodeTree::insert(Node& node, const Sphere& bounds)
+{
+  const uint leaf = allocate();
+
+  Entry& entry = entries[leaf];
+  entry.node = &node;
+  entry.bounds = bounds;
+  entry.minimum = bounds.center - vec3(bounds.radius * (1.f + TREE_MARGIN));
+  entry.maximum = bounds.center + vec3(bounds.radius * (1.f + TREE_MARGIN));
+  entry.height = 0;
+
+  insertLeaf(leaf);
+  return leaf;
+}
+
+void NodeTree::remove(uint proxy)
+{
+  removeLeaf(proxy);
+  release(proxy);
+}
+
+void NodeTree::update(uint proxy, const Sphere& bounds)
+{
+  Entry& entry = entries[proxy];
+  entry.bounds = bounds;
+
+  const vec3 minimum = bounds.center - vec3(bounds.radius);
+  const vec3 maximum = bounds.center + vec3(bounds.radius);
+
+  if (all(greaterThanEqual(minimum, entry.minimum)) &&
+      all(lessThanEqual(maximum, entry.maximum)))
+  {
+    return;
+  }
+
+  removeLeaf(proxy);
+
+  entry.minimum = bounds.center - vec3(bounds.radius * (1.f + TREE_MARGIN));
+  entry.maximum = bounds.center + vec3(bounds.radius * (1.f + TREE_MARGIN));
+
+  insertLeaf(proxy);
+}
+
+void NodeTree::query(const Sphere& sphere, std::vector<Node*>& nodes) const
+{
+  if (root == NONE)
+    return;
+
+  std::vector<uint> stack;
+  stack.push_back(root);
+
+  while (!stack.empty())
+  {
+    const Entry& entry = entries[stack.back()];
+    stack.pop_back();
+
+    const vec3 closest = clamp(sphere.center, entry.minimum, entry.maximum);
+    if (length2(closest - sphere.center) > sphere.radius * sphere.radius)
+      continue;
+
+    if (entry.isLeaf())
+    {
+      if (sphere.intersects(entry.bounds))
+        nodes.push_back(entry.node);
+    }
+    else
+    {
+      stack.push_back(entry.left);
+      stack.push_back(entry.right);
+    }
+  }
+}
+
+void NodeTree::query(const Frustum& frustum, std::vector<Node*>& nodes) const
+{
+  if (root == NONE)
+    return;
+
+  std::vector<uint> stack;
+  stack.push_back(root);
+
+  while (!stack.empty())
+  {
+    const uint index = stack.back();
+    stack.pop_back();
+
+    const Entry& entry = entries[index];
+
+    if (entry.isLeaf())
+    {
+      if (frustum.intersects(entry.bounds))
+        nodes.push_back(entry.node);
+
+      continue;
+    }
+
+    const Containment containment = classify(frustum,
+                                             entry.minimum,
+                                             entry.maximum);
+
+    if (containment == INSIDE)
+      collect(index, nodes);
+    else if (containment == INTERSECTING)
+    {
+      stack.push_back(entry.left);
+      stack.push_back(entry.right);
+    }
+  }
+}
+
+uint NodeTree::allocate()
+{
+  uint index;
+
+  if (freeList == NONE)
+  {
+    index = uint(entries.size());
+    entries.push_back(Entry());
+  }
+  else
+  {
+    index = freeList;
+    freeList = entries[index].parent;
+  }
+
+  Entry& entry = entries[index];
+  entry.node = NULL;
+  entry.parent = NONE;
+  entry.left = NONE;
+  entry.right = NONE;
+  entry.height = 0;
+
+  return index;
+}
+
+void NodeTree::release(uint index)
+{
+  entries[index].node = NULL;
+  entries[index].parent = freeList;
+  entries[index].height = -1;
+  freeList = index;
+}
+
+void NodeTree::insertLeaf(uint leaf)
+{
+  if (root == NONE)
+  {
+    root = leaf;
+    entries[leaf].parent = NONE;
+    return;
+  }
+
+  const vec3 minimum = entries[leaf].minimum;
+  const vec3 maximum = entries[leaf].maximum;
+
+  // Descend towards the sibling that minimizes the increase in total cost,
+  // stopping when creating a new parent here is cheaper than going deeper
+  uint index = root;
+
+  while (!entries[index].isLeaf())
+  {
+    const Entry& entry = entries[index];
+
+    const float cost = getCost(entry.minimum, entry.maximum);
+    const float combinedCost = getCost(min(entry.minimum, minimum),
+                                       max(entry.maximum, maximum));
+
+    const float parentCost = 2.f * combinedCost;
+    const float inheritedCost = 2.f * (combinedCost - cost);
+
+    float childCosts[2];
+    const uint children[] = { entry.left, entry.right };
+
+    for (size_t i = 0;  i < 2;  i++)
+    {
+      const Entry& child = entries[children[i]];
+
+      childCosts[i] = getCost(min(child.minimum, minimum),
+                              max(child.maximum, maximum)) + inheritedCost;
+
+      if (!child.isLeaf())
+        childCosts[i] -= getCost(child.minimum, child.maximum);
+    }
+
+    if (parentCost < childCosts[0] && parentCost < childCosts[1])
+      break;
+
+    if (childCosts[0] < childCosts[1])
+      index = entry.left;
+    else
+      index = entry.right;
+  }
+
+  const uint sibling = index;
+  const uint oldParent = entries[sibling].parent;
+  const uint newParent = allocate();
+
+  Entry& parent = entries[newParent];
+  parent.parent = oldParent;
+  parent.left = sibling;
+  parent.right = leaf;
+  parent.minimum = min(entries[sibling].minimum, minimum);
+  parent.maximum = max(entries[sibling].maximum, maximum);
+  parent.height = entries[sibling].height + 1;
+
+  if (oldParent == NONE)
+    root = newParent;
+  else if (entries[oldParent].left == sibling)
+    entries[oldParent].left = newParent;
+  else
+    entries[oldParent].right = newParent;
+
+  entries[sibling].parent = newParent;
+  entries[leaf].parent = newParent;
+
+  refit(newParent);
+}
+
+void NodeTree::removeLeaf(uint leaf)
+{
+  if (leaf == root)
+  {
+    root = NONE;
+    return;
+  }
+
+  const uint parent = entries[leaf].parent;
+  const uint grandParent = entries[parent].parent;
+
+  uint sibling;
+  if (entries[parent].left == leaf)
+    sibling = entries[parent].right;
+  else
+    sibling = entries[parent].left;
+
+  entries[sibling].parent = grandParent;
+  release(parent);
+
+  if (grandParent == NONE)
+  {
+    root = sibling;
+    return;
+  }
+
+  if (entries[grandParent].left == parent)
+    entries[grandParent].left = sibling;
+  else
+    entries[grandParent].right = sibling;
+
+  refit(grandParent);
+}
+
+uint NodeTree::balance(uint indexA)
+{
+  Entry& A = entries[indexA];
+  if (A.isLeaf() || A.height < 2)
+    return indexA;
+
+  const uint indexB = A.left;
+  const uint indexC = A.right;
+  Entry& B = entries[indexB];
+  Entry& C = entries[indexC];
+
+  if (C.height - B.height > 1)
+  {
+    // Rotate C up, moving its shorter child under A
+    const uint indexF = C.left;
+    const uint indexG = C.right;
+    Entry& F = entries[indexF];
+    Entry& G = entries[indexG];
+
+    C.left = indexA;
+    C.parent = A.parent;
+    A.parent = indexC;
+
+    if (C.parent == NONE)
+      root = indexC;
+    else if (entries[C.parent].left == indexA)
+      entries[C.parent].left = indexC;
+    else
+      entries[C.parent].right = indexC;
+
+    if (F.height > G.height)
+    {
+      C.right = indexF;
+      A.right = indexG;
+      G.parent = indexA;
+      A.minimum = min(B.minimum, G.minimum);
+      A.maximum = max(B.maximum, G.maximum);
+      C.minimum = min(A.minimum, F.minimum);
+      C.maximum = max(A.maximum, F.maximum);
+      A.height = 1 + std::max(B.height, G.height);
+      C.height = 1 + std::max(A.height, F.height);
+    }
+    else
+    {
+      C.right = indexG;
+      A.right = indexF;
+      F.parent = indexA;
+      A.minimum = min(B.minimum, F.minimum);
+      A.maximum = max(B.maximum, F.maximum);
+      C.minimum = min(A.minimum, G.minimum);
+      C.maximum = max(A.maximum, G.maximum);
+      A.height = 1 + std::max(B.height, F.height);
+      C.height = 1 + std::max(A.height, G.height);
+    }
+
+    return indexC;
+  }
+
+  if (B.height - C.height > 1)
+  {
+    // Rotate B up, moving its shorter child under A
+    const uint indexD = B.left;
+    const uint indexE = B.right;
+    Entry& D = entries[indexD];
+    Entry& E = entries[indexE];
+
+    B.left = indexA;
+    B.parent = A.parent;
+    A.parent = indexB;
+
+    if (B.parent == NONE)
+      root = indexB;
+    else if (entries[B.parent].left == indexA)
+      entries[B.parent].left = indexB;
+    else
+      entries[B.parent].right = indexB;
+
+    if (D.height > E.height)
+    {
+      B.right = indexD;
+      A.left = indexE;
+      E.parent = indexA;
+      A.minimum = min(C.minimum, E.minimum);
+      A.maximum = max(C.maximum, E.maximum);
+      B.minimum = min(A.minimum, D.minimum);
+      B.maximum = max(A.maximum, D.maximum);
+      A.height = 1 + std::max(C.height, E.height);
+      B.height = 1 + std::max(A.height, D.height);
+    }
+    else
+    {
+      B.right = indexE;
+      A.left = indexD;
+      D.parent = indexA;
+      A.minimum = min(C.minimum, D.minimum);
+      A.maximum = max(C.maximum, D.maximum);
+      B.minimum = min(A.minimum, E.minimum);
+      B.maximum = max(A.maximum, E.maximum);
+      A.height = 1 + std::max(C.height, D.height);
+      B.height = 1 + std::max(A.height, E.height);
+    }
+
+    return indexB;
+  }
+
+  return indexA;
+}
+
+void NodeTree::refit(uint index)
+{
+  while (index != NONE)
+  {
+    index = balance(index);
+
+    Entry& entry = entries[index];
+    const Entry& left = entries[entry.left];
+    const Entry& right = entries[entry.right];
+
+    entry.minimum = min(left.minimum, right.minimum);
+    entry.maximum = max(left.maximum, right.maximum);
+    entry.height = 1 + std::max(left.height, right.height);
+
+    index = entry.parent;
+  }
+}
+
+void NodeTree::collect(uint index, std::vector<Node*>& nodes) const
+{
+  const Entry& entry = entries[index];
+
+  if (entry.isLeaf())
+    nodes.push_back(entry.node);
+  else
+  {
+    collect(entry.left, nodes);
+    collect(entry.right, nodes);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////
+
+TransformHierarchy::TransformHierarchy():
+  deadCount(0),
+  anyDirty(false)
+{
+}
+
+uint TransformHierarchy::insert(Node& node, uint parent, const Transform3& local)
+{
+  assert(parent == NONE || parent < nodes.size());
+
+  locals.push_back(local);
+  worlds.push_back(local);
+  parents.push_back(parent);
+  nodes.push_back(&node);
+  dirty.push_back(1);
+  anyDirty = true;
+
+  return uint(nodes.size() - 1);
+}
+
+void TransformHierarchy::remove(uint slot)
+{
+  nodes[slot] = NULL;
+  dirty[slot] = 0;
+  deadCount++;
+}
+
+void TransformHierarchy::setLocalTransform(uint slot, const Transform3& local)
+{
+  locals[slot] = local;
+  dirty[slot] = 1;
+  anyDirty = true;
+}
+
+const Transform3& TransformHierarchy::getWorldTransform(uint slot)
+{
+  // Only the ancestors of this node are updated, leaving the dirty flags for
+  // the next full pass
+  if (anyDirty)
+    refresh(slot);
+
+  return worlds[slot];
+}
+
+void TransformHierarchy::update()
+{
+  if (deadCount > nodes.size() / 2)
+    compact();
+
+  if (!anyDirty)
+    return;
+
+  const size_t count = nodes.size();
+
+  // Removed slots are not skipped, as they are never parents of live ones and
+  // updating them is harmless
+  for (size_t i = 0;  i < count;  i++)
+  {
+    const uint parent = parents[i];
+
+    if (parent == NONE)
+    {
+      if (dirty[i])
+        worlds[i] = locals[i];
+    }
+    else if (dirty[i] || dirty[parent])
+    {
+      worlds[i] = worlds[parent] * locals[i];
+      dirty[i] = 1;
+    }
+  }
+
+  dirty.assign(count, 0);
+  anyDirty = false;
+}
+
+bool TransformHierarchy::refresh(uint slot)
+{
+  const uint parent = parents[slot];
+
+  bool changed = dirty[slot];
+
+  if (parent != NONE && refresh(parent))
+    changed = true;
+
+  if (changed)
+  {
+    if (parent == NONE)
+      worlds[slot] = locals[slot];
+    else
+      worlds[slot] = worlds[parent] * locals[slot];
+  }
+
+  return changed;
+}
+
+void TransformHierarchy::compact()
+{
+  std::vector<uint> remap(nodes.size(), NONE);
+  size_t count = 0;
+
+  for (size_t i = 0;  i < nodes.size();  i++)
+  {
+    if (!nodes[i])
+      continue;
+
+    remap[i] = uint(count);
+
+    locals[count] = locals[i];
+    worlds[count] = worlds[i];
+    dirty[count] = dirty[i];
+    nodes[count] = nodes[i];
+    nodes[count]->slot = uint(count);
+
+    // Parents precede their children, so they have already been remapped
+    if (parents[i] == NONE)
+      parents[count] = NONE;
+    else
+      parents[count] = remap[parents[i]];
+
+    count++;
+  }
+
+  locals.resize(count);
+  worlds.resize(count);
+  parents.resize(count);
+  nodes.resize(count);
+  dirty.resize(count);
+  deadCount = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+
+Graph::Graph():
+  dirtyGroups(false),
+  revision(0)
+{
+}
+
 Graph::~Graph()
 {
   destroyRootNodes();
@@ -320,48 +1123,103 @@ Graph::~Graph()
 
 void Graph::update()
 {
-  for (auto n = updated.begin();  n != updated.end();  n++)
-    (*n)->update();
+  if (jobs && updated.size() >= PARALLEL_NODE_COUNT)
+  {
+    // Each subtree is only touched by a single job, which updates its nodes in
+    // list order.  This keeps the world transforms read by light and camera
+    // nodes the same as for a serial update
+    if (dirtyGroups)
+      updateGroups();
+
+    jobs->parallelFor(groups.size(), 0, [&](size_t first, size_t last)
+    {
+      for (size_t g = first;  g < last;  g++)
+      {
+        for (auto n = groups[g].begin();  n != groups[g].end();  n++)
+          (*n)->update();
+      }
+    });
+  }
+  else
+  {
+    for (auto n = updated.begin();  n != updated.end();  n++)
+      (*n)->update();
+  }
+
+  transforms.update();
 }
 
 void Graph::enqueue(render::Scene& scene, const Camera& camera) const
 {
   ProfileNodeCall call("scene::Graph::enqueue");
 
-  const Frustum& frustum = camera.getFrustum();
+  updateTree();
 
-  for (auto r = roots.begin();  r != roots.end();  r++)
+  Node::List visible;
+  tree.query(camera.getFrustum(), visible);
+
+  if (!jobs || visible.size() < PARALLEL_NODE_COUNT)
   {
-    Sphere worldBounds = (*r)->getTotalBounds();
-    worldBounds.transformBy((*r)->getWorldTransform());
+    for (auto n = visible.begin();  n != visible.end();  n++)
+      (*n)->enqueue(scene, camera);
 
-    if (frustum.intersects(worldBounds))
-      (*r)->enqueue(scene, camera);
+    return;
   }
-}
 
-void Graph::query(const Sphere& sphere, Node::List& nodes) const
-{
-  for (auto r = roots.begin();  r != roots.end();  r++)
+  // The lazily computed transforms of the camera are brought up to date
+  // before it is shared between threads
+  camera.getViewTransform();
+
+  const size_t chunkCount = std::min(visible.size(),
+                                     size_t(jobs->getWorkerCount()) * 4);
+  const size_t chunkSize = (visible.size() + chunkCount - 1) / chunkCount;
+
+  // The chunk scenes are kept between calls so that their queues keep their
+  // storage
+  if (!chunks.empty() && &chunks.front().getGeometryPool() != &scene.getGeometryPool())
+    chunks.clear();
+
+  while (chunks.size() < chunkCount)
+    chunks.push_back(render::Scene(scene.getGeometryPool()));
+
+  for (size_t c = 0;  c < chunkCount;  c++)
   {
-    Sphere worldBounds = (*r)->getTotalBounds();
-    worldBounds.transformBy((*r)->getWorldTransform());
+    chunks[c].setPhase(scene.getPhase());
+    chunks[c].getOpaqueQueue().setSortMode(scene.getOpaqueQueue().getSortMode());
+    chunks[c].getBlendedQueue().setSortMode(scene.getBlendedQueue().getSortMode());
+  }
 
-    if (sphere.intersects(worldBounds))
-      nodes.push_back(*r);
+  jobs->parallelFor(chunkCount, 1, [&](size_t first, size_t last)
+  {
+    for (size_t c = first;  c < last;  c++)
+    {
+      const size_t end = std::min((c + 1) * chunkSize, visible.size());
+
+      for (size_t i = c * chunkSize;  i < end;  i++)
+        visible[i]->enqueue(chunks[c], camera);
+    }
+  });
+
+  // Merging in chunk order gives the same operations and lights, in the same
+  // order, as enqueueing on a single thread
+  for (size_t c = 0;  c < chunkCount;  c++)
+  {
+    scene.append(chunks[c]);
+    chunks[c].removeOperations();
+    chunks[c].detachLights();
   }
 }
 
-void Graph::query(const Frustum& frustum, Node::List& nodes) const
+void Graph::query(const Sphere& sphere, Node::List& nodes) const
 {
-  for (auto r = roots.begin();  r != roots.end();  r++)
-  {
-    Sphere worldBounds = (*r)->getTotalBounds();
-    worldBounds.transformBy((*r)->getWorldTransform());
+  updateTree();
+  tree.query(sphere, nodes);
+}
 
-    if (frustum.intersects(worldBounds))
-      nodes.push_back(*r);
-  }
+void Graph::query(const Frustum& frustum, Node::List& nodes) const
+{
+  updateTree();
+  tree.query(frustum, nodes);
 }
 
 void Graph::addRootNode(Node& node)
@@ -369,6 +1227,8 @@ void Graph::addRootNode(Node& node)
   node.removeFromParent();
   roots.push_back(&node);
   node.setGraph(this);
+  node.proxy = tree.insert(node, node.getWorldBounds());
+  revision++;
 }
 
 void Graph::destroyRootNodes()
@@ -382,6 +1242,63 @@ const Node::List& Graph::getNodes() const
   return roots;
 }
 
+uint Graph::getRevision() const
+{
+  return revision;
+}
+
+JobSystem* Graph::getJobSystem() const
+{
+  return jobs;
+}
+
+void Graph::setJobSystem(JobSystem* newJobSystem)
+{
+  jobs = newJobSystem;
+}
+
+void Graph::updateGroups()
+{
+  std::unordered_map<Node*, size_t> groupIndices;
+
+  groups.clear();
+
+  for (auto n = updated.begin();  n != updated.end();  n++)
+  {
+    Node* root = *n;
+    while (root->parent)
+      root = root->parent;
+
+    auto entry = groupIndices.insert(std::make_pair(root, groups.size()));
+    if (entry.second)
+      groups.push_back(Node::List());
+
+    groups[entry.first->second].push_back(*n);
+  }
+
+  dirtyGroups = false;
+}
+
+void Graph::updateTree() const
+{
+  transforms.update();
+
+  // Nodes may have been moved by several threads, so the tree is updated in
+  // proxy order to keep its shape independent of their timing
+  std::sort(moved.begin(), moved.end(), [](const Node* a, const Node* b)
+  {
+    return a->proxy < b->proxy;
+  });
+
+  for (auto n = moved.begin();  n != moved.end();  n++)
+  {
+    tree.update((*n)->proxy, (*n)->getWorldBounds());
+    (*n)->dirtyTree = false;
+  }
+
+  moved.clear();
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 LightNode::LightNode():
@@ -450,6 +1367,7 @@ bool ModelNode::isShadowCaster() const
 void ModelNode::setCastsShadows(bool enabled)
 {
   shadowCaster = enabled;
+  invalidateGraph();
 }
 
 render::Model* ModelNode::getModel() const
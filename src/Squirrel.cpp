@@ -272,7 +272,7 @@ bool VM::execute(const char* name)
     return false;
   }
 
-  std::ifstream stream(path.asString().c_str());
+  ResourceStream stream(cache, path);
   if (stream.fail())
   {
     logError("Failed to open script \'%s\'", name);
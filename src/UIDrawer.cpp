@@ -112,7 +112,7 @@ ThemeReader::ThemeReader(render::GeometryPool& initPool):
 
 Ref<Theme> ThemeReader::read(const String& name, const Path& path)
 {
-  std::ifstream stream(path.asString().c_str());
+  ResourceStream stream(cache, path);
   if (stream.fail())
   {
     logError("Failed to open animation \'%s\'", name.c_str());
@@ -328,7 +328,7 @@ void Drawer::drawBezier(const BezierCurve2& spline, const vec4& color)
 
   // Realize vertices
   {
-    GL::VertexRangeLock<Vertex2fv> vertices(range);
+    GL::VertexRangeLock<Vertex2fv> vertices(range, GL::LOCK_WRITE_UNSYNCHRONIZED);
 
     for (uint i = 0;  i < points.size();  i++)
       vertices[i].position = points[i];
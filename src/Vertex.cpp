@@ -62,6 +62,15 @@ size_t VertexComponent::getSize() const
   {
     case FLOAT32:
       return 4 * count;
+    case FLOAT16:
+    case SNORM16:
+    case UNORM16:
+      return 2 * count;
+    case SNORM8:
+    case UNORM8:
+      return count;
+    case INT_2_10_10_10_REV:
+      return 4;
     default:
       panic("Invalid vertex component type");
   }
@@ -109,6 +118,12 @@ bool VertexFormat::createComponent(const char* name,
     return false;
   }
 
+  if (type == VertexComponent::INT_2_10_10_10_REV && count < 3)
+  {
+    logError("Packed vertex components must have 3 or 4 elements");
+    return false;
+  }
+
   if (findComponent(name))
   {
     logError("Duplicate vertex component name \'%s\' detected; vertex "
@@ -146,11 +161,31 @@ bool VertexFormat::createComponents(const char* specification)
 
     VertexComponent::Type type;
 
-    switch (std::tolower(*c))
+    // Lower case letters are signed and upper case letters unsigned
+    switch (*c)
     {
       case 'f':
+      case 'F':
         type = VertexComponent::FLOAT32;
         break;
+      case 'h':
+        type = VertexComponent::FLOAT16;
+        break;
+      case 'b':
+        type = VertexComponent::SNORM8;
+        break;
+      case 'B':
+        type = VertexComponent::UNORM8;
+        break;
+      case 's':
+        type = VertexComponent::SNORM16;
+        break;
+      case 'S':
+        type = VertexComponent::UNORM16;
+        break;
+      case 'p':
+        type = VertexComponent::INT_2_10_10_10_REV;
+        break;
       default:
         if (std::isgraph(*c))
           logError("Invalid vertex component type \'%c\'", *c);
@@ -243,6 +278,24 @@ String VertexFormat::asString() const
       case VertexComponent::FLOAT32:
         result << 'f';
         break;
+      case VertexComponent::FLOAT16:
+        result << 'h';
+        break;
+      case VertexComponent::SNORM8:
+        result << 'b';
+        break;
+      case VertexComponent::UNORM8:
+        result << 'B';
+        break;
+      case VertexComponent::SNORM16:
+        result << 's';
+        break;
+      case VertexComponent::UNORM16:
+        result << 'S';
+        break;
+      case VertexComponent::INT_2_10_10_10_REV:
+        result << 'p';
+        break;
       default:
         panic("Invalid vertex component type");
     }
@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////
+// Wendy unit tests
+// Copyright (c) 2006 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any
+// damages arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any
+// purpose, including commercial applications, and to alter it and
+// redistribute it freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you
+//     must not claim that you wrote the original software. If you use
+//     this software in a product, an acknowledgment in the product
+//     documentation would be appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and
+//     must not be misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source
+//     distribution.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <wendy/Config.h>
+#include <wendy/Core.h>
+#include <wendy/AABB.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+///////////////////////////////////////////////////////////////////////
+
+using namespace wendy;
+
+///////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char* description)
+{
+  if (!condition)
+  {
+    std::fprintf(stderr, "FAILED: %s\n", description);
+    failures++;
+  }
+}
+
+// The size of a box is its full width, height and depth
+void testBoundsAreHalfSizeAroundCenter()
+{
+  const AABB box(vec3(1.f, 2.f, 3.f), vec3(4.f, 6.f, 8.f));
+
+  float minX, minY, minZ, maxX, maxY, maxZ;
+  box.getBounds(minX, minY, minZ, maxX, maxY, maxZ);
+
+  check(minX == -1.f && minY == -1.f && minZ == -1.f,
+        "getBounds minimum is center minus half size");
+  check(maxX == 3.f && maxY == 5.f && maxZ == 7.f,
+        "getBounds maximum is center plus half size");
+}
+
+void testBoundsRoundTrip()
+{
+  AABB box;
+  box.setBounds(-2.f, 0.f, 1.f, 4.f, 3.f, 2.f);
+
+  check(box.center == vec3(1.f, 1.5f, 1.5f), "setBounds stores the center");
+  check(box.size == vec3(6.f, 3.f, 1.f), "setBounds stores the full size");
+
+  float minX, minY, minZ, maxX, maxY, maxZ;
+  box.getBounds(minX, minY, minZ, maxX, maxY, maxZ);
+
+  check(minX == -2.f && minY == 0.f && minZ == 1.f &&
+        maxX == 4.f && maxY == 3.f && maxZ == 2.f,
+        "getBounds returns the bounds given to setBounds");
+}
+
+void testNegativeSize()
+{
+  const AABB box(vec3(0.f), vec3(-2.f, -2.f, -2.f));
+
+  float minX, minY, minZ, maxX, maxY, maxZ;
+  box.getBounds(minX, minY, minZ, maxX, maxY, maxZ);
+
+  check(minX == -1.f && maxX == 1.f, "getBounds uses the absolute size");
+}
+
+void testContainment()
+{
+  const AABB box(2.f, 2.f, 2.f);
+
+  check(box.contains(vec3(1.f, 1.f, 1.f)), "contains a point on the boundary");
+  check(!box.contains(vec3(1.5f, 0.f, 0.f)), "excludes a point past half size");
+  check(box.intersects(AABB(vec3(1.05f, 0.f, 0.f), vec3(0.2f))),
+        "intersects an overlapping box");
+  check(!box.intersects(AABB(vec3(1.5f, 0.f, 0.f), vec3(0.2f))),
+        "does not intersect a box past half size");
+}
+
+void testEnvelopKeepsSize()
+{
+  AABB box(vec3(0.f), vec3(2.f));
+  box.envelop(vec3(0.5f));
+
+  check(box.size == vec3(2.f), "enveloping an inner point keeps the size");
+
+  box.envelop(vec3(3.f, 0.f, 0.f));
+
+  check(box.size.x == 4.f && box.center.x == 1.f,
+        "enveloping an outer point grows to reach it");
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
+int main()
+{
+  testBoundsAreHalfSizeAroundCenter();
+  testBoundsRoundTrip();
+  testNegativeSize();
+  testContainment();
+  testEnvelopKeepsSize();
+
+  if (failures)
+    std::exit(EXIT_FAILURE);
+
+  std::exit(EXIT_SUCCESS);
+}
+
+///////////////////////////////////////////////////////////////////////
@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////
+// Wendy unit tests
+// Copyright (c) 2006 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any
+// damages arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any
+// purpose, including commercial applications, and to alter it and
+// redistribute it freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you
+//     must not claim that you wrote the original software. If you use
+//     this software in a product, an acknowledgment in the product
+//     documentation would be appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and
+//     must not be misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source
+//     distribution.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <wendy/Config.h>
+#include <wendy/Core.h>
+#include <wendy/Path.h>
+#include <wendy/Resource.h>
+#include <wendy/AABB.h>
+#include <wendy/Sphere.h>
+#include <wendy/Mesh.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+
+///////////////////////////////////////////////////////////////////////
+
+using namespace wendy;
+
+///////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const char* description)
+{
+  if (!condition)
+  {
+    std::fprintf(stderr, "FAILED: %s\n", description);
+    failures++;
+  }
+}
+
+const uint GRID_SIZE = 8;
+
+// Adds a grid of quads with its own copies of the vertices, starting at the
+// specified column, as a new section
+void addGridSection(Mesh& mesh, uint column, const char* materialName)
+{
+  const uint32 base = uint32(mesh.vertices.size());
+
+  for (uint y = 0;  y <= GRID_SIZE;  y++)
+  {
+    for (uint x = 0;  x <= GRID_SIZE;  x++)
+    {
+      MeshVertex vertex;
+      vertex.position = vec3(float(column + x), float(y), 0.f);
+      vertex.normal = vec3(0.f, 0.f, 1.f);
+      vertex.texcoord = vec2(vertex.position);
+      mesh.vertices.push_back(vertex);
+    }
+  }
+
+  mesh.sections.push_back(MeshSection());
+  MeshSection& section = mesh.sections.back();
+  section.materialName = materialName;
+
+  for (uint y = 0;  y < GRID_SIZE;  y++)
+  {
+    for (uint x = 0;  x < GRID_SIZE;  x++)
+    {
+      const uint32 a = base + y * (GRID_SIZE + 1) + x;
+      const uint32 b = a + 1;
+      const uint32 c = a + GRID_SIZE + 1;
+      const uint32 d = c + 1;
+
+      MeshTriangle triangle;
+      triangle.normal = vec3(0.f, 0.f, 1.f);
+
+      triangle.setIndices(a, b, d);
+      section.triangles.push_back(triangle);
+
+      triangle.setIndices(a, d, c);
+      section.triangles.push_back(triangle);
+    }
+  }
+}
+
+bool usesOnlyOwnVertices(const MeshSection& section)
+{
+  std::set<uint32> own;
+
+  for (auto t = section.triangles.begin();  t != section.triangles.end();  t++)
+    own.insert(t->indices, t->indices + 3);
+
+  for (auto l = section.levels.begin();  l != section.levels.end();  l++)
+  {
+    for (auto t = l->begin();  t != l->end();  t++)
+    {
+      for (size_t k = 0;  k < 3;  k++)
+      {
+        if (!own.count(t->indices[k]))
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool hasValidIndices(const Mesh& mesh)
+{
+  for (auto s = mesh.sections.begin();  s != mesh.sections.end();  s++)
+  {
+    for (auto l = s->levels.begin();  l != s->levels.end();  l++)
+    {
+      for (auto t = l->begin();  t != l->end();  t++)
+      {
+        for (size_t k = 0;  k < 3;  k++)
+        {
+          if (t->indices[k] >= mesh.vertices.size())
+            return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+// Two sections sharing the positions along their common edge, with the
+// second section's copies of those vertices coming first
+void testSectionsSharingPositions()
+{
+  ResourceCache cache;
+  Ref<Mesh> mesh(new Mesh(ResourceInfo(cache)));
+
+  addGridSection(*mesh, GRID_SIZE, "right");
+  addGridSection(*mesh, 0, "left");
+
+  mesh->generateLevels(2);
+
+  check(!mesh->sections[0].levels.empty() && !mesh->sections[1].levels.empty(),
+        "both sections are simplified");
+  check(usesOnlyOwnVertices(mesh->sections[0]),
+        "levels of the first section only use its own vertices");
+  check(usesOnlyOwnVertices(mesh->sections[1]),
+        "levels of the second section only use its own vertices");
+
+  mesh->optimize();
+
+  check(hasValidIndices(*mesh), "optimized levels have valid indices");
+}
+
+} /*namespace*/
+
+///////////////////////////////////////////////////////////////////////
+
+int main()
+{
+  testSectionsSharingPositions();
+
+  if (failures)
+    std::exit(EXIT_FAILURE);
+
+  std::exit(EXIT_SUCCESS);
+}
+
+///////////////////////////////////////////////////////////////////////